@@ -43,6 +43,13 @@ nassh.PluginCommand = function(params) {
   // Prevent us from reporting an exit twice.
   this.exited_ = false;
 
+  // Callbacks waiting for the plugin's reply to getStats.
+  this.statsCallbacks_ = [];
+
+  // Whether stream data goes to the plugin as ArrayBuffers.  Set from the
+  // plugin's sessionStarted message; until then data goes as base64.
+  this.binaryMessages_ = false;
+
   // Various callbacks.
   this.onLoad_ = params.onLoad;
   this.onExit_ = params.onExit;
@@ -51,6 +58,15 @@ nassh.PluginCommand = function(params) {
   this.run_();
 };
 
+/**
+ * Binary plugin messages are ArrayBuffers with an 8 byte header: the message
+ * type in byte 0, three zero bytes, then the little-endian int32 stream id.
+ * The rest of the buffer is the stream data.  Keep in sync with plugin.cc.
+ */
+nassh.PluginCommand.BINARY_WRITE = 1;
+nassh.PluginCommand.BINARY_READ = 2;
+nassh.PluginCommand.BINARY_HEADER_SIZE = 8;
+
 /**
  * Start the plugin.
  */
@@ -61,6 +77,11 @@ nassh.PluginCommand.prototype.run_ = function() {
   argv.useJsSocket = !!this.relay_;
   argv.environment = this.environment_;
   argv.writeWindow = 8 * 1024;
+  // Older browsers can only post strings to NaCl; the plugin falls back to
+  // base64 in JSON if we don't ask for binary messages, or if it can't
+  // handle them itself.  It says which in sessionStarted.
+  argv.binaryMessages =
+      !!(window.ArrayBuffer && window.Uint8Array && window.DataView);
   argv.arguments = this.arguments_;
 
   var self = this;
@@ -131,13 +152,38 @@ nassh.PluginCommand.prototype.sendToPlugin_ = function(name, args) {
     this.plugin_.postMessage(str);
 };
 
+/**
+ * Send stream data to the plugin.
+ *
+ * @param {integer} id The stream id.
+ * @param {string} string The data, one byte per character.
+ */
+nassh.PluginCommand.prototype.sendReadToPlugin_ = function(id, string) {
+  if (!this.binaryMessages_) {
+    this.sendToPlugin_('onRead', [id, btoa(string)]);
+    return;
+  }
+
+  var headerSize = nassh.PluginCommand.BINARY_HEADER_SIZE;
+  var buffer = new ArrayBuffer(headerSize + string.length);
+  var view = new DataView(buffer);
+  view.setUint8(0, nassh.PluginCommand.BINARY_READ);
+  view.setInt32(4, id, true);
+  var bytes = new Uint8Array(buffer, headerSize);
+  for (var i = 0; i < string.length; i++)
+    bytes[i] = string.charCodeAt(i);
+
+  if (this.plugin_)
+    this.plugin_.postMessage(buffer);
+};
+
 /**
  * Send a string to the remote host.
  *
  * @param {string} string The string to send.
  */
 nassh.PluginCommand.prototype.sendString_ = function(string) {
-  this.sendToPlugin_('onRead', [0, btoa(string)]);
+  this.sendReadToPlugin_(0, string);
 };
 
 /**
@@ -150,6 +196,24 @@ nassh.PluginCommand.prototype.onTerminalResize_ = function(width, height) {
   this.sendToPlugin_('onResize', [Number(width), Number(height)]);
 };
 
+/**
+ * Ask the plugin for a snapshot of its I/O counters and latency histograms.
+ *
+ * @param {function(Object)} callback Called with the snapshot, or null if
+ *     the plugin is gone.  See PluginInstance::OnGetStats in plugin.cc for
+ *     the snapshot's layout.
+ */
+nassh.PluginCommand.prototype.requestStats = function(callback) {
+  if (!this.plugin_) {
+    callback(null);
+    return;
+  }
+
+  this.statsCallbacks_.push(callback);
+  if (this.statsCallbacks_.length == 1)
+    this.sendToPlugin_('getStats', []);
+};
+
 /**
  * Exit the nassh command.
  */
@@ -174,11 +238,39 @@ nassh.PluginCommand.prototype.exit = function(code) {
  * plugin message into something dispatchMessage_ can digest.
  */
 nassh.PluginCommand.prototype.onPluginMessage_ = function(e) {
+  if (e.data instanceof ArrayBuffer) {
+    this.onPluginBinaryMessage_(e.data);
+    return;
+  }
+
   var msg = JSON.parse(e.data);
   msg.argv = msg.arguments;
   this.dispatchMessage_('plugin', this.onPlugin_, msg);
 };
 
+/**
+ * Called when the plugin sends us a binary message.
+ */
+nassh.PluginCommand.prototype.onPluginBinaryMessage_ = function(buffer) {
+  var headerSize = nassh.PluginCommand.BINARY_HEADER_SIZE;
+  var view = new DataView(buffer);
+  if (buffer.byteLength < headerSize ||
+      view.getUint8(0) != nassh.PluginCommand.BINARY_WRITE) {
+    console.log('Unknown binary plugin message');
+    return;
+  }
+
+  var id = view.getInt32(4, true);
+  var bytes = new Uint8Array(buffer, headerSize);
+  // Convert in slices; apply() has a limit on the argument count.
+  var chunks = [];
+  for (var i = 0; i < bytes.length; i += 8192) {
+    chunks.push(String.fromCharCode.apply(
+        null, bytes.subarray(i, i + 8192)));
+  }
+  this.onPluginWrite_(id, chunks.join(''));
+};
+
 /**
  * Plugin message handlers.
  */
@@ -191,6 +283,16 @@ nassh.PluginCommand.prototype.onPlugin_.printLog = function(str) {
   console.log('plugin log: ' + str);
 };
 
+/**
+ * Plugin has read its startSession arguments.
+ *
+ * @param {Object} options The choices the plugin made: binaryMessages says
+ *     whether it takes stream data as ArrayBuffers.
+ */
+nassh.PluginCommand.prototype.onPlugin_.sessionStarted = function(options) {
+  this.binaryMessages_ = !!options.binaryMessages;
+};
+
 /**
  * Plugin has exited.
  */
@@ -239,7 +341,7 @@ nassh.PluginCommand.prototype.onPlugin_.openSocket = function(
       });
 
   stream.onDataAvailable = function(data) {
-    self.sendToPlugin_('onRead', [fd, data]);
+    self.sendReadToPlugin_(fd, atob(data));
   };
 };
 
@@ -249,10 +351,19 @@ nassh.PluginCommand.prototype.onPlugin_.openSocket = function(
  * This is used to write to HTML5 Filesystem files.
  */
 nassh.PluginCommand.prototype.onPlugin_.write = function(id, data) {
+  this.onPluginWrite_(id, atob(data));
+};
+
+/**
+ * Handle data written by the plugin, from either message format.
+ *
+ * @param {integer} id The stream id.
+ * @param {string} string The data, one byte per character.
+ */
+nassh.PluginCommand.prototype.onPluginWrite_ = function(id, string) {
   var self = this;
 
   if (id == 1 || id == 2) {
-    var string = atob(data);
     var ackCount = (id == 1 ?
                     this.stdoutAcknowledgeCount_ += string.length :
                     this.stderrAcknowledgeCount_ += string.length);
@@ -273,7 +384,7 @@ nassh.PluginCommand.prototype.onPlugin_.write = function(id, data) {
     return;
   }
 
-  stream.asyncWrite(data, function(writeCount) {
+  stream.asyncWrite(btoa(string), function(writeCount) {
       self.sendToPlugin_('onWriteAcknowledge', [id, writeCount]);
     }, 100);
 };
@@ -292,7 +403,7 @@ nassh.PluginCommand.prototype.onPlugin_.read = function(id, size) {
   }
 
   stream.asyncRead(size, function(b64bytes) {
-      self.sendToPlugin_('onRead', [id, b64bytes]);
+      self.sendReadToPlugin_(id, atob(b64bytes));
     });
 };
 
@@ -309,3 +420,13 @@ nassh.PluginCommand.prototype.onPlugin_.close = function(id) {
 
   stream.close();
 };
+
+/**
+ * Plugin replies to getStats.
+ */
+nassh.PluginCommand.prototype.onPlugin_.stats = function(snapshot) {
+  var callbacks = this.statsCallbacks_;
+  this.statsCallbacks_ = [];
+  for (var i = 0; i < callbacks.length; i++)
+    callbacks[i](snapshot);
+};
@@ -0,0 +1,83 @@
+#!/usr/bin/python
+
+# Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Writes a C++ source file that compiles files into the plugin.
+
+Usage: embed_files.py SYMBOL DIRECTORY...
+
+Every file under each DIRECTORY becomes a StaticFileEntry (see
+src/static_file.h) in the array SYMBOL, with SYMBOLCount holding its length.
+Paths are relative to the parent of DIRECTORY and start with a slash, so
+en_US.UTF-8/LC_CTYPE is stored as /en_US.UTF-8/LC_CTYPE.
+"""
+
+import os
+import sys
+
+BYTES_PER_LINE = 24
+
+
+def collect_files(directories):
+  files = []
+  for directory in directories:
+    directory = os.path.normpath(directory)
+    parent = os.path.dirname(directory)
+    for root, dirs, names in os.walk(directory):
+      dirs.sort()
+      for name in sorted(names):
+        path = os.path.join(root, name)
+        files.append(('/' + os.path.relpath(path, parent).replace(os.sep, '/'),
+                      path))
+  return files
+
+
+def c_string(data):
+  """Returns |data| as C string literals, one per line.
+
+  Octal escapes are always three digits long, so a following digit can't
+  be mistaken for part of the escape.
+  """
+  lines = []
+  for i in range(0, len(data), BYTES_PER_LINE):
+    chunk = bytearray(data[i:i + BYTES_PER_LINE])
+    lines.append('  "%s"' % ''.join('\\%03o' % byte for byte in chunk))
+  return '\n'.join(lines) or '  ""'
+
+
+def main(argv):
+  if len(argv) < 3:
+    sys.stderr.write(__doc__)
+    return 1
+  symbol = argv[1]
+  files = collect_files(argv[2:])
+
+  out = sys.stdout
+  out.write('// Generated by embed_files.py from %s. Do not edit.\n\n' %
+            ' '.join(argv[2:]))
+  out.write('#include "static_file.h"\n\n')
+  out.write('namespace {\n\n')
+  for i, (name, path) in enumerate(files):
+    with open(path, 'rb') as f:
+      data = f.read()
+    out.write('// %s\n' % name)
+    out.write('const char kData%d[] =\n%s;\n\n' % (i, c_string(data)))
+  out.write('}  // namespace\n\n')
+
+  # Constants have internal linkage unless declared extern.
+  out.write('extern const StaticFileEntry %s[];\n' % symbol)
+  out.write('extern const size_t %sCount;\n\n' % symbol)
+
+  out.write('const StaticFileEntry %s[] = {\n' % symbol)
+  for i, (name, path) in enumerate(files):
+    out.write('  { "%s", kData%d, sizeof(kData%d) - 1 },\n' % (name, i, i))
+  out.write('};\n\n')
+  out.write('const size_t %sCount = sizeof(%s) / sizeof(%s[0]);\n' %
+            (symbol, symbol, symbol))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
@@ -0,0 +1,179 @@
+#!/usr/bin/python
+
+# Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Compiles a terminfo source entry into the table src/tinfo.c looks in.
+
+Usage: gen_tinfo.py ENTRY.ti > tinfo_table.h
+
+The table is open-addressed with no collisions: the generator searches for
+a hash seed that gives every capability name its own slot, so a lookup is
+one hash and one strcmp.
+"""
+
+import sys
+
+# FNV-1a of the name, then multiplicative hashing of that xor the seed,
+# keeping the top |bits| bits. Keep in sync with tinfo_slot() in
+# src/tinfo.c.
+FNV_BASIS = 2166136261
+FNV_PRIME = 16777619
+GOLDEN_RATIO = 2654435761
+
+
+def fnv1a(name):
+  h = FNV_BASIS
+  for c in bytearray(name.encode('ascii')):
+    h = ((h ^ c) * FNV_PRIME) & 0xffffffff
+  return h
+
+
+def tinfo_slot(name, seed, bits):
+  return (((fnv1a(name) ^ seed) * GOLDEN_RATIO) & 0xffffffff) >> (32 - bits)
+
+
+def split_fields(text):
+  """Splits on commas that aren't escaped with a backslash."""
+  fields = []
+  field = ''
+  i = 0
+  while i < len(text):
+    c = text[i]
+    if c == '\\' and i + 1 < len(text):
+      field += text[i:i + 2]
+      i += 2
+      continue
+    if c == ',':
+      fields.append(field.strip())
+      field = ''
+    else:
+      field += c
+    i += 1
+  if field.strip():
+    fields.append(field.strip())
+  return fields
+
+
+def decode_string(value):
+  """Turns terminfo string escapes into the bytes they stand for."""
+  simple = {'E': 27, 'e': 27, 'n': 10, 'l': 10, 'r': 13, 't': 9, 'b': 8,
+            'f': 12, 's': 32, '^': 94, '\\': 92, ',': 44, ':': 58}
+  out = bytearray()
+  i = 0
+  while i < len(value):
+    c = value[i]
+    if c == '\\':
+      n = value[i + 1]
+      if n in simple:
+        out.append(simple[n])
+        i += 2
+      elif n in '01234567':
+        j = i + 1
+        while j < i + 4 and j < len(value) and value[j] in '01234567':
+          j += 1
+        # \0 is stored as \200 so it doesn't end the string.
+        out.append(int(value[i + 1:j], 8) or 0o200)
+        i = j
+      else:
+        raise ValueError('unknown escape \\%s in %r' % (n, value))
+    elif c == '^':
+      n = value[i + 1]
+      out.append(127 if n == '?' else ord(n.upper()) & 0x1f)
+      i += 2
+    else:
+      out.append(ord(c))
+      i += 1
+  return out
+
+
+def c_string(data):
+  chars = []
+  for byte in data:
+    if byte in (34, 92) or byte < 32 or byte > 126:
+      chars.append('\\%03o' % byte)
+    else:
+      chars.append(chr(byte))
+  return '"%s"' % ''.join(chars)
+
+
+def parse_entry(path):
+  lines = []
+  with open(path) as f:
+    for line in f:
+      if line.startswith('#') or not line.strip():
+        continue
+      lines.append(line.strip())
+  fields = split_fields(' '.join(lines))
+  caps = []
+  # The first field holds the terminal's names.
+  for field in fields[1:]:
+    if field.endswith('@'):
+      continue
+    if '=' in field:
+      name, value = field.split('=', 1)
+      caps.append((name, 'TINFO_STR', '0', c_string(decode_string(value))))
+    elif '#' in field:
+      name, value = field.split('#', 1)
+      caps.append((name, 'TINFO_NUM', str(int(value, 0)), 'NULL'))
+    else:
+      caps.append((field, 'TINFO_FLAG', '1', 'NULL'))
+  return fields[0], caps
+
+
+def find_seed(names, bits):
+  for seed in range(1 << 16):
+    slots = set()
+    for name in names:
+      slot = tinfo_slot(name, seed, bits)
+      if slot in slots:
+        break
+      slots.add(slot)
+    else:
+      return seed
+  return None
+
+
+def main(argv):
+  if len(argv) != 2:
+    sys.stderr.write(__doc__)
+    return 1
+  terminal, caps = parse_entry(argv[1])
+  names = [cap[0] for cap in caps]
+  if len(set(names)) != len(names):
+    sys.stderr.write('%s: duplicate capability\n' % argv[1])
+    return 1
+
+  # At most half full; emptier tables find a seed faster.
+  bits = 1
+  while (1 << bits) < 2 * len(caps):
+    bits += 1
+  seed = find_seed(names, bits)
+  while seed is None:
+    bits += 1
+    seed = find_seed(names, bits)
+
+  slots = {}
+  for cap in caps:
+    slots[tinfo_slot(cap[0], seed, bits)] = cap
+
+  out = sys.stdout
+  out.write('/* Generated by gen_tinfo.py from %s. Do not edit. */\n\n' %
+            argv[1].split('/')[-1])
+  out.write('/* %s */\n' % terminal)
+  out.write('#define TINFO_HASH_SEED 0x%08xu\n' % seed)
+  out.write('#define TINFO_TABLE_BITS %d\n' % bits)
+  out.write('#define TINFO_TABLE_SIZE (1 << TINFO_TABLE_BITS)\n\n')
+  out.write('static const struct tinfo_cap '
+            'tinfo_table[TINFO_TABLE_SIZE] = {\n')
+  for slot in sorted(slots):
+    name, kind, num, string = slots[slot]
+    out.write('  [%d] = { "%s", %s, %s, %s },\n' %
+              (slot, name, kind, num, string))
+  out.write('};\n')
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
@@ -0,0 +1,759 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Throughput and latency benchmarks for the stream types behind
+// FileSystem, run against the host stand-ins for Pepper. The peer end of
+// each TCP and UDP test is a plain host socket served from its own thread,
+// and the JS side of JsFile is emulated by FakeJsBridge.
+//
+// Usage: benchmark [-b megabytes] [-r round_trips] [test_name_filter...]
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ppapi/cpp/instance.h"
+#include "ppapi/cpp/module.h"
+#include "ppapi/utility/completion_callback_factory.h"
+
+#include "file_system.h"
+#include "main_loop.h"
+#include "ppapi_host.h"
+#include "pthread_helpers.h"
+
+namespace {
+
+const size_t kChunkSize = 16 * 1024;
+const size_t kDatagramSize = 1200;
+const size_t kDatagramWindow = 32;
+const size_t kPingSize = 64;
+// Same as nassh_plugin_command.js.
+const size_t kJsWriteWindow = 8 * 1024;
+
+double NowUs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+class HostModule : public pp::Module {
+ public:
+  virtual pp::Instance* CreateInstance(PP_Instance instance) {
+    return new pp::Instance(instance);
+  }
+};
+
+// Plays the part of nassh_plugin_command.js and nassh_stream.js for
+// JsFile: acknowledges every write and answers every read with as many
+// bytes as were asked for.
+class FakeJsBridge : public OutputInterface {
+ public:
+  FakeJsBridge() : factory_(this), next_id_(3) {}
+
+  virtual bool OpenFile(int fd, const char* name, int mode,
+                        InputInterface* stream) {
+    if (fd < 3) {
+      // The terminal; FileSystem opens these itself.
+      streams_[fd] = stream;
+      return true;
+    }
+    int id = next_id_++;
+    streams_[id] = stream;
+    pp::Module::Get()->core()->CallOnMainThread(0,
+        factory_.NewCallback(&FakeJsBridge::DoOpen, id));
+    return true;
+  }
+
+  virtual bool OpenSocket(int fd, const char* host, uint16_t port,
+                          InputInterface* stream) {
+    return false;
+  }
+
+  virtual bool Write(int id, const char* data, size_t size) {
+    uint64_t count;
+    {
+      Mutex::Lock lock(mutex_);
+      count = bytes_written_[id] += size;
+      cond_.broadcast();
+    }
+    pp::Module::Get()->core()->CallOnMainThread(0,
+        factory_.NewCallback(&FakeJsBridge::DoAcknowledge, id, count));
+    return true;
+  }
+
+  virtual bool Read(int id, size_t size) {
+    pp::Module::Get()->core()->CallOnMainThread(0,
+        factory_.NewCallback(&FakeJsBridge::DoRead, id, size));
+    return true;
+  }
+
+  virtual bool Close(int id) {
+    pp::Module::Get()->core()->CallOnMainThread(0,
+        factory_.NewCallback(&FakeJsBridge::DoClose, id));
+    return true;
+  }
+
+  virtual size_t GetWriteWindow() {
+    return kJsWriteWindow;
+  }
+
+  virtual void SessionClosed(int error) {
+  }
+
+  // Blocks until stream |id| has been sent |count| bytes in total.
+  void WaitForBytes(int id, uint64_t count) {
+    Mutex::Lock lock(mutex_);
+    while (bytes_written_[id] < count)
+      cond_.wait(mutex_);
+  }
+
+  int last_id() {
+    return next_id_ - 1;
+  }
+
+ private:
+  void DoOpen(int32_t result, int id) {
+    streams_[id]->OnOpen(id);
+  }
+
+  void DoAcknowledge(int32_t result, int id, uint64_t count) {
+    if (streams_.count(id))
+      streams_[id]->OnWriteAcknowledge(count);
+  }
+
+  void DoRead(int32_t result, int id, size_t size) {
+    if (read_buf_.size() < size)
+      read_buf_.resize(size, 'x');
+    if (streams_.count(id))
+      streams_[id]->OnRead(&read_buf_[0], size);
+  }
+
+  void DoClose(int32_t result, int id) {
+    if (streams_.count(id)) {
+      streams_[id]->OnClose();
+      streams_.erase(id);
+    }
+  }
+
+  pp::CompletionCallbackFactory<FakeJsBridge, ThreadSafeRefCount> factory_;
+  // Main thread only.
+  std::map<int, InputInterface*> streams_;
+  std::vector<char> read_buf_;
+  int next_id_;
+  Mutex mutex_;
+  Cond cond_;
+  std::map<int, uint64_t> bytes_written_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeJsBridge);
+};
+
+//------------------------------------------------------------------------------
+// Peers. These use the host's sockets directly.
+
+bool HostReadAll(int fd, char* buf, size_t count) {
+  while (count) {
+    ssize_t n = ::read(fd, buf, count);
+    if (n <= 0)
+      return false;
+    buf += n;
+    count -= n;
+  }
+  return true;
+}
+
+bool HostWriteAll(int fd, const char* buf, size_t count) {
+  while (count) {
+    ssize_t n = ::send(fd, buf, count, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    buf += n;
+    count -= n;
+  }
+  return true;
+}
+
+// A TCP connection starts with a command byte and a 64-bit length:
+//   'S' n: read n bytes, then send one byte back.
+//   'G' n: send n bytes.
+//   'E' n: echo n byte messages until the client closes.
+void* ServeTCPConnection(void* arg) {
+  int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  char header[9];
+  std::vector<char> buf(kChunkSize, 'y');
+  if (HostReadAll(fd, header, sizeof(header))) {
+    uint64_t count;
+    memcpy(&count, header + 1, sizeof(count));
+    if (header[0] == 'S') {
+      while (count) {
+        size_t n = std::min<uint64_t>(count, buf.size());
+        if (!HostReadAll(fd, &buf[0], n))
+          break;
+        count -= n;
+      }
+      HostWriteAll(fd, "A", 1);
+    } else if (header[0] == 'G') {
+      while (count) {
+        size_t n = std::min<uint64_t>(count, buf.size());
+        if (!HostWriteAll(fd, &buf[0], n))
+          break;
+        count -= n;
+      }
+    } else if (header[0] == 'E') {
+      buf.resize(count);
+      while (HostReadAll(fd, &buf[0], count) &&
+             HostWriteAll(fd, &buf[0], count)) {
+      }
+    }
+  }
+  ::close(fd);
+  return NULL;
+}
+
+void* RunTCPServer(void* arg) {
+  int listen_fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  while (true) {
+    int fd = ::accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+    pthread_t thread;
+    pthread_create(&thread, NULL, ServeTCPConnection,
+                   reinterpret_cast<void*>(static_cast<intptr_t>(fd)));
+    pthread_detach(thread);
+  }
+  return NULL;
+}
+
+void* RunUDPEchoServer(void* arg) {
+  int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  char buf[65536];
+  while (true) {
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    ssize_t n = ::recvfrom(fd, buf, sizeof(buf), 0, (sockaddr*)&addr, &len);
+    if (n >= 0)
+      ::sendto(fd, buf, n, 0, (sockaddr*)&addr, len);
+  }
+  return NULL;
+}
+
+// Binds a loopback socket of |type| on an ephemeral port, serves it with
+// |start_routine| and returns the address.
+sockaddr_in StartPeer(int type, void* (*start_routine)(void*)) {
+  int fd = ::socket(AF_INET, type, 0);
+  sockaddr_in addr = { };
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (fd < 0 || ::bind(fd, (sockaddr*)&addr, len) ||
+      ::getsockname(fd, (sockaddr*)&addr, &len) ||
+      (type == SOCK_STREAM && ::listen(fd, 16))) {
+    perror("benchmark peer");
+    exit(1);
+  }
+  int buf_size = 4 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+  pthread_t thread;
+  pthread_create(&thread, NULL, start_routine,
+                 reinterpret_cast<void*>(static_cast<intptr_t>(fd)));
+  pthread_detach(thread);
+  return addr;
+}
+
+//------------------------------------------------------------------------------
+// Client side, through FileSystem.
+
+class Benchmark {
+ public:
+  Benchmark(FileSystem* sys, FakeJsBridge* js, size_t bytes,
+            size_t round_trips, const std::vector<std::string>& filters)
+    : sys_(sys), js_(js), bytes_(bytes), round_trips_(round_trips),
+      filters_(filters), chunk_(kChunkSize, 'z'), failed_(false) {}
+
+  bool Run();
+
+ private:
+  typedef void (Benchmark::*Test)();
+
+  void RunTest(const char* name, Test test);
+
+  // Report a bulk transfer of |bytes| that took |us| microseconds.
+  void ReportThroughput(uint64_t bytes, double us, size_t ops);
+  // Report per-operation latencies in microseconds.
+  void ReportLatency(std::vector<double>* samples);
+  void Fail(const char* what, int err);
+
+  bool WriteAll(int fd, const char* buf, size_t count);
+  bool ReadAll(int fd, char* buf, size_t count);
+  int ConnectTCP(char command, uint64_t count);
+  int WaitFor(int fd, short events, int timeout_ms);
+
+  void TCPWrite();
+  void TCPRead();
+  void TCPLatency();
+  void UDPThroughput();
+  void UDPLatency();
+  void JsFileWrite();
+  void JsFileRead();
+  void JsFileLatency();
+  void PepperFileWrite();
+  void PepperFileRead();
+  void PepperFileOpenLatency();
+
+  FileSystem* sys_;
+  FakeJsBridge* js_;
+  size_t bytes_;
+  size_t round_trips_;
+  std::vector<std::string> filters_;
+  std::vector<char> chunk_;
+  sockaddr_in tcp_peer_;
+  sockaddr_in udp_peer_;
+  const char* current_;
+  bool failed_;
+};
+
+bool Benchmark::Run() {
+  tcp_peer_ = StartPeer(SOCK_STREAM, RunTCPServer);
+  udp_peer_ = StartPeer(SOCK_DGRAM, RunUDPEchoServer);
+
+  // Waits for the HTML5 file system to come up.
+  sys_->mkdir("/bench", 0755);
+
+  printf("%-24s %10s %10s %10s %10s %10s\n",
+         "test", "MB/s", "ops/s", "p50 us", "p99 us", "max us");
+  RunTest("tcp.write", &Benchmark::TCPWrite);
+  RunTest("tcp.read", &Benchmark::TCPRead);
+  RunTest("tcp.latency", &Benchmark::TCPLatency);
+  RunTest("udp.throughput", &Benchmark::UDPThroughput);
+  RunTest("udp.latency", &Benchmark::UDPLatency);
+  RunTest("jsfile.write", &Benchmark::JsFileWrite);
+  RunTest("jsfile.read", &Benchmark::JsFileRead);
+  RunTest("jsfile.latency", &Benchmark::JsFileLatency);
+  RunTest("pepperfile.write", &Benchmark::PepperFileWrite);
+  RunTest("pepperfile.read", &Benchmark::PepperFileRead);
+  RunTest("pepperfile.open", &Benchmark::PepperFileOpenLatency);
+  return !failed_;
+}
+
+void Benchmark::RunTest(const char* name, Test test) {
+  if (!filters_.empty()) {
+    bool match = false;
+    for (size_t i = 0; i < filters_.size(); i++)
+      match |= strstr(name, filters_[i].c_str()) != NULL;
+    if (!match)
+      return;
+  }
+  current_ = name;
+  (this->*test)();
+  fflush(stdout);
+}
+
+void Benchmark::ReportThroughput(uint64_t bytes, double us, size_t ops) {
+  printf("%-24s %10.1f %10.0f %10s %10s %10s\n", current_,
+         bytes / us, ops * 1e6 / us, "-", "-", "-");
+}
+
+void Benchmark::ReportLatency(std::vector<double>* samples) {
+  if (samples->empty())
+    return;
+  std::sort(samples->begin(), samples->end());
+  double total = 0;
+  for (size_t i = 0; i < samples->size(); i++)
+    total += (*samples)[i];
+  printf("%-24s %10s %10.0f %10.1f %10.1f %10.1f\n", current_, "-",
+         samples->size() * 1e6 / total,
+         (*samples)[samples->size() / 2],
+         (*samples)[samples->size() * 99 / 100],
+         samples->back());
+}
+
+void Benchmark::Fail(const char* what, int err) {
+  printf("%-24s FAILED: %s: %s\n", current_, what, strerror(err));
+  failed_ = true;
+}
+
+bool Benchmark::WriteAll(int fd, const char* buf, size_t count) {
+  while (count) {
+    size_t nwrote;
+    int err = sys_->write(fd, buf, count, &nwrote);
+    if (err) {
+      Fail("write", err);
+      return false;
+    }
+    buf += nwrote;
+    count -= nwrote;
+  }
+  return true;
+}
+
+bool Benchmark::ReadAll(int fd, char* buf, size_t count) {
+  while (count) {
+    size_t nread;
+    int err = sys_->read(fd, buf, count, &nread);
+    if (err || !nread) {
+      Fail("read", err ? err : EPIPE);
+      return false;
+    }
+    buf += nread;
+    count -= nread;
+  }
+  return true;
+}
+
+int Benchmark::ConnectTCP(char command, uint64_t count) {
+  int fd = sys_->socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      sys_->connect(fd, (sockaddr*)&tcp_peer_, sizeof(tcp_peer_))) {
+    Fail("connect", errno);
+    if (fd >= 0)
+      sys_->close(fd);
+    return -1;
+  }
+  char header[9];
+  header[0] = command;
+  memcpy(header + 1, &count, sizeof(count));
+  if (!WriteAll(fd, header, sizeof(header))) {
+    sys_->close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int Benchmark::WaitFor(int fd, short events, int timeout_ms) {
+  pollfd pfd = { fd, events, 0 };
+  timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000 };
+  return sys_->poll(&pfd, 1, timeout_ms < 0 ? NULL : &timeout);
+}
+
+void Benchmark::TCPWrite() {
+  int fd = ConnectTCP('S', bytes_);
+  if (fd < 0)
+    return;
+  double start = NowUs();
+  size_t ops = 0;
+  for (size_t sent = 0; sent < bytes_; sent += kChunkSize, ops++) {
+    if (!WriteAll(fd, &chunk_[0], std::min(kChunkSize, bytes_ - sent)))
+      break;
+  }
+  char ack;
+  if (ReadAll(fd, &ack, 1))
+    ReportThroughput(bytes_, NowUs() - start, ops);
+  sys_->close(fd);
+}
+
+void Benchmark::TCPRead() {
+  int fd = ConnectTCP('G', bytes_);
+  if (fd < 0)
+    return;
+  double start = NowUs();
+  size_t received = 0;
+  size_t ops = 0;
+  while (received < bytes_) {
+    size_t nread;
+    int err = sys_->read(fd, &chunk_[0], kChunkSize, &nread);
+    if (err || !nread) {
+      Fail("read", err ? err : EPIPE);
+      break;
+    }
+    received += nread;
+    ops++;
+  }
+  if (received == bytes_)
+    ReportThroughput(bytes_, NowUs() - start, ops);
+  sys_->close(fd);
+}
+
+void Benchmark::TCPLatency() {
+  int fd = ConnectTCP('E', kPingSize);
+  if (fd < 0)
+    return;
+  std::vector<double> samples;
+  char buf[kPingSize];
+  memset(buf, 'p', sizeof(buf));
+  for (size_t i = 0; i < round_trips_; i++) {
+    double start = NowUs();
+    if (!WriteAll(fd, buf, sizeof(buf)) || !ReadAll(fd, buf, sizeof(buf)))
+      break;
+    samples.push_back(NowUs() - start);
+  }
+  ReportLatency(&samples);
+  sys_->close(fd);
+}
+
+void Benchmark::UDPThroughput() {
+  int fd = sys_->socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    Fail("socket", errno);
+    return;
+  }
+  // Keep a window of datagrams in flight to the echo peer. A datagram
+  // that doesn't come back within the timeout is counted lost and
+  // replaced.
+  size_t count = bytes_ / kDatagramSize;
+  size_t sent = 0, received = 0, in_flight = 0, lost = 0;
+  double start = NowUs();
+  while (received + lost < count) {
+    while (in_flight < kDatagramWindow && sent < count) {
+      if (sys_->sendto(fd, &chunk_[0], kDatagramSize, 0,
+                       (sockaddr*)&udp_peer_, sizeof(udp_peer_)) < 0) {
+        Fail("sendto", errno);
+        sys_->close(fd);
+        return;
+      }
+      sent++;
+      in_flight++;
+    }
+    if (WaitFor(fd, POLLIN, 100) <= 0) {
+      lost += in_flight;
+      in_flight = 0;
+      continue;
+    }
+    if (sys_->recvfrom(fd, &chunk_[0], kChunkSize, 0, NULL, NULL) < 0) {
+      Fail("recvfrom", errno);
+      sys_->close(fd);
+      return;
+    }
+    received++;
+    in_flight--;
+  }
+  ReportThroughput(uint64_t(received) * kDatagramSize, NowUs() - start,
+                   received);
+  if (lost)
+    printf("%-24s %zu of %zu datagrams lost\n", current_, lost, count);
+  sys_->close(fd);
+}
+
+void Benchmark::UDPLatency() {
+  int fd = sys_->socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    Fail("socket", errno);
+    return;
+  }
+  std::vector<double> samples;
+  char buf[kPingSize];
+  memset(buf, 'p', sizeof(buf));
+  for (size_t i = 0; i < round_trips_; i++) {
+    double start = NowUs();
+    if (sys_->sendto(fd, buf, sizeof(buf), 0,
+                     (sockaddr*)&udp_peer_, sizeof(udp_peer_)) < 0) {
+      Fail("sendto", errno);
+      break;
+    }
+    if (WaitFor(fd, POLLIN, 1000) <= 0)
+      continue;
+    if (sys_->recvfrom(fd, buf, sizeof(buf), 0, NULL, NULL) < 0) {
+      Fail("recvfrom", errno);
+      break;
+    }
+    samples.push_back(NowUs() - start);
+  }
+  ReportLatency(&samples);
+  sys_->close(fd);
+}
+
+void Benchmark::JsFileWrite() {
+  int fd;
+  int err = sys_->open("/dev/js/bench", O_RDWR, 0, &fd);
+  if (err) {
+    Fail("open", err);
+    return;
+  }
+  int id = js_->last_id();
+  double start = NowUs();
+  size_t ops = 0;
+  for (size_t sent = 0; sent < bytes_; sent += kChunkSize, ops++) {
+    // JsFile buffers without limit; wait for room like a real writer.
+    WaitFor(fd, POLLOUT, -1);
+    if (!WriteAll(fd, &chunk_[0], std::min(kChunkSize, bytes_ - sent)))
+      break;
+  }
+  js_->WaitForBytes(id, bytes_);
+  ReportThroughput(bytes_, NowUs() - start, ops);
+  sys_->close(fd);
+}
+
+void Benchmark::JsFileRead() {
+  int fd;
+  int err = sys_->open("/dev/js/bench", O_RDWR, 0, &fd);
+  if (err) {
+    Fail("open", err);
+    return;
+  }
+  double start = NowUs();
+  size_t ops = 0;
+  for (size_t received = 0; received < bytes_; ops++) {
+    size_t nread;
+    err = sys_->read(fd, &chunk_[0], kChunkSize, &nread);
+    if (err || !nread) {
+      Fail("read", err ? err : EPIPE);
+      break;
+    }
+    received += nread;
+  }
+  ReportThroughput(bytes_, NowUs() - start, ops);
+  sys_->close(fd);
+}
+
+void Benchmark::JsFileLatency() {
+  int fd;
+  int err = sys_->open("/dev/js/bench", O_RDWR, 0, &fd);
+  if (err) {
+    Fail("open", err);
+    return;
+  }
+  std::vector<double> samples;
+  char buf[kPingSize];
+  for (size_t i = 0; i < round_trips_; i++) {
+    double start = NowUs();
+    if (!ReadAll(fd, buf, sizeof(buf)))
+      break;
+    samples.push_back(NowUs() - start);
+  }
+  ReportLatency(&samples);
+  sys_->close(fd);
+}
+
+void Benchmark::PepperFileWrite() {
+  int fd;
+  int err = sys_->open("/bench/data", O_WRONLY | O_CREAT | O_TRUNC, 0644, &fd);
+  if (err) {
+    Fail("open", err);
+    return;
+  }
+  double start = NowUs();
+  size_t ops = 0;
+  for (size_t sent = 0; sent < bytes_; sent += kChunkSize, ops++) {
+    if (!WriteAll(fd, &chunk_[0], std::min(kChunkSize, bytes_ - sent)))
+      break;
+  }
+  sys_->close(fd);
+  ReportThroughput(bytes_, NowUs() - start, ops);
+}
+
+void Benchmark::PepperFileRead() {
+  int fd;
+  int err = sys_->open("/bench/data", O_RDONLY, 0, &fd);
+  if (err) {
+    Fail("open", err);
+    return;
+  }
+  double start = NowUs();
+  size_t received = 0;
+  size_t ops = 0;
+  while (true) {
+    size_t nread;
+    err = sys_->read(fd, &chunk_[0], kChunkSize, &nread);
+    if (err) {
+      Fail("read", err);
+      break;
+    }
+    if (!nread)
+      break;
+    received += nread;
+    ops++;
+  }
+  sys_->close(fd);
+  ReportThroughput(received, NowUs() - start, ops);
+}
+
+void Benchmark::PepperFileOpenLatency() {
+  std::vector<double> samples;
+  for (size_t i = 0; i < round_trips_; i++) {
+    int fd;
+    double start = NowUs();
+    int err = sys_->open("/bench/data", O_RDONLY, 0, &fd);
+    if (err) {
+      Fail("open", err);
+      break;
+    }
+    sys_->close(fd);
+    samples.push_back(NowUs() - start);
+  }
+  ReportLatency(&samples);
+}
+
+struct BenchmarkThreadArgs {
+  Benchmark* benchmark;
+  bool result;
+};
+
+void* RunBenchmarkThread(void* arg) {
+  BenchmarkThreadArgs* args = static_cast<BenchmarkThreadArgs*>(arg);
+  args->result = args->benchmark->Run();
+  host::MainLoop::Get()->Quit();
+  return NULL;
+}
+
+void Usage(const char* argv0) {
+  fprintf(stderr, "usage: %s [-b megabytes] [-r round_trips] [filter...]\n",
+          argv0);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t megabytes = 64;
+  size_t round_trips = 2000;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:r:h")) != -1) {
+    switch (opt) {
+      case 'b':
+        megabytes = atoi(optarg);
+        break;
+      case 'r':
+        round_trips = atoi(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  std::vector<std::string> filters(argv + optind, argv + argc);
+
+  char root[] = "/tmp/nassh_benchmark_XXXXXX";
+  if (!mkdtemp(root)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  host::SetFileSystemRoot(root);
+
+  // Everything Pepper-facing lives on this, the main thread.
+  host::MainLoop main_loop;
+  HostModule module;
+  pp::Instance instance(1);
+  FakeJsBridge js;
+  new FileSystem(&instance, &js);
+
+  Benchmark benchmark(FileSystem::GetFileSystem(), &js,
+                      megabytes * 1024 * 1024, round_trips, filters);
+  BenchmarkThreadArgs args = { &benchmark, false };
+  pthread_t thread;
+  pthread_create(&thread, NULL, RunBenchmarkThread, &args);
+  main_loop.Run();
+  pthread_join(thread, NULL);
+
+  std::string cleanup = std::string("rm -rf ") + root;
+  if (system(cleanup.c_str()))
+    fprintf(stderr, "failed to remove %s\n", root);
+  // The FileSystem is left alone: tearing it down would need the main
+  // loop, which has stopped.
+  _exit(args.result ? 0 : 1);
+}
@@ -0,0 +1,301 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Checks of FileSystem behaviour that the benchmark doesn't exercise, run
+// against the host stand-ins for Pepper like the benchmark is.
+//
+// Usage: file_system_test
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "ppapi/cpp/instance.h"
+#include "ppapi/cpp/module.h"
+
+#include "file_system.h"
+#include "main_loop.h"
+#include "ppapi_host.h"
+
+namespace {
+
+class HostModule : public pp::Module {
+ public:
+  virtual pp::Instance* CreateInstance(PP_Instance instance) {
+    return new pp::Instance(instance);
+  }
+};
+
+// No JS side: the terminal descriptors are left closed.
+class NullJsBridge : public OutputInterface {
+ public:
+  virtual bool OpenFile(int fd, const char* name, int mode,
+                        InputInterface* stream) {
+    return false;
+  }
+  virtual bool OpenSocket(int fd, const char* host, uint16_t port,
+                          InputInterface* stream) {
+    return false;
+  }
+  virtual bool Write(int id, const char* data, size_t size) {
+    return false;
+  }
+  virtual bool Read(int id, size_t size) {
+    return false;
+  }
+  virtual bool Close(int id) {
+    return false;
+  }
+  virtual size_t GetWriteWindow() {
+    return 0;
+  }
+  virtual void SessionClosed(int error) {
+  }
+};
+
+int failures = 0;
+
+void Check(bool ok, const char* test, const char* what) {
+  if (!ok) {
+    printf("%-24s FAILED: %s (errno %s)\n", test, what, strerror(errno));
+    failures++;
+  }
+}
+
+// A loopback listening socket on the host, or -1.
+int HostListen(sockaddr_in* addr) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(*addr);
+  if (fd < 0 || ::bind(fd, (sockaddr*)addr, len) ||
+      ::getsockname(fd, (sockaddr*)addr, &len) || ::listen(fd, 4)) {
+    return -1;
+  }
+  return fd;
+}
+
+int Fcntl(FileSystem* sys, int fd, int cmd, ...) {
+  va_list ap;
+  va_start(ap, cmd);
+  int ret = sys->fcntl(fd, cmd, ap);
+  va_end(ap);
+  return ret;
+}
+
+// Starts a non-blocking connect to |addr| and waits for it to finish.
+// Returns the descriptor.
+int ConnectNonBlocking(FileSystem* sys, const sockaddr_in& addr,
+                       const char* test) {
+  int fd = sys->socket(AF_INET, SOCK_STREAM, 0);
+  Check(!Fcntl(sys, fd, F_SETFL, O_RDWR | O_NONBLOCK), test, "fcntl");
+  Check(sys->connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1 &&
+        errno == EINPROGRESS, test, "connect not in progress");
+  pollfd pfd = { fd, POLLOUT, 0 };
+  timespec timeout = { 5, 0 };
+  Check(sys->poll(&pfd, 1, &timeout) == 1, test, "connect never finished");
+  return fd;
+}
+
+// A second connect reports how the first one went.
+void TestConnectAgain(FileSystem* sys) {
+  const char* test = "connect.again";
+  sockaddr_in addr;
+  int listen_fd = HostListen(&addr);
+  Check(listen_fd >= 0, test, "host listen");
+  int fd = ConnectNonBlocking(sys, addr, test);
+  Check(sys->connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1 &&
+        errno == EISCONN, test, "connected socket not EISCONN");
+  sys->close(fd);
+
+  // Nothing listens on the port any more.
+  ::close(listen_fd);
+  fd = ConnectNonBlocking(sys, addr, test);
+  Check(sys->connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1 &&
+        errno == ECONNREFUSED, test, "failed socket not ECONNREFUSED");
+  int error = -1;
+  socklen_t len = sizeof(error);
+  Check(!sys->getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) && !error,
+        test, "SO_ERROR not cleared");
+  sys->close(fd);
+}
+
+// Closing a registered descriptor drops it from the epoll set: the
+// stream really closes, and the number can be registered again.
+void TestEpollClose(FileSystem* sys) {
+  const char* test = "epoll.close";
+  int epfd = sys->epoll_create(0);
+  Check(epfd >= 0, test, "epoll_create");
+
+  sockaddr_in addr;
+  int listen_fd = HostListen(&addr);
+  Check(listen_fd >= 0, test, "host listen");
+  int fd = sys->socket(AF_INET, SOCK_STREAM, 0);
+  Check(!sys->connect(fd, (sockaddr*)&addr, sizeof(addr)), test, "connect");
+  int peer = ::accept(listen_fd, NULL, NULL);
+
+  epoll_event event = { };
+  event.events = EPOLLIN;
+  event.data.u32 = 1;
+  Check(!sys->epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event), test, "add");
+  Check(!sys->close(fd), test, "close");
+
+  // The peer sees the connection close.
+  pollfd pfd = { peer, POLLIN, 0 };
+  char c;
+  Check(::poll(&pfd, 1, 5000) == 1 && ::read(peer, &c, 1) == 0, test,
+        "socket left open");
+
+  // The lowest free descriptor is the one just closed.
+  int null_fd;
+  Check(!sys->open("/dev/null", O_RDWR, 0, &null_fd), test, "open");
+  Check(null_fd == fd, test, "descriptor not reused");
+  event.data.u32 = 2;
+  Check(!sys->epoll_ctl(epfd, EPOLL_CTL_ADD, null_fd, &event), test,
+        "add reused descriptor");
+
+  epoll_event events[4];
+  timespec nowait = { 0, 0 };
+  int n = sys->epoll_wait(epfd, events, 4, &nowait);
+  Check(n == 1 && events[0].data.u32 == 2, test, "stale registration");
+
+  sys->close(null_fd);
+  sys->close(epfd);
+  ::close(peer);
+  ::close(listen_fd);
+}
+
+// dup2() of a descriptor onto itself leaves its registrations alone.
+void TestEpollDup2Self(FileSystem* sys) {
+  const char* test = "epoll.dup2_self";
+  int epfd = sys->epoll_create(0);
+  int fd;
+  Check(!sys->open("/dev/null", O_RDWR, 0, &fd), test, "open");
+  epoll_event event = { };
+  event.events = EPOLLIN;
+  Check(!sys->epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event), test, "add");
+  Check(!sys->dup2(fd, fd), test, "dup2");
+
+  epoll_event events[4];
+  timespec nowait = { 0, 0 };
+  Check(sys->epoll_wait(epfd, events, 4, &nowait) == 1, test,
+        "registration dropped");
+  sys->close(fd);
+  sys->close(epfd);
+}
+
+// dup2() rejects target descriptors outside the table's range.
+void TestDup2Range(FileSystem* sys) {
+  const char* test = "dup2.range";
+  int fd;
+  Check(!sys->open("/dev/null", O_RDWR, 0, &fd), test, "open");
+  Check(sys->dup2(fd, -1) == EBADF, test, "negative newfd not EBADF");
+  Check(sys->dup2(fd, 1 << 30) == EBADF, test, "huge newfd not EBADF");
+  sys->close(fd);
+}
+
+// An epoll set can't be added to another one.
+void TestEpollNested(FileSystem* sys) {
+  const char* test = "epoll.nested";
+  int outer = sys->epoll_create(0);
+  int inner = sys->epoll_create(0);
+  epoll_event event = { };
+  event.events = EPOLLIN;
+  Check(sys->epoll_ctl(outer, EPOLL_CTL_ADD, inner, &event) == -1 &&
+        errno == EINVAL, test, "nested set not EINVAL");
+  sys->close(inner);
+  sys->close(outer);
+}
+
+// Reading past end of file returns nothing and leaves the size alone.
+void TestReadPastEnd(FileSystem* sys) {
+  const char* test = "pepperfile.past_end";
+  char buf[100];
+  memset(buf, 'x', sizeof(buf));
+  int fd;
+  size_t n;
+  Check(!sys->open("/test/past_end", O_WRONLY | O_CREAT, 0644, &fd), test,
+        "create");
+  Check(!sys->write(fd, buf, sizeof(buf), &n) && n == sizeof(buf), test,
+        "write");
+  Check(!sys->close(fd), test, "close after write");
+
+  Check(!sys->open("/test/past_end", O_RDONLY, 0, &fd), test, "open");
+  nacl_abi_off_t offset;
+  Check(!sys->seek(fd, 40000, SEEK_SET, &offset), test, "seek");
+  Check(!sys->read(fd, buf, sizeof(buf), &n) && n == 0, test,
+        "read past end not EOF");
+  nacl_abi_stat st;
+  Check(!sys->fstat(fd, &st) && st.nacl_abi_st_size == sizeof(buf), test,
+        "size changed");
+  Check(!sys->seek(fd, 0, SEEK_END, &offset) && offset == sizeof(buf), test,
+        "SEEK_END moved");
+  Check(!sys->seek(fd, 0, SEEK_SET, &offset) &&
+        !sys->read(fd, buf, sizeof(buf), &n) && n == sizeof(buf), test,
+        "read from start");
+  sys->close(fd);
+}
+
+void* RunTests(void* arg) {
+  FileSystem* sys = FileSystem::GetFileSystem();
+  // Waits for the HTML5 file system to come up.
+  sys->mkdir("/test", 0755);
+  TestEpollClose(sys);
+  TestEpollDup2Self(sys);
+  TestEpollNested(sys);
+  TestDup2Range(sys);
+  TestConnectAgain(sys);
+  TestReadPastEnd(sys);
+  host::MainLoop::Get()->Quit();
+  return NULL;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  char root[] = "/tmp/nassh_test_XXXXXX";
+  if (!mkdtemp(root)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  host::SetFileSystemRoot(root);
+
+  // Everything Pepper-facing lives on this, the main thread.
+  host::MainLoop main_loop;
+  HostModule module;
+  pp::Instance instance(1);
+  NullJsBridge js;
+  new FileSystem(&instance, &js);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, RunTests, NULL);
+  main_loop.Run();
+  pthread_join(thread, NULL);
+
+  std::string cleanup = std::string("rm -rf ") + root;
+  if (system(cleanup.c_str()))
+    fprintf(stderr, "failed to remove %s\n", root);
+  if (failures) {
+    printf("%d file system checks failed\n", failures);
+    fflush(stdout);
+    _exit(1);
+  }
+  printf("file system checks passed\n");
+  fflush(stdout);
+  // The FileSystem is left alone, as in the benchmark.
+  _exit(0);
+}
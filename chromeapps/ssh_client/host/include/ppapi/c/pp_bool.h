@@ -0,0 +1,19 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_BOOL_H
+#define HOST_PPAPI_C_PP_BOOL_H
+
+typedef enum {
+  PP_FALSE = 0,
+  PP_TRUE = 1
+} PP_Bool;
+
+#define PP_FromBool(b) ((b) ? PP_TRUE : PP_FALSE)
+#define PP_ToBool(b) ((b) != PP_FALSE)
+
+#endif  // HOST_PPAPI_C_PP_BOOL_H
@@ -0,0 +1,21 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_COMPLETION_CALLBACK_H
+#define HOST_PPAPI_C_PP_COMPLETION_CALLBACK_H
+
+#include "ppapi/c/pp_stdint.h"
+
+typedef void (*PP_CompletionCallback_Func)(void* user_data, int32_t result);
+
+struct PP_CompletionCallback {
+  PP_CompletionCallback_Func func;
+  void* user_data;
+  int32_t flags;
+};
+
+#endif  // HOST_PPAPI_C_PP_COMPLETION_CALLBACK_H
@@ -0,0 +1,38 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_ERRORS_H
+#define HOST_PPAPI_C_PP_ERRORS_H
+
+enum {
+  PP_OK = 0,
+  PP_OK_COMPLETIONPENDING = -1,
+  PP_ERROR_FAILED = -2,
+  PP_ERROR_ABORTED = -3,
+  PP_ERROR_BADARGUMENT = -4,
+  PP_ERROR_BADRESOURCE = -5,
+  PP_ERROR_NOINTERFACE = -6,
+  PP_ERROR_NOACCESS = -7,
+  PP_ERROR_NOMEMORY = -8,
+  PP_ERROR_NOSPACE = -9,
+  PP_ERROR_NOQUOTA = -10,
+  PP_ERROR_INPROGRESS = -11,
+  PP_ERROR_NOTSUPPORTED = -12,
+  PP_ERROR_BLOCKS_MAIN_THREAD = -13,
+  PP_ERROR_FILENOTFOUND = -20,
+  PP_ERROR_FILEEXISTS = -21,
+  PP_ERROR_FILETOOBIG = -22,
+  PP_ERROR_FILECHANGED = -23,
+  PP_ERROR_TIMEDOUT = -30,
+  PP_ERROR_USERCANCEL = -40,
+  PP_ERROR_NO_USER_GESTURE = -41,
+  PP_ERROR_CONTEXT_LOST = -50,
+  PP_ERROR_NO_MESSAGE_LOOP = -51,
+  PP_ERROR_WRONG_THREAD = -52
+};
+
+#endif  // HOST_PPAPI_C_PP_ERRORS_H
@@ -0,0 +1,37 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_FILE_INFO_H
+#define HOST_PPAPI_C_PP_FILE_INFO_H
+
+#include "ppapi/c/pp_stdint.h"
+
+typedef double PP_Time;
+
+typedef enum {
+  PP_FILETYPE_REGULAR = 0,
+  PP_FILETYPE_DIRECTORY = 1,
+  PP_FILETYPE_OTHER = 2
+} PP_FileType;
+
+typedef enum {
+  PP_FILESYSTEMTYPE_INVALID = 0,
+  PP_FILESYSTEMTYPE_EXTERNAL = 1,
+  PP_FILESYSTEMTYPE_LOCALPERSISTENT = 2,
+  PP_FILESYSTEMTYPE_LOCALTEMPORARY = 3
+} PP_FileSystemType;
+
+struct PP_FileInfo {
+  int64_t size;
+  PP_FileType type;
+  PP_FileSystemType system_type;
+  PP_Time creation_time;
+  PP_Time last_access_time;
+  PP_Time last_modified_time;
+};
+
+#endif  // HOST_PPAPI_C_PP_FILE_INFO_H
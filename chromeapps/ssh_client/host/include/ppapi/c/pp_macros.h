@@ -0,0 +1,15 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_MACROS_H
+#define HOST_PPAPI_C_PP_MACROS_H
+
+#define PP_COMPILE_ASSERT_SIZE_IN_BYTES(NAME, SIZE)
+#define PP_COMPILE_ASSERT_STRUCT_SIZE_IN_BYTES(NAME, SIZE)
+#define PP_INLINE inline
+
+#endif  // HOST_PPAPI_C_PP_MACROS_H
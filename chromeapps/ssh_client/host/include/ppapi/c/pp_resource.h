@@ -0,0 +1,15 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PP_RESOURCE_H
+#define HOST_PPAPI_C_PP_RESOURCE_H
+
+#include "ppapi/c/pp_stdint.h"
+
+typedef int32_t PP_Resource;
+
+#endif  // HOST_PPAPI_C_PP_RESOURCE_H
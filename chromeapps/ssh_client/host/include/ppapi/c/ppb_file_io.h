@@ -0,0 +1,19 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_C_PPB_FILE_IO_H
+#define HOST_PPAPI_C_PPB_FILE_IO_H
+
+typedef enum {
+  PP_FILEOPENFLAG_READ = 1 << 0,
+  PP_FILEOPENFLAG_WRITE = 1 << 1,
+  PP_FILEOPENFLAG_CREATE = 1 << 2,
+  PP_FILEOPENFLAG_TRUNCATE = 1 << 3,
+  PP_FILEOPENFLAG_EXCLUSIVE = 1 << 4
+} PP_FileOpenFlags;
+
+#endif  // HOST_PPAPI_C_PPB_FILE_IO_H
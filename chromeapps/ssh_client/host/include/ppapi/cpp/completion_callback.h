@@ -0,0 +1,53 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_COMPLETION_CALLBACK_H
+#define HOST_PPAPI_CPP_COMPLETION_CALLBACK_H
+
+#include "ppapi/c/pp_completion_callback.h"
+#include "ppapi/c/pp_errors.h"
+#include "ppapi/cpp/module.h"
+
+namespace pp {
+
+class CompletionCallback {
+ public:
+  enum Flag {
+    kRequired = 0,
+    kOptional = 1
+  };
+
+  CompletionCallback() {
+    cc_.func = NULL;
+    cc_.user_data = NULL;
+    cc_.flags = kRequired;
+  }
+
+  CompletionCallback(PP_CompletionCallback_Func func, void* user_data) {
+    cc_.func = func;
+    cc_.user_data = user_data;
+    cc_.flags = kRequired;
+  }
+
+  void set_flags(int32_t flags) { cc_.flags = flags; }
+  int32_t flags() const { return cc_.flags; }
+  bool IsOptional() const { return !cc_.func || (cc_.flags & kOptional); }
+
+  void Run(int32_t result) const {
+    if (cc_.func)
+      cc_.func(cc_.user_data, result);
+  }
+
+  const PP_CompletionCallback& pp_completion_callback() const { return cc_; }
+
+ private:
+  PP_CompletionCallback cc_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_COMPLETION_CALLBACK_H
@@ -0,0 +1,27 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_CORE_H
+#define HOST_PPAPI_CPP_CORE_H
+
+#include "ppapi/c/pp_stdint.h"
+
+namespace pp {
+
+class CompletionCallback;
+
+class Core {
+ public:
+  void CallOnMainThread(int32_t delay_in_milliseconds,
+                        const CompletionCallback& callback,
+                        int32_t result = 0);
+  bool IsMainThread();
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_CORE_H
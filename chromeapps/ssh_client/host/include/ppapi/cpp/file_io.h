@@ -0,0 +1,40 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_FILE_IO_H
+#define HOST_PPAPI_CPP_FILE_IO_H
+
+#include "ppapi/c/pp_file_info.h"
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/resource.h"
+
+namespace pp {
+
+class CompletionCallback;
+class FileRef;
+
+class FileIO : public Resource {
+ public:
+  FileIO() {}
+  explicit FileIO(const InstanceHandle& instance);
+
+  int32_t Open(const FileRef& file_ref, int32_t open_flags,
+               const CompletionCallback& callback);
+  int32_t Query(PP_FileInfo* result_buf, const CompletionCallback& callback);
+  int32_t Read(int64_t offset, char* buffer, int32_t bytes_to_read,
+               const CompletionCallback& callback);
+  int32_t Write(int64_t offset, const char* buffer, int32_t bytes_to_write,
+                const CompletionCallback& callback);
+  int32_t SetLength(int64_t length, const CompletionCallback& callback);
+  int32_t Flush(const CompletionCallback& callback);
+  void Close();
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_FILE_IO_H
@@ -0,0 +1,37 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_FILE_REF_H
+#define HOST_PPAPI_CPP_FILE_REF_H
+
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/pass_ref.h"
+#include "ppapi/cpp/resource.h"
+#include "ppapi/cpp/var.h"
+
+namespace pp {
+
+class CompletionCallback;
+class FileSystem;
+
+class FileRef : public Resource {
+ public:
+  FileRef() {}
+  FileRef(PassRef, PP_Resource resource);
+  FileRef(const FileSystem& file_system, const char* path);
+
+  Var GetPath() const;
+  int32_t MakeDirectory(const CompletionCallback& callback);
+  int32_t MakeDirectoryIncludingAncestors(const CompletionCallback& callback);
+  int32_t Delete(const CompletionCallback& callback);
+  int32_t Rename(const FileRef& new_file_ref,
+                 const CompletionCallback& callback);
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_FILE_REF_H
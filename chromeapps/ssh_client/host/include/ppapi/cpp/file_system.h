@@ -0,0 +1,30 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_FILE_SYSTEM_H
+#define HOST_PPAPI_CPP_FILE_SYSTEM_H
+
+#include "ppapi/c/pp_file_info.h"
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/resource.h"
+
+namespace pp {
+
+class CompletionCallback;
+
+class FileSystem : public Resource {
+ public:
+  FileSystem() {}
+  FileSystem(const InstanceHandle& instance, PP_FileSystemType type);
+
+  int32_t Open(int64_t expected_size, const CompletionCallback& callback);
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_FILE_SYSTEM_H
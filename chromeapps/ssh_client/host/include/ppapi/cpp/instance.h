@@ -0,0 +1,33 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_INSTANCE_H
+#define HOST_PPAPI_CPP_INSTANCE_H
+
+#include "ppapi/c/pp_instance.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/var.h"
+
+namespace pp {
+
+class Instance {
+ public:
+  explicit Instance(PP_Instance instance);
+  virtual ~Instance();
+
+  PP_Instance pp_instance() const { return pp_instance_; }
+
+  virtual void HandleMessage(const Var& message) {}
+  void PostMessage(const Var& message);
+
+ private:
+  PP_Instance pp_instance_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_INSTANCE_H
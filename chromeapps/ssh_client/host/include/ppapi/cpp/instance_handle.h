@@ -0,0 +1,31 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_INSTANCE_HANDLE_H
+#define HOST_PPAPI_CPP_INSTANCE_HANDLE_H
+
+#include "ppapi/c/pp_instance.h"
+
+namespace pp {
+
+class Instance;
+
+class InstanceHandle {
+ public:
+  InstanceHandle(Instance* instance);
+  explicit InstanceHandle(PP_Instance pp_instance)
+      : pp_instance_(pp_instance) {}
+
+  PP_Instance pp_instance() const { return pp_instance_; }
+
+ private:
+  PP_Instance pp_instance_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_INSTANCE_HANDLE_H
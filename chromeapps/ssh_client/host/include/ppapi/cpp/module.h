@@ -0,0 +1,39 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_MODULE_H
+#define HOST_PPAPI_CPP_MODULE_H
+
+#include "ppapi/c/pp_instance.h"
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/core.h"
+
+namespace pp {
+
+class Instance;
+
+class Module {
+ public:
+  Module();
+  virtual ~Module();
+
+  static Module* Get();
+
+  Core* core() { return &core_; }
+
+  virtual Instance* CreateInstance(PP_Instance instance) = 0;
+
+ private:
+  Core core_;
+};
+
+// Provided by the embedder.
+Module* CreateModule();
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_MODULE_H
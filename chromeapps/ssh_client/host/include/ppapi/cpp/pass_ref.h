@@ -0,0 +1,17 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_PASS_REF_H
+#define HOST_PPAPI_CPP_PASS_REF_H
+
+namespace pp {
+
+enum PassRef { PASS_REF };
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_PASS_REF_H
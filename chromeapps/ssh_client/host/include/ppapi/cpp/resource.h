@@ -0,0 +1,42 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_RESOURCE_H
+#define HOST_PPAPI_CPP_RESOURCE_H
+
+#include "ppapi/c/pp_resource.h"
+#include "ppapi/cpp/pass_ref.h"
+
+namespace pp {
+
+// Resources are reference counted handles into the host object
+// registry (see host/ppapi_host.cc).
+class Resource {
+ public:
+  Resource();
+  Resource(const Resource& other);
+  virtual ~Resource();
+
+  Resource& operator=(const Resource& other);
+
+  bool is_null() const { return !pp_resource_; }
+  PP_Resource pp_resource() const { return pp_resource_; }
+  PP_Resource detach();
+
+ protected:
+  explicit Resource(PP_Resource resource);
+  Resource(PassRef, PP_Resource resource);
+
+  void PassRefFromConstructor(PP_Resource resource);
+
+ private:
+  PP_Resource pp_resource_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_RESOURCE_H
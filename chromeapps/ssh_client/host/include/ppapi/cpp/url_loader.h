@@ -0,0 +1,36 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_URL_LOADER_H
+#define HOST_PPAPI_CPP_URL_LOADER_H
+
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/resource.h"
+#include "ppapi/cpp/url_response_info.h"
+
+namespace pp {
+
+class CompletionCallback;
+class URLRequestInfo;
+
+class URLLoader : public Resource {
+ public:
+  explicit URLLoader(const InstanceHandle& instance);
+
+  int32_t Open(const URLRequestInfo& request_info,
+               const CompletionCallback& callback);
+  int32_t FinishStreamingToFile(const CompletionCallback& callback);
+  URLResponseInfo GetResponseInfo() const;
+  int32_t ReadResponseBody(void* buffer, int32_t bytes_to_read,
+                           const CompletionCallback& callback);
+  void Close();
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_URL_LOADER_H
@@ -0,0 +1,28 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_URL_REQUEST_INFO_H
+#define HOST_PPAPI_CPP_URL_REQUEST_INFO_H
+
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/resource.h"
+#include "ppapi/cpp/var.h"
+
+namespace pp {
+
+class URLRequestInfo : public Resource {
+ public:
+  explicit URLRequestInfo(const InstanceHandle& instance);
+
+  bool SetURL(const Var& url_string);
+  bool SetMethod(const Var& method_string);
+  bool SetStreamToFile(bool enable);
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_URL_REQUEST_INFO_H
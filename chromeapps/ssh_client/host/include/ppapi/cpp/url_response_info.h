@@ -0,0 +1,28 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_URL_RESPONSE_INFO_H
+#define HOST_PPAPI_CPP_URL_RESPONSE_INFO_H
+
+#include "ppapi/c/pp_stdint.h"
+#include "ppapi/cpp/file_ref.h"
+#include "ppapi/cpp/resource.h"
+
+namespace pp {
+
+class URLResponseInfo : public Resource {
+ public:
+  URLResponseInfo() {}
+  URLResponseInfo(PassRef, PP_Resource resource);
+
+  int32_t GetStatusCode() const;
+  FileRef GetBodyAsFileRef() const;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_URL_RESPONSE_INFO_H
@@ -0,0 +1,64 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Only
+// the subset used by src/ is declared.
+
+#ifndef HOST_PPAPI_CPP_VAR_H
+#define HOST_PPAPI_CPP_VAR_H
+
+#include <string>
+
+#include "ppapi/c/pp_stdint.h"
+
+namespace pp {
+
+class Var {
+ public:
+  enum Type {
+    kUndefined,
+    kNull,
+    kBool,
+    kInt,
+    kDouble,
+    kString,
+    kArrayBuffer
+  };
+
+  Var() : type_(kUndefined), bool_(false), int_(0), double_(0) {}
+  Var(bool b) : type_(kBool), bool_(b), int_(0), double_(0) {}
+  Var(int32_t i) : type_(kInt), bool_(false), int_(i), double_(0) {}
+  Var(double d) : type_(kDouble), bool_(false), int_(0), double_(d) {}
+  Var(const char* str)
+      : type_(kString), bool_(false), int_(0), double_(0), string_(str) {}
+  Var(const std::string& str)
+      : type_(kString), bool_(false), int_(0), double_(0), string_(str) {}
+  virtual ~Var() {}
+
+  bool is_undefined() const { return type_ == kUndefined; }
+  bool is_null() const { return type_ == kNull; }
+  bool is_bool() const { return type_ == kBool; }
+  bool is_int() const { return type_ == kInt; }
+  bool is_double() const { return type_ == kDouble; }
+  bool is_number() const { return is_int() || is_double(); }
+  bool is_string() const { return type_ == kString; }
+  bool is_array_buffer() const { return type_ == kArrayBuffer; }
+
+  bool AsBool() const { return bool_; }
+  int32_t AsInt() const { return is_double() ? int32_t(double_) : int_; }
+  double AsDouble() const { return is_int() ? double(int_) : double_; }
+  std::string AsString() const { return string_; }
+
+ protected:
+  // Array buffers keep their contents in string_.
+  Type type_;
+  bool bool_;
+  int32_t int_;
+  double double_;
+  std::string string_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_CPP_VAR_H
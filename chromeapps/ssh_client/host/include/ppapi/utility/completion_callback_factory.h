@@ -0,0 +1,202 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host build stand-in for the NaCl SDK header of the same name. Like
+// the real factory, callbacks hold a reference to a shared back pointer
+// which is cleared when the factory is destroyed, so callbacks that run
+// afterwards are dropped.
+
+#ifndef HOST_PPAPI_UTILITY_COMPLETION_CALLBACK_FACTORY_H
+#define HOST_PPAPI_UTILITY_COMPLETION_CALLBACK_FACTORY_H
+
+#include <assert.h>
+
+#include "ppapi/cpp/completion_callback.h"
+
+namespace pp {
+
+template <typename T, typename RefCount>
+class CompletionCallbackFactory {
+ public:
+  explicit CompletionCallbackFactory(T* object = NULL)
+      : object_(object) {
+    InitBackPointer();
+  }
+
+  ~CompletionCallbackFactory() {
+    ResetBackPointer();
+  }
+
+  void CancelAll() {
+    ResetBackPointer();
+    InitBackPointer();
+  }
+
+  void Initialize(T* object) {
+    assert(object);
+    assert(!object_);
+    object_ = object;
+  }
+
+  T* GetObject() { return object_; }
+
+  template <typename Method>
+  CompletionCallback NewCallback(Method method) {
+    return NewCallbackHelper(new Dispatcher0<Method>(method));
+  }
+
+  template <typename Method>
+  CompletionCallback NewOptionalCallback(Method method) {
+    CompletionCallback cc = NewCallback(method);
+    cc.set_flags(cc.flags() | CompletionCallback::kOptional);
+    return cc;
+  }
+
+  template <typename Method, typename A>
+  CompletionCallback NewCallback(Method method, const A& a) {
+    return NewCallbackHelper(new Dispatcher1<Method, A>(method, a));
+  }
+
+  template <typename Method, typename A, typename B>
+  CompletionCallback NewCallback(Method method, const A& a, const B& b) {
+    return NewCallbackHelper(new Dispatcher2<Method, A, B>(method, a, b));
+  }
+
+  template <typename Method, typename A, typename B, typename C>
+  CompletionCallback NewCallback(Method method, const A& a, const B& b,
+                                 const C& c) {
+    return NewCallbackHelper(
+        new Dispatcher3<Method, A, B, C>(method, a, b, c));
+  }
+
+ private:
+  class BackPointer {
+   public:
+    explicit BackPointer(CompletionCallbackFactory* factory)
+        : factory_(factory) {
+    }
+
+    void AddRef() { ref_.AddRef(); }
+
+    void Release() {
+      if (ref_.Release() == 0)
+        delete this;
+    }
+
+    void DropFactory() { factory_ = NULL; }
+
+    T* GetObject() { return factory_ ? factory_->GetObject() : NULL; }
+
+   private:
+    RefCount ref_;
+    CompletionCallbackFactory* factory_;
+  };
+
+  template <typename Dispatcher>
+  class CallbackData {
+   public:
+    CallbackData(BackPointer* back_pointer, Dispatcher* dispatcher)
+        : back_pointer_(back_pointer), dispatcher_(dispatcher) {
+      back_pointer_->AddRef();
+    }
+
+    ~CallbackData() {
+      back_pointer_->Release();
+      delete dispatcher_;
+    }
+
+    static void Thunk(void* user_data, int32_t result) {
+      CallbackData* self = static_cast<CallbackData*>(user_data);
+      T* object = self->back_pointer_->GetObject();
+      if (object)
+        (*self->dispatcher_)(object, result);
+      delete self;
+    }
+
+   private:
+    BackPointer* back_pointer_;
+    Dispatcher* dispatcher_;
+  };
+
+  template <typename Method>
+  class Dispatcher0 {
+   public:
+    explicit Dispatcher0(Method method) : method_(method) {}
+    void operator()(T* object, int32_t result) {
+      (object->*method_)(result);
+    }
+   private:
+    Method method_;
+  };
+
+  template <typename Method, typename A>
+  class Dispatcher1 {
+   public:
+    Dispatcher1(Method method, const A& a) : method_(method), a_(a) {}
+    void operator()(T* object, int32_t result) {
+      (object->*method_)(result, a_);
+    }
+   private:
+    Method method_;
+    A a_;
+  };
+
+  template <typename Method, typename A, typename B>
+  class Dispatcher2 {
+   public:
+    Dispatcher2(Method method, const A& a, const B& b)
+        : method_(method), a_(a), b_(b) {}
+    void operator()(T* object, int32_t result) {
+      (object->*method_)(result, a_, b_);
+    }
+   private:
+    Method method_;
+    A a_;
+    B b_;
+  };
+
+  template <typename Method, typename A, typename B, typename C>
+  class Dispatcher3 {
+   public:
+    Dispatcher3(Method method, const A& a, const B& b, const C& c)
+        : method_(method), a_(a), b_(b), c_(c) {}
+    void operator()(T* object, int32_t result) {
+      (object->*method_)(result, a_, b_, c_);
+    }
+   private:
+    Method method_;
+    A a_;
+    B b_;
+    C c_;
+  };
+
+  void InitBackPointer() {
+    back_pointer_ = new BackPointer(this);
+    back_pointer_->AddRef();
+  }
+
+  void ResetBackPointer() {
+    back_pointer_->DropFactory();
+    back_pointer_->Release();
+  }
+
+  template <typename Dispatcher>
+  CompletionCallback NewCallbackHelper(Dispatcher* dispatcher) {
+    assert(object_);
+    return CompletionCallback(
+        &CallbackData<Dispatcher>::Thunk,
+        new CallbackData<Dispatcher>(back_pointer_, dispatcher));
+  }
+
+  // Disallow copying.
+  CompletionCallbackFactory(const CompletionCallbackFactory&);
+  CompletionCallbackFactory& operator=(const CompletionCallbackFactory&);
+
+  T* object_;
+  BackPointer* back_pointer_;
+};
+
+}  // namespace pp
+
+#endif  // HOST_PPAPI_UTILITY_COMPLETION_CALLBACK_FACTORY_H
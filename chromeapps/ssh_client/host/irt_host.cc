@@ -0,0 +1,56 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host replacements for the pieces of src/syscalls.cc and the NaCl IRT
+// that the file system layer depends on. The host build calls FileSystem
+// directly instead of wrapping libc.
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "irt/irt.h"
+
+namespace {
+
+// LOG() is very chatty on hot paths; keep it quiet unless asked for so it
+// doesn't dominate benchmark numbers.
+bool log_enabled = getenv("NASSH_HOST_LOG") != NULL;
+
+int GetRandomBytes(void* buf, size_t count, size_t* nread) {
+  static int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  ssize_t result = ::read(fd, buf, count);
+  if (result < 0)
+    return 1;
+  *nread = result;
+  return 0;
+}
+
+}  // namespace
+
+extern "C" void debug_log(const char* format, ...) {
+  if (!log_enabled)
+    return;
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+}
+
+extern "C" void DoWrapSysCalls() {
+}
+
+size_t nacl_interface_query(const char* interface_ident,
+                            void* table, size_t tablesize) {
+  if (!strcmp(interface_ident, NACL_IRT_RANDOM_v0_1) &&
+      tablesize >= sizeof(nacl_irt_random)) {
+    nacl_irt_random* random = static_cast<nacl_irt_random*>(table);
+    random->get_random_bytes = GetRandomBytes;
+    return sizeof(nacl_irt_random);
+  }
+  return 0;
+}
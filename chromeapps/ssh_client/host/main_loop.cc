@@ -0,0 +1,157 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "main_loop.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace host {
+
+MainLoop* MainLoop::main_loop_ = NULL;
+
+MainLoop::MainLoop()
+  : main_thread_(pthread_self()), wakeup_pending_(false), quit_(false) {
+  assert(!main_loop_);
+  main_loop_ = this;
+  int result = pipe(wakeup_pipe_);
+  assert(result == 0);
+  (void)result;
+  fcntl(wakeup_pipe_[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakeup_pipe_[1], F_SETFL, O_NONBLOCK);
+}
+
+MainLoop::~MainLoop() {
+  // Drop the remaining callbacks without running them, like a dying
+  // renderer would.
+  tasks_.clear();
+  ::close(wakeup_pipe_[0]);
+  ::close(wakeup_pipe_[1]);
+  main_loop_ = NULL;
+}
+
+MainLoop* MainLoop::Get() {
+  assert(main_loop_);
+  return main_loop_;
+}
+
+bool MainLoop::IsMainThread() {
+  return pthread_equal(pthread_self(), main_thread_);
+}
+
+uint64_t MainLoop::Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+void MainLoop::Run() {
+  assert(IsMainThread());
+  while (true) {
+    int timeout = RunTasks();
+    {
+      Mutex::Lock lock(mutex_);
+      if (quit_) {
+        quit_ = false;
+        return;
+      }
+    }
+
+    pollfds_.clear();
+    pollfd wakeup = { wakeup_pipe_[0], POLLIN, 0 };
+    pollfds_.push_back(wakeup);
+    for (WatchMap::iterator it = watches_.begin(); it != watches_.end(); ++it) {
+      pollfd pfd = { it->first, it->second.events, 0 };
+      pollfds_.push_back(pfd);
+    }
+
+    int nready = ::poll(&pollfds_[0], pollfds_.size(), timeout);
+    if (nready < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+
+    if (pollfds_[0].revents) {
+      char buf[64];
+      while (::read(wakeup_pipe_[0], buf, sizeof(buf)) > 0) {}
+      Mutex::Lock lock(mutex_);
+      wakeup_pending_ = false;
+    }
+
+    for (size_t i = 1; i < pollfds_.size(); i++) {
+      if (!pollfds_[i].revents)
+        continue;
+      // An earlier watcher may have removed or replaced this watch.
+      WatchMap::iterator it = watches_.find(pollfds_[i].fd);
+      if (it == watches_.end())
+        continue;
+      it->second.watcher->OnFdReady(pollfds_[i].fd, pollfds_[i].revents);
+    }
+  }
+}
+
+void MainLoop::Quit() {
+  Mutex::Lock lock(mutex_);
+  quit_ = true;
+  Wakeup();
+}
+
+void MainLoop::PostTask(int32_t delay_in_milliseconds,
+                        const pp::CompletionCallback& callback,
+                        int32_t result) {
+  Task task = { callback, result };
+  Mutex::Lock lock(mutex_);
+  tasks_.insert(std::make_pair(Now() + delay_in_milliseconds * 1000ULL, task));
+  Wakeup();
+}
+
+void MainLoop::Watch(int fd, short events, FdWatcher* watcher) {
+  assert(IsMainThread());
+  if (!events) {
+    watches_.erase(fd);
+    return;
+  }
+  FdWatch& watch = watches_[fd];
+  watch.events = events;
+  watch.watcher = watcher;
+}
+
+void MainLoop::Wakeup() {
+  // Called with mutex_ held.
+  if (!wakeup_pending_ && !IsMainThread()) {
+    wakeup_pending_ = true;
+    char c = 0;
+    ssize_t result = ::write(wakeup_pipe_[1], &c, 1);
+    (void)result;
+  }
+}
+
+int MainLoop::RunTasks() {
+  // Run only the tasks that are due now; ones they post go round the
+  // loop again so descriptors get polled in between.
+  std::vector<Task> due;
+  uint64_t now = Now();
+  {
+    Mutex::Lock lock(mutex_);
+    TaskMap::iterator end = tasks_.upper_bound(now);
+    for (TaskMap::iterator it = tasks_.begin(); it != end; ++it)
+      due.push_back(it->second);
+    tasks_.erase(tasks_.begin(), end);
+  }
+
+  for (size_t i = 0; i < due.size(); i++)
+    due[i].callback.Run(due[i].result);
+
+  Mutex::Lock lock(mutex_);
+  if (tasks_.empty())
+    return -1;
+  uint64_t next = tasks_.begin()->first;
+  now = Now();
+  return next <= now ? 0 : static_cast<int>((next - now + 999) / 1000);
+}
+
+}  // namespace host
@@ -0,0 +1,91 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HOST_MAIN_LOOP_H
+#define HOST_MAIN_LOOP_H
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <map>
+#include <vector>
+
+#include "ppapi/cpp/completion_callback.h"
+
+#include "pthread_helpers.h"
+
+namespace host {
+
+class FdWatcher {
+ public:
+  virtual ~FdWatcher() {}
+
+  // Called on the main thread with the poll() revents of a watched fd.
+  virtual void OnFdReady(int fd, short revents) = 0;
+};
+
+// Stand-in for the Pepper main thread. Runs callbacks posted with
+// pp::Core::CallOnMainThread in order and dispatches readiness of the
+// descriptors behind the fake sockets.
+class MainLoop {
+ public:
+  // The thread that creates the loop becomes the main thread.
+  MainLoop();
+  ~MainLoop();
+
+  static MainLoop* Get();
+
+  bool IsMainThread();
+
+  // Runs until Quit() is called.
+  void Run();
+  // May be called from any thread.
+  void Quit();
+
+  // May be called from any thread.
+  void PostTask(int32_t delay_in_milliseconds,
+                const pp::CompletionCallback& callback, int32_t result);
+
+  // Main thread only. Replaces any previous watch on |fd|; |events| of
+  // zero removes it.
+  void Watch(int fd, short events, FdWatcher* watcher);
+
+ private:
+  struct Task {
+    pp::CompletionCallback callback;
+    int32_t result;
+  };
+
+  struct FdWatch {
+    short events;
+    FdWatcher* watcher;
+  };
+
+  typedef std::multimap<uint64_t, Task> TaskMap;
+  typedef std::map<int, FdWatch> WatchMap;
+
+  static uint64_t Now();
+
+  void Wakeup();
+  // Runs tasks that are due and returns the poll() timeout until the
+  // next one.
+  int RunTasks();
+
+  static MainLoop* main_loop_;
+
+  pthread_t main_thread_;
+  Mutex mutex_;
+  TaskMap tasks_;
+  WatchMap watches_;
+  std::vector<pollfd> pollfds_;
+  int wakeup_pipe_[2];
+  bool wakeup_pending_;
+  bool quit_;
+
+  DISALLOW_COPY_AND_ASSIGN(MainLoop);
+};
+
+}  // namespace host
+
+#endif  // HOST_MAIN_LOOP_H
@@ -0,0 +1,481 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host implementations of the core Pepper classes, the HTML5 file system
+// (backed by a host directory) and the URL loader (which always fails;
+// the host build has no web server to fetch from).
+
+#include "ppapi_host.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "ppapi/c/pp_errors.h"
+#include "ppapi/c/ppb_file_io.h"
+#include "ppapi/cpp/completion_callback.h"
+#include "ppapi/cpp/core.h"
+#include "ppapi/cpp/file_io.h"
+#include "ppapi/cpp/file_ref.h"
+#include "ppapi/cpp/file_system.h"
+#include "ppapi/cpp/instance.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/module.h"
+#include "ppapi/cpp/resource.h"
+#include "ppapi/cpp/url_loader.h"
+#include "ppapi/cpp/url_request_info.h"
+#include "ppapi/cpp/url_response_info.h"
+
+#include "main_loop.h"
+#include "resource_tracker.h"
+
+namespace host {
+
+namespace {
+
+std::string file_system_root = "/tmp/nassh_host_fs";
+
+class HostFileSystem : public HostResource {
+};
+
+class HostFileRef : public HostResource {
+ public:
+  explicit HostFileRef(const std::string& path) : path_(path) {}
+
+  const std::string& path() const { return path_; }
+  std::string host_path() const { return file_system_root + path_; }
+
+ private:
+  std::string path_;
+};
+
+class HostFileIO : public HostResource {
+ public:
+  HostFileIO() : fd_(-1) {}
+  virtual ~HostFileIO() { Close(); }
+
+  int fd() const { return fd_; }
+  void set_fd(int fd) { Close(); fd_ = fd; }
+  void Close() {
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+  }
+
+ private:
+  int fd_;
+};
+
+int MakeDirectories(const std::string& path) {
+  for (size_t pos = 1; pos <= path.size(); pos++) {
+    if (pos != path.size() && path[pos] != '/')
+      continue;
+    if (::mkdir(path.substr(0, pos).c_str(), 0755) && errno != EEXIST)
+      return errno;
+  }
+  return 0;
+}
+
+}  // namespace
+
+void SetFileSystemRoot(const char* path) {
+  file_system_root = path;
+}
+
+int32_t PostCompletion(const pp::CompletionCallback& callback,
+                       int32_t result) {
+  MainLoop::Get()->PostTask(0, callback, result);
+  return PP_OK_COMPLETIONPENDING;
+}
+
+int32_t ErrnoToPPError(int err) {
+  switch (err) {
+    case 0:
+      return PP_OK;
+    case ENOENT:
+      return PP_ERROR_FILENOTFOUND;
+    case EEXIST:
+      return PP_ERROR_FILEEXISTS;
+    case EACCES:
+    case EPERM:
+      return PP_ERROR_NOACCESS;
+    case ENOMEM:
+      return PP_ERROR_NOMEMORY;
+    case ENOSPC:
+      return PP_ERROR_NOSPACE;
+    case EFBIG:
+      return PP_ERROR_FILETOOBIG;
+    case ETIMEDOUT:
+      return PP_ERROR_TIMEDOUT;
+    case EINVAL:
+      return PP_ERROR_BADARGUMENT;
+    default:
+      return PP_ERROR_FAILED;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+ResourceTracker::ResourceTracker() : next_resource_(1) {
+}
+
+ResourceTracker* ResourceTracker::Get() {
+  static ResourceTracker* tracker = new ResourceTracker();
+  return tracker;
+}
+
+PP_Resource ResourceTracker::Add(HostResource* object) {
+  Mutex::Lock lock(mutex_);
+  PP_Resource resource = next_resource_++;
+  Entry entry = { object, 1 };
+  resources_[resource] = entry;
+  return resource;
+}
+
+void ResourceTracker::AddRef(PP_Resource resource) {
+  Mutex::Lock lock(mutex_);
+  ResourceMap::iterator it = resources_.find(resource);
+  assert(it != resources_.end());
+  it->second.ref++;
+}
+
+void ResourceTracker::Release(PP_Resource resource) {
+  HostResource* object;
+  {
+    Mutex::Lock lock(mutex_);
+    ResourceMap::iterator it = resources_.find(resource);
+    assert(it != resources_.end());
+    if (--it->second.ref)
+      return;
+    object = it->second.object;
+    resources_.erase(it);
+  }
+  // Destructors may post aborted callbacks, so run them unlocked.
+  delete object;
+}
+
+}  // namespace host
+
+using host::HostFileIO;
+using host::HostFileRef;
+using host::HostFileSystem;
+using host::PostCompletion;
+using host::ResourceTracker;
+
+namespace pp {
+
+namespace {
+
+Module* module_singleton = NULL;
+
+}  // namespace
+
+void Core::CallOnMainThread(int32_t delay_in_milliseconds,
+                            const CompletionCallback& callback,
+                            int32_t result) {
+  host::MainLoop::Get()->PostTask(delay_in_milliseconds, callback, result);
+}
+
+bool Core::IsMainThread() {
+  return host::MainLoop::Get()->IsMainThread();
+}
+
+Module::Module() {
+  assert(!module_singleton);
+  module_singleton = this;
+}
+
+Module::~Module() {
+  module_singleton = NULL;
+}
+
+Module* Module::Get() {
+  return module_singleton;
+}
+
+Instance::Instance(PP_Instance instance) : pp_instance_(instance) {
+}
+
+Instance::~Instance() {
+}
+
+void Instance::PostMessage(const Var& message) {
+}
+
+InstanceHandle::InstanceHandle(Instance* instance)
+    : pp_instance_(instance->pp_instance()) {
+}
+
+//------------------------------------------------------------------------------
+
+Resource::Resource() : pp_resource_(0) {
+}
+
+Resource::Resource(const Resource& other) : pp_resource_(other.pp_resource_) {
+  if (pp_resource_)
+    ResourceTracker::Get()->AddRef(pp_resource_);
+}
+
+Resource::~Resource() {
+  if (pp_resource_)
+    ResourceTracker::Get()->Release(pp_resource_);
+}
+
+Resource& Resource::operator=(const Resource& other) {
+  if (other.pp_resource_)
+    ResourceTracker::Get()->AddRef(other.pp_resource_);
+  if (pp_resource_)
+    ResourceTracker::Get()->Release(pp_resource_);
+  pp_resource_ = other.pp_resource_;
+  return *this;
+}
+
+PP_Resource Resource::detach() {
+  PP_Resource resource = pp_resource_;
+  pp_resource_ = 0;
+  return resource;
+}
+
+Resource::Resource(PP_Resource resource) : pp_resource_(resource) {
+  if (pp_resource_)
+    ResourceTracker::Get()->AddRef(pp_resource_);
+}
+
+Resource::Resource(PassRef, PP_Resource resource) : pp_resource_(resource) {
+}
+
+void Resource::PassRefFromConstructor(PP_Resource resource) {
+  assert(!pp_resource_);
+  pp_resource_ = resource;
+}
+
+//------------------------------------------------------------------------------
+
+FileSystem::FileSystem(const InstanceHandle& instance,
+                       PP_FileSystemType type) {
+  PassRefFromConstructor(ResourceTracker::Get()->Add(new HostFileSystem()));
+}
+
+int32_t FileSystem::Open(int64_t expected_size,
+                         const CompletionCallback& callback) {
+  return PostCompletion(callback, host::ErrnoToPPError(
+      host::MakeDirectories(host::file_system_root)));
+}
+
+FileRef::FileRef(PassRef, PP_Resource resource)
+    : Resource(PASS_REF, resource) {
+}
+
+FileRef::FileRef(const FileSystem& file_system, const char* path) {
+  PassRefFromConstructor(
+      ResourceTracker::Get()->Add(new HostFileRef(path)));
+}
+
+Var FileRef::GetPath() const {
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(pp_resource());
+  return ref ? Var(ref->path()) : Var();
+}
+
+int32_t FileRef::MakeDirectory(const CompletionCallback& callback) {
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(pp_resource());
+  if (!ref)
+    return PP_ERROR_BADRESOURCE;
+  int err = ::mkdir(ref->host_path().c_str(), 0755) ? errno : 0;
+  return PostCompletion(callback, host::ErrnoToPPError(err));
+}
+
+int32_t FileRef::MakeDirectoryIncludingAncestors(
+    const CompletionCallback& callback) {
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(pp_resource());
+  if (!ref)
+    return PP_ERROR_BADRESOURCE;
+  return PostCompletion(callback, host::ErrnoToPPError(
+      host::MakeDirectories(ref->host_path())));
+}
+
+int32_t FileRef::Delete(const CompletionCallback& callback) {
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(pp_resource());
+  if (!ref)
+    return PP_ERROR_BADRESOURCE;
+  int err = 0;
+  if (::unlink(ref->host_path().c_str()) &&
+      ::rmdir(ref->host_path().c_str())) {
+    err = errno;
+  }
+  return PostCompletion(callback, host::ErrnoToPPError(err));
+}
+
+int32_t FileRef::Rename(const FileRef& new_file_ref,
+                        const CompletionCallback& callback) {
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(pp_resource());
+  HostFileRef* new_ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(new_file_ref.pp_resource());
+  if (!ref || !new_ref)
+    return PP_ERROR_BADRESOURCE;
+  int err = ::rename(ref->host_path().c_str(),
+                     new_ref->host_path().c_str()) ? errno : 0;
+  return PostCompletion(callback, host::ErrnoToPPError(err));
+}
+
+FileIO::FileIO(const InstanceHandle& instance) {
+  PassRefFromConstructor(ResourceTracker::Get()->Add(new HostFileIO()));
+}
+
+int32_t FileIO::Open(const FileRef& file_ref, int32_t open_flags,
+                     const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  HostFileRef* ref =
+      ResourceTracker::Get()->GetAs<HostFileRef>(file_ref.pp_resource());
+  if (!io || !ref)
+    return PP_ERROR_BADRESOURCE;
+
+  int oflag;
+  if ((open_flags & PP_FILEOPENFLAG_READ) &&
+      (open_flags & PP_FILEOPENFLAG_WRITE)) {
+    oflag = O_RDWR;
+  } else if (open_flags & PP_FILEOPENFLAG_WRITE) {
+    oflag = O_WRONLY;
+  } else {
+    oflag = O_RDONLY;
+  }
+  if (open_flags & PP_FILEOPENFLAG_CREATE)
+    oflag |= O_CREAT;
+  if (open_flags & PP_FILEOPENFLAG_TRUNCATE)
+    oflag |= O_TRUNC;
+  if (open_flags & PP_FILEOPENFLAG_EXCLUSIVE)
+    oflag |= O_EXCL;
+
+  int fd = ::open(ref->host_path().c_str(), oflag, 0644);
+  if (fd < 0)
+    return PostCompletion(callback, host::ErrnoToPPError(errno));
+  io->set_fd(fd);
+  return PostCompletion(callback, PP_OK);
+}
+
+int32_t FileIO::Query(PP_FileInfo* result_buf,
+                      const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (!io)
+    return PP_ERROR_BADRESOURCE;
+  struct stat st;
+  if (::fstat(io->fd(), &st))
+    return PostCompletion(callback, host::ErrnoToPPError(errno));
+  result_buf->size = st.st_size;
+  result_buf->type = S_ISDIR(st.st_mode) ?
+      PP_FILETYPE_DIRECTORY : PP_FILETYPE_REGULAR;
+  result_buf->system_type = PP_FILESYSTEMTYPE_LOCALPERSISTENT;
+  result_buf->creation_time = st.st_ctime;
+  result_buf->last_access_time = st.st_atime;
+  result_buf->last_modified_time = st.st_mtime;
+  return PostCompletion(callback, PP_OK);
+}
+
+int32_t FileIO::Read(int64_t offset, char* buffer, int32_t bytes_to_read,
+                     const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (!io)
+    return PP_ERROR_BADRESOURCE;
+  ssize_t result = ::pread(io->fd(), buffer, bytes_to_read, offset);
+  return PostCompletion(callback, result >= 0 ?
+      static_cast<int32_t>(result) : host::ErrnoToPPError(errno));
+}
+
+int32_t FileIO::Write(int64_t offset, const char* buffer,
+                      int32_t bytes_to_write,
+                      const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (!io)
+    return PP_ERROR_BADRESOURCE;
+  ssize_t result = ::pwrite(io->fd(), buffer, bytes_to_write, offset);
+  return PostCompletion(callback, result >= 0 ?
+      static_cast<int32_t>(result) : host::ErrnoToPPError(errno));
+}
+
+int32_t FileIO::SetLength(int64_t length,
+                          const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (!io)
+    return PP_ERROR_BADRESOURCE;
+  int err = ::ftruncate(io->fd(), length) ? errno : 0;
+  return PostCompletion(callback, host::ErrnoToPPError(err));
+}
+
+int32_t FileIO::Flush(const CompletionCallback& callback) {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (!io)
+    return PP_ERROR_BADRESOURCE;
+  int err = ::fdatasync(io->fd()) ? errno : 0;
+  return PostCompletion(callback, host::ErrnoToPPError(err));
+}
+
+void FileIO::Close() {
+  HostFileIO* io = ResourceTracker::Get()->GetAs<HostFileIO>(pp_resource());
+  if (io)
+    io->Close();
+}
+
+//------------------------------------------------------------------------------
+
+URLLoader::URLLoader(const InstanceHandle& instance) {
+}
+
+int32_t URLLoader::Open(const URLRequestInfo& request_info,
+                        const CompletionCallback& callback) {
+  return PostCompletion(callback, PP_ERROR_FAILED);
+}
+
+int32_t URLLoader::FinishStreamingToFile(const CompletionCallback& callback) {
+  return PostCompletion(callback, PP_ERROR_FAILED);
+}
+
+URLResponseInfo URLLoader::GetResponseInfo() const {
+  return URLResponseInfo();
+}
+
+int32_t URLLoader::ReadResponseBody(void* buffer, int32_t bytes_to_read,
+                                    const CompletionCallback& callback) {
+  return PostCompletion(callback, PP_ERROR_FAILED);
+}
+
+void URLLoader::Close() {
+}
+
+URLRequestInfo::URLRequestInfo(const InstanceHandle& instance) {
+}
+
+bool URLRequestInfo::SetURL(const Var& url_string) {
+  return true;
+}
+
+bool URLRequestInfo::SetMethod(const Var& method_string) {
+  return true;
+}
+
+bool URLRequestInfo::SetStreamToFile(bool enable) {
+  return true;
+}
+
+URLResponseInfo::URLResponseInfo(PassRef, PP_Resource resource)
+    : Resource(PASS_REF, resource) {
+}
+
+int32_t URLResponseInfo::GetStatusCode() const {
+  return 0;
+}
+
+FileRef URLResponseInfo::GetBodyAsFileRef() const {
+  return FileRef();
+}
+
+}  // namespace pp
@@ -0,0 +1,31 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HOST_PPAPI_HOST_H
+#define HOST_PPAPI_HOST_H
+
+#include "ppapi/c/pp_stdint.h"
+
+namespace pp {
+class CompletionCallback;
+}
+
+namespace host {
+
+// Directory backing the fake HTML5 persistent file system. Must be set
+// before the plugin's FileSystem is created.
+void SetFileSystemRoot(const char* path);
+
+// Pepper never runs a required callback from inside the call that was
+// passed it. Posts |callback| with |result| and returns
+// PP_OK_COMPLETIONPENDING.
+int32_t PostCompletion(const pp::CompletionCallback& callback,
+                       int32_t result);
+
+// Maps an errno value to the closest PP_ERROR_* code.
+int32_t ErrnoToPPError(int err);
+
+}  // namespace host
+
+#endif  // HOST_PPAPI_HOST_H
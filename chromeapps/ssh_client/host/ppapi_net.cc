@@ -0,0 +1,874 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Host implementations of the private Pepper networking classes on top of
+// non-blocking host sockets. Every operation completes asynchronously on
+// the main loop, as in the browser.
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "ppapi/c/pp_errors.h"
+#include "ppapi/cpp/completion_callback.h"
+#include "ppapi/cpp/instance_handle.h"
+#include "ppapi/cpp/private/host_resolver_private.h"
+#include "ppapi/cpp/private/net_address_private.h"
+#include "ppapi/cpp/private/tcp_server_socket_private.h"
+#include "ppapi/cpp/private/tcp_socket_private.h"
+#include "ppapi/cpp/private/udp_socket_private.h"
+#include "ppapi/cpp/var.h"
+
+#include "main_loop.h"
+#include "ppapi_host.h"
+#include "resource_tracker.h"
+
+namespace host {
+
+namespace {
+
+// PP_NetAddress_Private is opaque to plugins; here it holds a sockaddr.
+bool ToNetAddress(const sockaddr* addr, socklen_t len,
+                  PP_NetAddress_Private* netaddr) {
+  if (len > sizeof(netaddr->data))
+    return false;
+  memset(netaddr, 0, sizeof(*netaddr));
+  netaddr->size = len;
+  memcpy(netaddr->data, addr, len);
+  return true;
+}
+
+const sockaddr* ToSockAddr(const PP_NetAddress_Private& netaddr) {
+  return reinterpret_cast<const sockaddr*>(netaddr.data);
+}
+
+int NewSocket(int family, int type) {
+  int fd = ::socket(family, type, 0);
+  if (fd >= 0) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  return fd;
+}
+
+// Moves a pending callback out so it can be posted exactly once.
+pp::CompletionCallback TakeCallback(pp::CompletionCallback* callback) {
+  pp::CompletionCallback result = *callback;
+  *callback = pp::CompletionCallback();
+  return result;
+}
+
+bool IsPending(const pp::CompletionCallback& callback) {
+  return callback.pp_completion_callback().func != NULL;
+}
+
+int32_t LastPPError() {
+  return (errno == EAGAIN || errno == EWOULDBLOCK) ?
+      PP_OK_COMPLETIONPENDING : ErrnoToPPError(errno);
+}
+
+//------------------------------------------------------------------------------
+
+class HostTCPSocket : public HostResource, public FdWatcher {
+ public:
+  explicit HostTCPSocket(int fd = -1)
+    : fd_(fd), next_addr_(0), read_buf_(NULL), read_size_(0),
+      write_buf_(NULL), write_size_(0) {}
+  virtual ~HostTCPSocket() { Disconnect(); }
+
+  int32_t Connect(const char* host, uint16_t port,
+                  const pp::CompletionCallback& callback) {
+    if (fd_ >= 0 || IsPending(connect_callback_))
+      return PP_ERROR_FAILED;
+    addrinfo hints = { };
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* ai;
+    char service[16];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &ai))
+      return PostCompletion(callback, PP_ERROR_FAILED);
+    for (addrinfo* it = ai; it; it = it->ai_next) {
+      PP_NetAddress_Private netaddr;
+      if (ToNetAddress(it->ai_addr, it->ai_addrlen, &netaddr))
+        addrs_.push_back(netaddr);
+    }
+    freeaddrinfo(ai);
+    connect_callback_ = callback;
+    ConnectNext();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  int32_t ConnectWithNetAddress(const PP_NetAddress_Private* addr,
+                                const pp::CompletionCallback& callback) {
+    if (fd_ >= 0 || IsPending(connect_callback_))
+      return PP_ERROR_FAILED;
+    addrs_.push_back(*addr);
+    connect_callback_ = callback;
+    ConnectNext();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  bool GetLocalAddress(PP_NetAddress_Private* addr) {
+    sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    return fd_ >= 0 && !getsockname(fd_, (sockaddr*)&ss, &len) &&
+        ToNetAddress((sockaddr*)&ss, len, addr);
+  }
+
+  bool GetRemoteAddress(PP_NetAddress_Private* addr) {
+    sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    return fd_ >= 0 && !getpeername(fd_, (sockaddr*)&ss, &len) &&
+        ToNetAddress((sockaddr*)&ss, len, addr);
+  }
+
+  int32_t Read(char* buffer, int32_t bytes_to_read,
+               const pp::CompletionCallback& callback) {
+    if (fd_ < 0 || IsPending(connect_callback_) || IsPending(read_callback_))
+      return PP_ERROR_FAILED;
+    read_buf_ = buffer;
+    read_size_ = bytes_to_read;
+    read_callback_ = callback;
+    TryRead();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  int32_t Write(const char* buffer, int32_t bytes_to_write,
+                const pp::CompletionCallback& callback) {
+    if (fd_ < 0 || IsPending(connect_callback_) || IsPending(write_callback_))
+      return PP_ERROR_FAILED;
+    write_buf_ = buffer;
+    write_size_ = bytes_to_write;
+    write_callback_ = callback;
+    TryWrite();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  void Disconnect() {
+    if (fd_ >= 0) {
+      MainLoop::Get()->Watch(fd_, 0, this);
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (IsPending(connect_callback_))
+      PostCompletion(TakeCallback(&connect_callback_), PP_ERROR_ABORTED);
+    if (IsPending(read_callback_))
+      PostCompletion(TakeCallback(&read_callback_), PP_ERROR_ABORTED);
+    if (IsPending(write_callback_))
+      PostCompletion(TakeCallback(&write_callback_), PP_ERROR_ABORTED);
+  }
+
+  virtual void OnFdReady(int fd, short revents) {
+    if (IsPending(connect_callback_)) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err) {
+        MainLoop::Get()->Watch(fd_, 0, this);
+        ::close(fd_);
+        fd_ = -1;
+        ConnectNext();
+      } else {
+        ConnectDone(PP_OK);
+      }
+      return;
+    }
+    if (IsPending(read_callback_) && (revents & ~POLLOUT))
+      TryRead();
+    if (IsPending(write_callback_) && (revents & ~POLLIN))
+      TryWrite();
+  }
+
+ private:
+  void ConnectNext() {
+    while (next_addr_ < addrs_.size()) {
+      const PP_NetAddress_Private& addr = addrs_[next_addr_++];
+      fd_ = NewSocket(ToSockAddr(addr)->sa_family, SOCK_STREAM);
+      if (fd_ < 0)
+        continue;
+      int one = 1;
+      setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (!::connect(fd_, ToSockAddr(addr), addr.size)) {
+        ConnectDone(PP_OK);
+        return;
+      }
+      if (errno == EINPROGRESS) {
+        MainLoop::Get()->Watch(fd_, POLLOUT, this);
+        return;
+      }
+      ::close(fd_);
+      fd_ = -1;
+    }
+    ConnectDone(PP_ERROR_FAILED);
+  }
+
+  void ConnectDone(int32_t result) {
+    addrs_.clear();
+    next_addr_ = 0;
+    UpdateWatch();
+    PostCompletion(TakeCallback(&connect_callback_), result);
+  }
+
+  void TryRead() {
+    ssize_t result = ::recv(fd_, read_buf_, read_size_, 0);
+    int32_t pp_result = result >= 0 ? int32_t(result) : LastPPError();
+    if (pp_result != PP_OK_COMPLETIONPENDING)
+      PostCompletion(TakeCallback(&read_callback_), pp_result);
+    UpdateWatch();
+  }
+
+  void TryWrite() {
+    ssize_t result = ::send(fd_, write_buf_, write_size_, MSG_NOSIGNAL);
+    int32_t pp_result = result >= 0 ? int32_t(result) : LastPPError();
+    if (pp_result != PP_OK_COMPLETIONPENDING)
+      PostCompletion(TakeCallback(&write_callback_), pp_result);
+    UpdateWatch();
+  }
+
+  void UpdateWatch() {
+    short events = 0;
+    if (IsPending(read_callback_))
+      events |= POLLIN;
+    if (IsPending(write_callback_))
+      events |= POLLOUT;
+    MainLoop::Get()->Watch(fd_, events, this);
+  }
+
+  int fd_;
+  std::vector<PP_NetAddress_Private> addrs_;
+  size_t next_addr_;
+  pp::CompletionCallback connect_callback_;
+  char* read_buf_;
+  int32_t read_size_;
+  pp::CompletionCallback read_callback_;
+  const char* write_buf_;
+  int32_t write_size_;
+  pp::CompletionCallback write_callback_;
+};
+
+//------------------------------------------------------------------------------
+
+class HostTCPServerSocket : public HostResource, public FdWatcher {
+ public:
+  HostTCPServerSocket() : fd_(-1), accepted_(NULL) {}
+  virtual ~HostTCPServerSocket() { StopListening(); }
+
+  int32_t Listen(const PP_NetAddress_Private* addr, int32_t backlog,
+                 const pp::CompletionCallback& callback) {
+    if (fd_ >= 0)
+      return PP_ERROR_FAILED;
+    fd_ = NewSocket(ToSockAddr(*addr)->sa_family, SOCK_STREAM);
+    if (fd_ < 0)
+      return PostCompletion(callback, ErrnoToPPError(errno));
+    int one = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd_, ToSockAddr(*addr), addr->size) ||
+        ::listen(fd_, backlog)) {
+      int32_t result = ErrnoToPPError(errno);
+      ::close(fd_);
+      fd_ = -1;
+      return PostCompletion(callback, result);
+    }
+    return PostCompletion(callback, PP_OK);
+  }
+
+  int32_t Accept(PP_Resource* socket,
+                 const pp::CompletionCallback& callback) {
+    if (fd_ < 0 || IsPending(accept_callback_))
+      return PP_ERROR_FAILED;
+    accepted_ = socket;
+    accept_callback_ = callback;
+    TryAccept();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  void StopListening() {
+    if (fd_ >= 0) {
+      MainLoop::Get()->Watch(fd_, 0, this);
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (IsPending(accept_callback_))
+      PostCompletion(TakeCallback(&accept_callback_), PP_ERROR_ABORTED);
+  }
+
+  virtual void OnFdReady(int fd, short revents) {
+    if (IsPending(accept_callback_))
+      TryAccept();
+  }
+
+ private:
+  void TryAccept() {
+    int fd = ::accept(fd_, NULL, NULL);
+    if (fd < 0 && LastPPError() == PP_OK_COMPLETIONPENDING) {
+      MainLoop::Get()->Watch(fd_, POLLIN, this);
+      return;
+    }
+    MainLoop::Get()->Watch(fd_, 0, this);
+    if (fd < 0) {
+      PostCompletion(TakeCallback(&accept_callback_), ErrnoToPPError(errno));
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    *accepted_ = ResourceTracker::Get()->Add(new HostTCPSocket(fd));
+    PostCompletion(TakeCallback(&accept_callback_), PP_OK);
+  }
+
+  int fd_;
+  PP_Resource* accepted_;
+  pp::CompletionCallback accept_callback_;
+};
+
+//------------------------------------------------------------------------------
+
+class HostUDPSocket : public HostResource, public FdWatcher {
+ public:
+  HostUDPSocket()
+    : fd_(-1), recv_buf_(NULL), recv_size_(0), send_buf_(NULL),
+      send_size_(0) {
+    memset(&recv_addr_, 0, sizeof(recv_addr_));
+    memset(&send_addr_, 0, sizeof(send_addr_));
+  }
+  virtual ~HostUDPSocket() { Close(); }
+
+  int32_t Bind(const PP_NetAddress_Private* addr,
+               const pp::CompletionCallback& callback) {
+    if (fd_ >= 0)
+      return PP_ERROR_FAILED;
+    fd_ = NewSocket(ToSockAddr(*addr)->sa_family, SOCK_DGRAM);
+    if (fd_ < 0)
+      return PostCompletion(callback, ErrnoToPPError(errno));
+    if (::bind(fd_, ToSockAddr(*addr), addr->size)) {
+      int32_t result = ErrnoToPPError(errno);
+      ::close(fd_);
+      fd_ = -1;
+      return PostCompletion(callback, result);
+    }
+    return PostCompletion(callback, PP_OK);
+  }
+
+  bool GetBoundAddress(PP_NetAddress_Private* addr) {
+    sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    return fd_ >= 0 && !getsockname(fd_, (sockaddr*)&ss, &len) &&
+        ToNetAddress((sockaddr*)&ss, len, addr);
+  }
+
+  int32_t RecvFrom(char* buffer, int32_t num_bytes,
+                   const pp::CompletionCallback& callback) {
+    if (fd_ < 0 || IsPending(recv_callback_))
+      return PP_ERROR_FAILED;
+    recv_buf_ = buffer;
+    recv_size_ = num_bytes;
+    recv_callback_ = callback;
+    TryRecv();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  bool GetRecvFromAddress(PP_NetAddress_Private* addr) {
+    if (!recv_addr_.size)
+      return false;
+    *addr = recv_addr_;
+    return true;
+  }
+
+  int32_t SendTo(const char* buffer, int32_t num_bytes,
+                 const PP_NetAddress_Private* addr,
+                 const pp::CompletionCallback& callback) {
+    if (fd_ < 0 || IsPending(send_callback_))
+      return PP_ERROR_FAILED;
+    send_buf_ = buffer;
+    send_size_ = num_bytes;
+    send_addr_ = *addr;
+    send_callback_ = callback;
+    TrySend();
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      MainLoop::Get()->Watch(fd_, 0, this);
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (IsPending(recv_callback_))
+      PostCompletion(TakeCallback(&recv_callback_), PP_ERROR_ABORTED);
+    if (IsPending(send_callback_))
+      PostCompletion(TakeCallback(&send_callback_), PP_ERROR_ABORTED);
+  }
+
+  virtual void OnFdReady(int fd, short revents) {
+    if (IsPending(recv_callback_) && (revents & ~POLLOUT))
+      TryRecv();
+    if (IsPending(send_callback_) && (revents & ~POLLIN))
+      TrySend();
+  }
+
+ private:
+  void TryRecv() {
+    sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    ssize_t result = ::recvfrom(fd_, recv_buf_, recv_size_, 0,
+                                (sockaddr*)&ss, &len);
+    int32_t pp_result = result >= 0 ? int32_t(result) : LastPPError();
+    if (pp_result != PP_OK_COMPLETIONPENDING) {
+      if (result >= 0)
+        ToNetAddress((sockaddr*)&ss, len, &recv_addr_);
+      PostCompletion(TakeCallback(&recv_callback_), pp_result);
+    }
+    UpdateWatch();
+  }
+
+  void TrySend() {
+    ssize_t result = ::sendto(fd_, send_buf_, send_size_, 0,
+                              ToSockAddr(send_addr_), send_addr_.size);
+    int32_t pp_result = result >= 0 ? int32_t(result) : LastPPError();
+    if (pp_result != PP_OK_COMPLETIONPENDING)
+      PostCompletion(TakeCallback(&send_callback_), pp_result);
+    UpdateWatch();
+  }
+
+  void UpdateWatch() {
+    short events = 0;
+    if (IsPending(recv_callback_))
+      events |= POLLIN;
+    if (IsPending(send_callback_))
+      events |= POLLOUT;
+    MainLoop::Get()->Watch(fd_, events, this);
+  }
+
+  int fd_;
+  char* recv_buf_;
+  int32_t recv_size_;
+  PP_NetAddress_Private recv_addr_;
+  pp::CompletionCallback recv_callback_;
+  const char* send_buf_;
+  int32_t send_size_;
+  PP_NetAddress_Private send_addr_;
+  pp::CompletionCallback send_callback_;
+};
+
+//------------------------------------------------------------------------------
+
+class HostResolver : public HostResource {
+ public:
+  int32_t Resolve(const std::string& host, uint16_t port,
+                  const PP_HostResolver_Private_Hint& hint,
+                  const pp::CompletionCallback& callback) {
+    addrs_.clear();
+    canonical_name_.clear();
+
+    addrinfo hints = { };
+    hints.ai_socktype = SOCK_STREAM;
+    if (hint.family == PP_NETADDRESSFAMILY_IPV4)
+      hints.ai_family = AF_INET;
+    else if (hint.family == PP_NETADDRESSFAMILY_IPV6)
+      hints.ai_family = AF_INET6;
+    if (hint.flags & PP_HOST_RESOLVER_FLAGS_CANONNAME)
+      hints.ai_flags |= AI_CANONNAME;
+    char service[16];
+    snprintf(service, sizeof(service), "%u", port);
+
+    addrinfo* ai;
+    if (getaddrinfo(host.c_str(), service, &hints, &ai))
+      return PostCompletion(callback, PP_ERROR_FAILED);
+    if (ai->ai_canonname)
+      canonical_name_ = ai->ai_canonname;
+    for (addrinfo* it = ai; it; it = it->ai_next) {
+      PP_NetAddress_Private netaddr;
+      if (ToNetAddress(it->ai_addr, it->ai_addrlen, &netaddr))
+        addrs_.push_back(netaddr);
+    }
+    freeaddrinfo(ai);
+    return PostCompletion(callback, PP_OK);
+  }
+
+  const std::string& canonical_name() const { return canonical_name_; }
+  const std::vector<PP_NetAddress_Private>& addrs() const { return addrs_; }
+
+ private:
+  std::string canonical_name_;
+  std::vector<PP_NetAddress_Private> addrs_;
+};
+
+}  // namespace
+
+}  // namespace host
+
+using host::HostResolver;
+using host::HostTCPServerSocket;
+using host::HostTCPSocket;
+using host::HostUDPSocket;
+using host::ResourceTracker;
+using host::ToNetAddress;
+using host::ToSockAddr;
+
+namespace pp {
+
+// static
+bool NetAddressPrivate::IsAvailable() {
+  return true;
+}
+
+// static
+bool NetAddressPrivate::AreEqual(const PP_NetAddress_Private& addr1,
+                                 const PP_NetAddress_Private& addr2) {
+  return addr1.size == addr2.size &&
+      !memcmp(addr1.data, addr2.data, addr1.size);
+}
+
+// static
+bool NetAddressPrivate::AreHostsEqual(const PP_NetAddress_Private& addr1,
+                                      const PP_NetAddress_Private& addr2) {
+  uint8_t ip1[16], ip2[16];
+  return GetFamily(addr1) == GetFamily(addr2) &&
+      GetAddress(addr1, ip1, sizeof(ip1)) &&
+      GetAddress(addr2, ip2, sizeof(ip2)) &&
+      !memcmp(ip1, ip2, GetFamily(addr1) == PP_NETADDRESSFAMILY_IPV4 ? 4 : 16);
+}
+
+// static
+std::string NetAddressPrivate::Describe(const PP_NetAddress_Private& addr,
+                                        bool include_port) {
+  char buf[INET6_ADDRSTRLEN];
+  const sockaddr* saddr = ToSockAddr(addr);
+  std::string result;
+  if (saddr->sa_family == AF_INET) {
+    inet_ntop(AF_INET, &((const sockaddr_in*)saddr)->sin_addr,
+              buf, sizeof(buf));
+    result = buf;
+  } else if (saddr->sa_family == AF_INET6) {
+    inet_ntop(AF_INET6, &((const sockaddr_in6*)saddr)->sin6_addr,
+              buf, sizeof(buf));
+    result = include_port ? std::string("[") + buf + "]" : buf;
+  } else {
+    return std::string();
+  }
+  if (include_port) {
+    snprintf(buf, sizeof(buf), ":%u", GetPort(addr));
+    result += buf;
+  }
+  return result;
+}
+
+// static
+bool NetAddressPrivate::ReplacePort(const PP_NetAddress_Private& addr_in,
+                                    uint16_t port,
+                                    PP_NetAddress_Private* addr_out) {
+  *addr_out = addr_in;
+  sockaddr* saddr = reinterpret_cast<sockaddr*>(addr_out->data);
+  if (saddr->sa_family == AF_INET)
+    ((sockaddr_in*)saddr)->sin_port = htons(port);
+  else if (saddr->sa_family == AF_INET6)
+    ((sockaddr_in6*)saddr)->sin6_port = htons(port);
+  else
+    return false;
+  return true;
+}
+
+// static
+bool NetAddressPrivate::GetAnyAddress(bool is_ipv6,
+                                      PP_NetAddress_Private* addr) {
+  if (is_ipv6) {
+    sockaddr_in6 sin6 = { };
+    sin6.sin6_family = AF_INET6;
+    sin6.sin6_addr = in6addr_any;
+    return ToNetAddress((sockaddr*)&sin6, sizeof(sin6), addr);
+  }
+  sockaddr_in sin4 = { };
+  sin4.sin_family = AF_INET;
+  sin4.sin_addr.s_addr = htonl(INADDR_ANY);
+  return ToNetAddress((sockaddr*)&sin4, sizeof(sin4), addr);
+}
+
+// static
+PP_NetAddressFamily_Private NetAddressPrivate::GetFamily(
+    const PP_NetAddress_Private& addr) {
+  if (!addr.size)
+    return PP_NETADDRESSFAMILY_UNSPECIFIED;
+  switch (ToSockAddr(addr)->sa_family) {
+    case AF_INET:
+      return PP_NETADDRESSFAMILY_IPV4;
+    case AF_INET6:
+      return PP_NETADDRESSFAMILY_IPV6;
+    default:
+      return PP_NETADDRESSFAMILY_UNSPECIFIED;
+  }
+}
+
+// static
+uint16_t NetAddressPrivate::GetPort(const PP_NetAddress_Private& addr) {
+  const sockaddr* saddr = ToSockAddr(addr);
+  if (saddr->sa_family == AF_INET)
+    return ntohs(((const sockaddr_in*)saddr)->sin_port);
+  if (saddr->sa_family == AF_INET6)
+    return ntohs(((const sockaddr_in6*)saddr)->sin6_port);
+  return 0;
+}
+
+// static
+bool NetAddressPrivate::GetAddress(const PP_NetAddress_Private& addr,
+                                   void* address,
+                                   uint16_t address_size) {
+  const sockaddr* saddr = ToSockAddr(addr);
+  if (saddr->sa_family == AF_INET && address_size >= 4) {
+    memcpy(address, &((const sockaddr_in*)saddr)->sin_addr, 4);
+    return true;
+  }
+  if (saddr->sa_family == AF_INET6 && address_size >= 16) {
+    memcpy(address, &((const sockaddr_in6*)saddr)->sin6_addr, 16);
+    return true;
+  }
+  return false;
+}
+
+// static
+uint32_t NetAddressPrivate::GetScopeID(const PP_NetAddress_Private& addr) {
+  const sockaddr* saddr = ToSockAddr(addr);
+  if (saddr->sa_family == AF_INET6)
+    return ((const sockaddr_in6*)saddr)->sin6_scope_id;
+  return 0;
+}
+
+// static
+bool NetAddressPrivate::CreateFromIPv4Address(
+    const uint8_t ip[4], uint16_t port,
+    struct PP_NetAddress_Private* addr_out) {
+  sockaddr_in sin4 = { };
+  sin4.sin_family = AF_INET;
+  sin4.sin_port = htons(port);
+  memcpy(&sin4.sin_addr, ip, 4);
+  return ToNetAddress((sockaddr*)&sin4, sizeof(sin4), addr_out);
+}
+
+// static
+bool NetAddressPrivate::CreateFromIPv6Address(
+    const uint8_t ip[16], uint32_t scope_id, uint16_t port,
+    struct PP_NetAddress_Private* addr_out) {
+  sockaddr_in6 sin6 = { };
+  sin6.sin6_family = AF_INET6;
+  sin6.sin6_port = htons(port);
+  sin6.sin6_scope_id = scope_id;
+  memcpy(&sin6.sin6_addr, ip, 16);
+  return ToNetAddress((sockaddr*)&sin6, sizeof(sin6), addr_out);
+}
+
+//------------------------------------------------------------------------------
+
+HostResolverPrivate::HostResolverPrivate(const InstanceHandle& instance) {
+  PassRefFromConstructor(ResourceTracker::Get()->Add(new HostResolver()));
+}
+
+// static
+bool HostResolverPrivate::IsAvailable() {
+  return true;
+}
+
+int32_t HostResolverPrivate::Resolve(const std::string& host, uint16_t port,
+                                     const PP_HostResolver_Private_Hint& hint,
+                                     const CompletionCallback& callback) {
+  HostResolver* resolver =
+      ResourceTracker::Get()->GetAs<HostResolver>(pp_resource());
+  if (!resolver)
+    return PP_ERROR_BADRESOURCE;
+  return resolver->Resolve(host, port, hint, callback);
+}
+
+Var HostResolverPrivate::GetCanonicalName() {
+  HostResolver* resolver =
+      ResourceTracker::Get()->GetAs<HostResolver>(pp_resource());
+  return resolver ? Var(resolver->canonical_name()) : Var();
+}
+
+uint32_t HostResolverPrivate::GetSize() {
+  HostResolver* resolver =
+      ResourceTracker::Get()->GetAs<HostResolver>(pp_resource());
+  return resolver ? resolver->addrs().size() : 0;
+}
+
+bool HostResolverPrivate::GetNetAddress(uint32_t index,
+                                        PP_NetAddress_Private* address) {
+  HostResolver* resolver =
+      ResourceTracker::Get()->GetAs<HostResolver>(pp_resource());
+  if (!resolver || index >= resolver->addrs().size())
+    return false;
+  *address = resolver->addrs()[index];
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+TCPSocketPrivate::TCPSocketPrivate(const InstanceHandle& instance) {
+  PassRefFromConstructor(ResourceTracker::Get()->Add(new HostTCPSocket()));
+}
+
+TCPSocketPrivate::TCPSocketPrivate(PassRef, PP_Resource resource)
+    : Resource(PASS_REF, resource) {
+}
+
+// static
+bool TCPSocketPrivate::IsAvailable() {
+  return true;
+}
+
+int32_t TCPSocketPrivate::Connect(const char* host, uint16_t port,
+                                  const CompletionCallback& callback) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket ? socket->Connect(host, port, callback) : PP_ERROR_BADRESOURCE;
+}
+
+int32_t TCPSocketPrivate::ConnectWithNetAddress(
+    const PP_NetAddress_Private* addr, const CompletionCallback& callback) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket ?
+      socket->ConnectWithNetAddress(addr, callback) : PP_ERROR_BADRESOURCE;
+}
+
+bool TCPSocketPrivate::GetLocalAddress(PP_NetAddress_Private* local_addr) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket && socket->GetLocalAddress(local_addr);
+}
+
+bool TCPSocketPrivate::GetRemoteAddress(PP_NetAddress_Private* remote_addr) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket && socket->GetRemoteAddress(remote_addr);
+}
+
+int32_t TCPSocketPrivate::SSLHandshake(const char* server_name,
+                                       uint16_t server_port,
+                                       const CompletionCallback& callback) {
+  return PP_ERROR_NOTSUPPORTED;
+}
+
+int32_t TCPSocketPrivate::Read(char* buffer, int32_t bytes_to_read,
+                               const CompletionCallback& callback) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket ?
+      socket->Read(buffer, bytes_to_read, callback) : PP_ERROR_BADRESOURCE;
+}
+
+int32_t TCPSocketPrivate::Write(const char* buffer, int32_t bytes_to_write,
+                                const CompletionCallback& callback) {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  return socket ?
+      socket->Write(buffer, bytes_to_write, callback) : PP_ERROR_BADRESOURCE;
+}
+
+void TCPSocketPrivate::Disconnect() {
+  HostTCPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPSocket>(pp_resource());
+  if (socket)
+    socket->Disconnect();
+}
+
+//------------------------------------------------------------------------------
+
+TCPServerSocketPrivate::TCPServerSocketPrivate(
+    const InstanceHandle& instance) {
+  PassRefFromConstructor(
+      ResourceTracker::Get()->Add(new HostTCPServerSocket()));
+}
+
+// static
+bool TCPServerSocketPrivate::IsAvailable() {
+  return true;
+}
+
+int32_t TCPServerSocketPrivate::Listen(const PP_NetAddress_Private* addr,
+                                       int32_t backlog,
+                                       const CompletionCallback& callback) {
+  HostTCPServerSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPServerSocket>(pp_resource());
+  return socket ?
+      socket->Listen(addr, backlog, callback) : PP_ERROR_BADRESOURCE;
+}
+
+int32_t TCPServerSocketPrivate::Accept(PP_Resource* socket,
+                                       const CompletionCallback& callback) {
+  HostTCPServerSocket* server =
+      ResourceTracker::Get()->GetAs<HostTCPServerSocket>(pp_resource());
+  return server ? server->Accept(socket, callback) : PP_ERROR_BADRESOURCE;
+}
+
+void TCPServerSocketPrivate::StopListening() {
+  HostTCPServerSocket* socket =
+      ResourceTracker::Get()->GetAs<HostTCPServerSocket>(pp_resource());
+  if (socket)
+    socket->StopListening();
+}
+
+//------------------------------------------------------------------------------
+
+UDPSocketPrivate::UDPSocketPrivate(const InstanceHandle& instance) {
+  PassRefFromConstructor(ResourceTracker::Get()->Add(new HostUDPSocket()));
+}
+
+// static
+bool UDPSocketPrivate::IsAvailable() {
+  return true;
+}
+
+int32_t UDPSocketPrivate::Bind(const PP_NetAddress_Private* addr,
+                               const CompletionCallback& callback) {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  return socket ? socket->Bind(addr, callback) : PP_ERROR_BADRESOURCE;
+}
+
+bool UDPSocketPrivate::GetBoundAddress(PP_NetAddress_Private* addr) {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  return socket && socket->GetBoundAddress(addr);
+}
+
+int32_t UDPSocketPrivate::RecvFrom(char* buffer, int32_t num_bytes,
+                                   const CompletionCallback& callback) {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  return socket ?
+      socket->RecvFrom(buffer, num_bytes, callback) : PP_ERROR_BADRESOURCE;
+}
+
+bool UDPSocketPrivate::GetRecvFromAddress(PP_NetAddress_Private* addr) {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  return socket && socket->GetRecvFromAddress(addr);
+}
+
+int32_t UDPSocketPrivate::SendTo(const char* buffer, int32_t num_bytes,
+                                 const PP_NetAddress_Private* addr,
+                                 const CompletionCallback& callback) {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  return socket ?
+      socket->SendTo(buffer, num_bytes, addr, callback) : PP_ERROR_BADRESOURCE;
+}
+
+void UDPSocketPrivate::Close() {
+  HostUDPSocket* socket =
+      ResourceTracker::Get()->GetAs<HostUDPSocket>(pp_resource());
+  if (socket)
+    socket->Close();
+}
+
+}  // namespace pp
@@ -0,0 +1,64 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HOST_RESOURCE_TRACKER_H
+#define HOST_RESOURCE_TRACKER_H
+
+#include <map>
+
+#include "ppapi/c/pp_resource.h"
+
+#include "pthread_helpers.h"
+
+namespace host {
+
+// Object behind a PP_Resource. Destroyed when the last pp::Resource
+// referring to it goes away.
+class HostResource {
+ public:
+  HostResource() {}
+  virtual ~HostResource() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HostResource);
+};
+
+class ResourceTracker {
+ public:
+  static ResourceTracker* Get();
+
+  // Takes ownership of |object| and returns its resource with one
+  // reference.
+  PP_Resource Add(HostResource* object);
+  void AddRef(PP_Resource resource);
+  void Release(PP_Resource resource);
+
+  // Returns NULL if |resource| is unknown or of another type.
+  template <class T>
+  T* GetAs(PP_Resource resource) {
+    Mutex::Lock lock(mutex_);
+    ResourceMap::iterator it = resources_.find(resource);
+    return it != resources_.end() ?
+        dynamic_cast<T*>(it->second.object) : NULL;
+  }
+
+ private:
+  struct Entry {
+    HostResource* object;
+    int ref;
+  };
+  typedef std::map<PP_Resource, Entry> ResourceMap;
+
+  ResourceTracker();
+
+  Mutex mutex_;
+  ResourceMap resources_;
+  PP_Resource next_resource_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResourceTracker);
+};
+
+}  // namespace host
+
+#endif  // HOST_RESOURCE_TRACKER_H
@@ -0,0 +1,48 @@
+#ifndef MOSH_NACL_BYTEORDER_H_
+#define MOSH_NACL_BYTEORDER_H_
+
+/* Byte-order helpers for mosh on NaCl. mosh's src/crypto/byteorder.h
+ * includes this instead of <endian.h>: glibc's bswap64 is broken on x86-64
+ * NaCl, and mosh's own fallback assembles every value a byte at a time.
+ * The compiler builtins become a single bswap on both x86 targets. */
+
+#include <stdint.h>
+
+#if !defined(__i386__) && !defined(__x86_64__) && !defined(__arm__)
+#error "NaCl byte order helpers assume a little-endian target"
+#endif
+
+/* Make sure they aren't macros */
+#undef htobe64
+#undef be64toh
+#undef htobe32
+#undef be32toh
+#undef htobe16
+#undef be16toh
+
+static inline uint64_t htobe64( uint64_t x ) {
+  return __builtin_bswap64( x );
+}
+
+static inline uint64_t be64toh( uint64_t x ) {
+  return __builtin_bswap64( x );
+}
+
+static inline uint32_t htobe32( uint32_t x ) {
+  return __builtin_bswap32( x );
+}
+
+static inline uint32_t be32toh( uint32_t x ) {
+  return __builtin_bswap32( x );
+}
+
+/* There is no __builtin_bswap16 before GCC 4.8; this compiles to a rotate. */
+static inline uint16_t htobe16( uint16_t x ) {
+  return (uint16_t)( ( x << 8 ) | ( x >> 8 ) );
+}
+
+static inline uint16_t be16toh( uint16_t x ) {
+  return (uint16_t)( ( x << 8 ) | ( x >> 8 ) );
+}
+
+#endif  /* MOSH_NACL_BYTEORDER_H_ */
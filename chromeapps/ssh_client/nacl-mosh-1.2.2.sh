@@ -25,9 +25,11 @@ export CPPFLAGS="-I$PWD/../include"
 export LDFLAGS="-L$PWD/lib${NACL_PACKAGES_BITSIZE}"
 [ -d "lib${NACL_PACKAGES_BITSIZE}" ] || mkdir "lib${NACL_PACKAGES_BITSIZE}"
 
-# Build a fake libtinfo.
-"${NACLCC}" $CPPFLAGS -c "$PWD/../src/tinfo.c" \
-    -o "lib${NACL_PACKAGES_BITSIZE}/tinfo.o"
+# Build a fake libtinfo, with the terminfo entry compiled in.
+python "$PWD/../gen_tinfo.py" "$PWD/../src/xterm-256color.ti" \
+    > "lib${NACL_PACKAGES_BITSIZE}/tinfo_table.h" || exit 1
+"${NACLCC}" $CPPFLAGS -I"lib${NACL_PACKAGES_BITSIZE}" -O2 \
+    -c "$PWD/../src/tinfo.c" -o "lib${NACL_PACKAGES_BITSIZE}/tinfo.o" || exit 1
 "${NACLAR}" rcs "lib${NACL_PACKAGES_BITSIZE}/libtinfo.a" \
     "lib${NACL_PACKAGES_BITSIZE}/tinfo.o"
 
@@ -0,0 +1,68 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "byte_queue.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const size_t kMinCapacity = 4096;
+
+ByteQueue::ByteQueue()
+  : buf_(NULL), capacity_(0), head_(0), size_(0) {
+}
+
+ByteQueue::~ByteQueue() {
+  delete[] buf_;
+}
+
+void ByteQueue::Append(const char* data, size_t count) {
+  if (size_ + count > capacity_)
+    Grow(size_ + count);
+
+  size_t tail = (head_ + size_) & (capacity_ - 1);
+  size_t first = std::min(count, capacity_ - tail);
+  memcpy(buf_ + tail, data, first);
+  memcpy(buf_, data + first, count - first);
+  size_ += count;
+}
+
+size_t ByteQueue::Read(char* buf, size_t count) {
+  count = std::min(count, size_);
+  size_t first = std::min(count, capacity_ - head_);
+  memcpy(buf, buf_ + head_, first);
+  memcpy(buf + first, buf_, count - first);
+  Consume(count);
+  return count;
+}
+
+const char* ByteQueue::Peek(size_t* count) const {
+  *count = std::min(size_, capacity_ - head_);
+  return buf_ + head_;
+}
+
+void ByteQueue::Consume(size_t count) {
+  assert(count <= size_);
+  size_ -= count;
+  // Start over at the beginning when empty, so the next Peek is as long
+  // as possible.
+  head_ = size_ ? (head_ + count) & (capacity_ - 1) : 0;
+}
+
+void ByteQueue::Grow(size_t min_capacity) {
+  size_t capacity = std::max(capacity_, kMinCapacity);
+  while (capacity < min_capacity)
+    capacity *= 2;
+
+  char* buf = new char[capacity];
+  size_t first = std::min(size_, capacity_ - head_);
+  memcpy(buf, buf_ + head_, first);
+  memcpy(buf + first, buf_, size_ - first);
+  delete[] buf_;
+  buf_ = buf;
+  capacity_ = capacity;
+  head_ = 0;
+}
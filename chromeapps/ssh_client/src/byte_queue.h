@@ -0,0 +1,50 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BYTE_QUEUE_H
+#define BYTE_QUEUE_H
+
+#include <stddef.h>
+
+#include "pthread_helpers.h"
+
+// A FIFO of bytes stored in a growable ring buffer. Data goes in and out
+// with memcpy, and the front of the queue can be handed out as a
+// contiguous span without copying.
+class ByteQueue {
+ public:
+  ByteQueue();
+  ~ByteQueue();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Appends |count| bytes to the back of the queue.
+  void Append(const char* data, size_t count);
+
+  // Copies up to |count| bytes from the front of the queue into |buf| and
+  // removes them. Returns the number of bytes copied.
+  size_t Read(char* buf, size_t count);
+
+  // Returns the longest contiguous span at the front of the queue and
+  // stores its length in |count|. If the data wraps around the end of the
+  // buffer, the rest follows in the next span once this one is consumed.
+  const char* Peek(size_t* count) const;
+
+  // Removes |count| bytes from the front of the queue.
+  void Consume(size_t count);
+
+ private:
+  void Grow(size_t min_capacity);
+
+  char* buf_;
+  // Always zero or a power of two.
+  size_t capacity_;
+  size_t head_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ByteQueue);
+};
+
+#endif  // BYTE_QUEUE_H
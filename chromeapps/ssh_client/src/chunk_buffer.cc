@@ -0,0 +1,128 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chunk_buffer.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const size_t kSegmentSize = 16 * 1024;
+
+Segment::Segment(size_t capacity)
+  : ref_(1), data_(new char[capacity]), capacity_(capacity), used_(0) {
+}
+
+Segment::~Segment() {
+  assert(!ref_);
+  delete[] data_;
+}
+
+void Segment::addref() {
+  __sync_add_and_fetch(&ref_, 1);
+}
+
+void Segment::release() {
+  if (!__sync_sub_and_fetch(&ref_, 1))
+    delete this;
+}
+
+void Segment::Commit(size_t count) {
+  assert(count <= available());
+  used_ += count;
+}
+
+//------------------------------------------------------------------------------
+
+ChunkBuffer::ChunkBuffer() : size_(0) {
+}
+
+ChunkBuffer::~ChunkBuffer() {
+  Consume(size_);
+}
+
+void ChunkBuffer::Append(const char* data, size_t count) {
+  while (count) {
+    // Extend the last slice in place if nothing was written to its
+    // segment after it.
+    if (!slices_.empty()) {
+      Slice& last = slices_.back();
+      if (last.end == last.segment->used() && last.segment->available()) {
+        size_t n = std::min(count, last.segment->available());
+        memcpy(last.segment->tail(), data, n);
+        last.segment->Commit(n);
+        last.end += n;
+        size_ += n;
+        data += n;
+        count -= n;
+        continue;
+      }
+    }
+
+    Segment* segment = new Segment(std::max(count, kSegmentSize));
+    memcpy(segment->tail(), data, count);
+    segment->Commit(count);
+    Append(segment, 0, count);
+    segment->release();
+    return;
+  }
+}
+
+void ChunkBuffer::Append(Segment* segment, size_t begin, size_t end) {
+  assert(begin <= end && end <= segment->used());
+  if (begin == end)
+    return;
+
+  size_ += end - begin;
+  if (!slices_.empty()) {
+    Slice& last = slices_.back();
+    if (last.segment == segment && last.end == begin) {
+      last.end = end;
+      return;
+    }
+  }
+
+  Slice slice = { segment, begin, end };
+  segment->addref();
+  slices_.push_back(slice);
+}
+
+size_t ChunkBuffer::Read(char* buf, size_t count) {
+  size_t nread = 0;
+  while (nread < count && !empty()) {
+    size_t span;
+    const char* data = Peek(&span);
+    span = std::min(span, count - nread);
+    memcpy(buf + nread, data, span);
+    Consume(span);
+    nread += span;
+  }
+  return nread;
+}
+
+const char* ChunkBuffer::Peek(size_t* count) const {
+  if (slices_.empty()) {
+    *count = 0;
+    return NULL;
+  }
+  const Slice& first = slices_.front();
+  *count = first.end - first.begin;
+  return first.segment->data() + first.begin;
+}
+
+void ChunkBuffer::Consume(size_t count) {
+  assert(count <= size_);
+  size_ -= count;
+  while (count) {
+    Slice& first = slices_.front();
+    size_t n = std::min(count, first.end - first.begin);
+    first.begin += n;
+    count -= n;
+    if (first.begin == first.end) {
+      first.segment->release();
+      slices_.pop_front();
+    }
+  }
+}
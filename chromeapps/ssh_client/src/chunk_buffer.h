@@ -0,0 +1,84 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHUNK_BUFFER_H
+#define CHUNK_BUFFER_H
+
+#include <stddef.h>
+
+#include <deque>
+
+#include "pthread_helpers.h"
+
+// A reference-counted block of memory that is filled front to back.
+// Several ChunkBuffers (and a pending Pepper read) may refer to
+// different parts of the same segment.
+class Segment {
+ public:
+  explicit Segment(size_t capacity);
+
+  void addref();
+  void release();
+
+  char* data() { return data_; }
+  // Bytes handed out so far; everything after is free.
+  size_t used() const { return used_; }
+  size_t available() const { return capacity_ - used_; }
+  char* tail() { return data_ + used_; }
+  // Marks |count| bytes after used() as filled.
+  void Commit(size_t count);
+
+ private:
+  ~Segment();
+
+  int ref_;
+  char* data_;
+  size_t capacity_;
+  size_t used_;
+
+  DISALLOW_COPY_AND_ASSIGN(Segment);
+};
+
+// A FIFO of bytes kept as a chain of slices of Segments. Appending a
+// slice of an already-filled segment and consuming from the front never
+// move the remaining data.
+class ChunkBuffer {
+ public:
+  ChunkBuffer();
+  ~ChunkBuffer();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Copies |count| bytes to the back, filling the last segment first.
+  void Append(const char* data, size_t count);
+
+  // Appends bytes [begin, end) of |segment| without copying them.
+  void Append(Segment* segment, size_t begin, size_t end);
+
+  // Copies up to |count| bytes from the front into |buf| and consumes
+  // them. Returns the number of bytes copied.
+  size_t Read(char* buf, size_t count);
+
+  // Returns the first contiguous span and stores its length in |count|.
+  // The span stays valid until it is consumed.
+  const char* Peek(size_t* count) const;
+
+  // Removes |count| bytes from the front.
+  void Consume(size_t count);
+
+ private:
+  struct Slice {
+    Segment* segment;
+    size_t begin;
+    size_t end;
+  };
+
+  std::deque<Slice> slices_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkBuffer);
+};
+
+#endif  // CHUNK_BUFFER_H
@@ -45,12 +45,15 @@ DevNull::~DevNull() {
 }
 
 void DevNull::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void DevNull::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
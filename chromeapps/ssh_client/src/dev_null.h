@@ -33,6 +33,10 @@ class DevNull : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kDevNull;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
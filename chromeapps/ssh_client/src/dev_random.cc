@@ -50,12 +50,15 @@ DevRandom::~DevRandom() {
 }
 
 void DevRandom::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void DevRandom::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -36,6 +36,10 @@ class DevRandom : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kDevRandom;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
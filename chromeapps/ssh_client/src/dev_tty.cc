@@ -54,12 +54,15 @@ DevTty::~DevTty() {
 }
 
 void DevTty::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void DevTty::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -68,11 +71,36 @@ void DevTty::close() {
   fd_ = 0;
 }
 
+void DevTty::AddWaiter(StreamWaiter* waiter, int tag) {
+  {
+    Mutex::Lock lock(stdin_->mutex());
+    stdin_->AddWaiter(waiter, tag);
+  }
+  Mutex::Lock lock(stdout_->mutex());
+  stdout_->AddWaiter(waiter, tag);
+}
+
+void DevTty::RemoveWaiter(StreamWaiter* waiter, int tag) {
+  {
+    Mutex::Lock lock(stdin_->mutex());
+    stdin_->RemoveWaiter(waiter, tag);
+  }
+  Mutex::Lock lock(stdout_->mutex());
+  stdout_->RemoveWaiter(waiter, tag);
+}
+
+// Reads and writes can block in stdin or stdout. FileSystem calls them
+// with our own lock held; drop it meanwhile so other calls on /dev/tty
+// aren't stuck behind them. None of our state is touched here.
 int DevTty::read(char* buf, size_t count, size_t* nread) {
+  Mutex::Unlock unlock(mutex());
+  Mutex::Lock lock(stdin_->mutex());
   return stdin_->read(buf, count, nread);
 }
 
 int DevTty::write(const char* buf, size_t count, size_t* nwrote) {
+  Mutex::Unlock unlock(mutex());
+  Mutex::Lock lock(stdout_->mutex());
   return stdout_->write(buf, count, nwrote);
 }
 
@@ -81,10 +109,12 @@ int DevTty::isatty() {
 }
 
 int DevTty::tcgetattr(termios* termios_p) {
+  Mutex::Lock lock(stdin_->mutex());
   return stdin_->tcgetattr(termios_p);
 }
 
 int DevTty::tcsetattr(int optional_actions, const termios* termios_p) {
+  Mutex::Lock lock(stdin_->mutex());
   return stdin_->tcsetattr(optional_actions, termios_p);
 }
 
@@ -101,9 +131,11 @@ int DevTty::fcntl(int cmd, va_list ap) {
 }
 
 bool DevTty::is_read_ready() {
+  Mutex::Lock lock(stdin_->mutex());
   return stdin_->is_read_ready();
 }
 
 bool DevTty::is_write_ready() {
+  Mutex::Lock lock(stdout_->mutex());
   return stdout_->is_write_ready();
 }
@@ -35,6 +35,15 @@ class DevTty : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kDevTty;
+  }
+
+  // /dev/tty has no state of its own; select() on it waits on the
+  // underlying stdin and stdout streams.
+  virtual void AddWaiter(StreamWaiter* waiter, int tag);
+  virtual void RemoveWaiter(StreamWaiter* waiter, int tag);
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
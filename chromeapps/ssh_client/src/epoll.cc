@@ -0,0 +1,237 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "epoll.h"
+
+#include <assert.h>
+#include <errno.h>
+
+#include <algorithm>
+
+EpollStream::EpollStream(int fd)
+  : ref_(1), fd_(fd) {
+}
+
+EpollStream::~EpollStream() {
+  assert(!ref_);
+  assert(fd_to_registration_.empty());
+}
+
+void EpollStream::addref() {
+  __sync_add_and_fetch(&ref_, 1);
+}
+
+void EpollStream::release() {
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
+    delete this;
+  }
+}
+
+void EpollStream::close() {
+  while (!fd_to_registration_.empty())
+    Unregister(fd_to_registration_.begin()->second);
+  fd_ = 0;
+}
+
+int EpollStream::read(char* buf, size_t count, size_t* nread) {
+  return EINVAL;
+}
+
+int EpollStream::write(const char* buf, size_t count, size_t* nwrote) {
+  return EINVAL;
+}
+
+bool EpollStream::is_read_ready() {
+  return false;
+}
+
+bool EpollStream::is_write_ready() {
+  return false;
+}
+
+int EpollStream::Control(int op, int fd, FileStream* stream,
+                         const epoll_event* event) {
+  std::map<int, int>::iterator it = fd_to_registration_.find(fd);
+  switch (op) {
+    case EPOLL_CTL_ADD: {
+      if (it != fd_to_registration_.end())
+        return EEXIST;
+      if (!event)
+        return EFAULT;
+
+      int index;
+      if (!free_registrations_.empty()) {
+        index = free_registrations_.back();
+        free_registrations_.pop_back();
+      } else {
+        index = registrations_.size();
+        registrations_.push_back(Registration());
+      }
+
+      Registration& reg = registrations_[index];
+      reg.fd = fd;
+      reg.stream = stream;
+      reg.events = event->events;
+      reg.data = event->data;
+      reg.in_use = true;
+      reg.enabled = true;
+      reg.queued = false;
+      stream->addref();
+      {
+        Mutex::Lock lock(stream->mutex());
+        stream->AddWaiter(&waiter_, index);
+      }
+      fd_to_registration_[fd] = index;
+      // The stream may already be ready; check on the next wait.
+      Enqueue(index);
+      return 0;
+    }
+
+    case EPOLL_CTL_MOD: {
+      if (it == fd_to_registration_.end())
+        return ENOENT;
+      if (!event)
+        return EFAULT;
+
+      Registration& reg = registrations_[it->second];
+      reg.events = event->events;
+      reg.data = event->data;
+      reg.enabled = true;
+      Enqueue(it->second);
+      return 0;
+    }
+
+    case EPOLL_CTL_DEL:
+      if (it == fd_to_registration_.end())
+        return ENOENT;
+      Unregister(it->second);
+      return 0;
+
+    default:
+      return EINVAL;
+  }
+}
+
+void EpollStream::RemoveDescriptor(int fd, FileStream* stream) {
+  std::map<int, int>::iterator it = fd_to_registration_.find(fd);
+  if (it != fd_to_registration_.end() &&
+      registrations_[it->second].stream == stream) {
+    Unregister(it->second);
+  }
+}
+
+int EpollStream::Wait(epoll_event* events, int maxevents, bool nonblocking,
+                      const timespec* abstime, int* nevents) {
+  std::vector<int> changed;
+  size_t wakeups = 0;
+  while (true) {
+    {
+      Mutex::Lock lock(mutex());
+      for (size_t i = 0; i < changed.size(); i++)
+        Enqueue(changed[i]);
+
+      *nevents = CollectEvents(events, maxevents);
+      if (*nevents || nonblocking) {
+        Stats::Get()->RecordWait(wakeups, wakeups ? wakeups - 1 : 0,
+                                 *nevents);
+        return 0;
+      }
+    }
+
+    // Streams that change from here on are recorded by the waiter, so
+    // nothing is lost between dropping the lock and sleeping.
+    int ret = waiter_.Wait(abstime, &changed);
+    if (ret) {
+      Stats::Get()->RecordWait(wakeups, wakeups, 0);
+      // See FileSystem::select about NaCl and negative errno values.
+      if (errno < 0) errno = -errno;
+      if (ret == ETIMEDOUT || errno == ETIMEDOUT)
+        return 0;
+      return errno;
+    }
+    wakeups++;
+  }
+}
+
+void EpollStream::Unregister(int index) {
+  Registration& reg = registrations_[index];
+  assert(reg.in_use);
+  {
+    Mutex::Lock lock(reg.stream->mutex());
+    reg.stream->RemoveWaiter(&waiter_, index);
+  }
+  reg.stream->release();
+  reg.stream = NULL;
+  reg.in_use = false;
+  if (reg.queued) {
+    candidates_.erase(std::find(candidates_.begin(), candidates_.end(), index));
+    reg.queued = false;
+  }
+  fd_to_registration_.erase(reg.fd);
+  free_registrations_.push_back(index);
+}
+
+void EpollStream::Enqueue(int index) {
+  // A signal may arrive for a registration that has since been removed.
+  if (index >= static_cast<int>(registrations_.size()))
+    return;
+  Registration& reg = registrations_[index];
+  if (!reg.in_use || !reg.enabled || reg.queued)
+    return;
+  reg.queued = true;
+  candidates_.push_back(index);
+}
+
+uint32_t EpollStream::GetReadyEvents(const Registration& reg) {
+  Mutex::Lock lock(reg.stream->mutex());
+  uint32_t ready = 0;
+  if ((reg.events & EPOLLIN) && reg.stream->is_read_ready())
+    ready |= EPOLLIN;
+  if ((reg.events & EPOLLOUT) && reg.stream->is_write_ready())
+    ready |= EPOLLOUT;
+  if ((reg.events & EPOLLPRI) && reg.stream->is_exception())
+    ready |= EPOLLPRI;
+  return ready;
+}
+
+int EpollStream::CollectEvents(epoll_event* events, int maxevents) {
+  int n = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < candidates_.size(); i++) {
+    int index = candidates_[i];
+    Registration& reg = registrations_[index];
+    if (n == maxevents) {
+      // Out of room, leave the rest for the next call.
+      candidates_[kept++] = index;
+      continue;
+    }
+
+    uint32_t ready = GetReadyEvents(reg);
+    if (!ready) {
+      reg.queued = false;
+      continue;
+    }
+
+    events[n].events = ready;
+    events[n].data = reg.data;
+    n++;
+
+    if (reg.events & EPOLLONESHOT)
+      reg.enabled = false;
+
+    if (reg.events & (EPOLLET | EPOLLONESHOT)) {
+      // Edge-triggered: not reported again until the stream changes.
+      reg.queued = false;
+    } else {
+      // Level-triggered: still ready until proven otherwise.
+      candidates_[kept++] = index;
+    }
+  }
+  candidates_.resize(kept);
+  return n;
+}
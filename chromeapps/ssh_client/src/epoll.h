@@ -0,0 +1,91 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <sys/epoll.h>
+
+#include <map>
+#include <vector>
+
+#include "file_interfaces.h"
+#include "pthread_helpers.h"
+
+// The descriptor returned by epoll_create. Registering a descriptor
+// subscribes our StreamWaiter to its stream, with the registration index
+// as the tag, so epoll_wait only has to look at registrations whose streams
+// changed, plus level-triggered ones that were ready last time.
+class EpollStream : public FileStream {
+ public:
+  explicit EpollStream(int fd);
+  virtual ~EpollStream();
+
+  virtual void addref();
+  virtual void release();
+
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kEpoll;
+  }
+
+  virtual void close();
+  virtual int read(char* buf, size_t count, size_t* nread);
+  virtual int write(const char* buf, size_t count, size_t* nwrote);
+
+  // Nesting an epoll descriptor in select() or poll() is not supported;
+  // it never reports ready. FileSystem::epoll_ctl refuses to add one to
+  // another epoll set.
+  virtual bool is_read_ready();
+  virtual bool is_write_ready();
+
+  // Implements EPOLL_CTL_ADD/MOD/DEL for |fd|, which refers to |stream|.
+  // Returns 0 or an errno value. Must be called with mutex() held.
+  int Control(int op, int fd, FileStream* stream, const epoll_event* event);
+
+  // Drops the registration of |fd| if it is for |stream|. FileSystem
+  // calls this when |fd| is closed, so the set doesn't keep the stream
+  // open and the descriptor number can be registered again, as on Linux.
+  // Must be called with mutex() held.
+  void RemoveDescriptor(int fd, FileStream* stream);
+
+  // Fills |events| with up to |maxevents| ready registrations, blocking
+  // until there is one or |abstime| passes unless |nonblocking| is set.
+  // Returns 0 or an errno value. Takes mutex() itself and releases it
+  // while blocked.
+  int Wait(epoll_event* events, int maxevents, bool nonblocking,
+           const timespec* abstime, int* nevents);
+
+ private:
+  struct Registration {
+    int fd;
+    FileStream* stream;
+    uint32_t events;
+    epoll_data_t data;
+    bool in_use;
+    // Disarmed by EPOLLONESHOT until the next EPOLL_CTL_MOD.
+    bool enabled;
+    // Whether the index is in candidates_.
+    bool queued;
+  };
+
+  void Unregister(int index);
+  void Enqueue(int index);
+  uint32_t GetReadyEvents(const Registration& reg);
+  int CollectEvents(epoll_event* events, int maxevents);
+
+  int ref_;
+  int fd_;
+  StreamWaiter waiter_;
+
+  std::vector<Registration> registrations_;
+  std::vector<int> free_registrations_;
+  std::map<int, int> fd_to_registration_;
+  // Registrations that may be ready: those whose stream signaled a
+  // change, and level-triggered ones that were ready on the last wait.
+  std::vector<int> candidates_;
+
+  DISALLOW_COPY_AND_ASSIGN(EpollStream);
+};
+
+#endif  // EPOLL_H
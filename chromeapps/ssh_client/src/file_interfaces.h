@@ -9,24 +9,150 @@
 #include <fcntl.h>
 #include <sys/dir.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "nacl-mounts/base/nacl_dirent.h"
 
+#include "pthread_helpers.h"
+#include "stats.h"
+
+// A thread blocked in select() on one or more streams. The waiter
+// subscribes to each stream with a tag of its choosing; when a stream's
+// state changes it publishes its tag into the waiter's readiness set.
+// The waiter then only has to re-examine the streams whose tags it
+// collects, and is not woken by unrelated streams.
+class StreamWaiter {
+ public:
+  StreamWaiter() : woken_(false) {}
+
+  // Records that the stream subscribed with |tag| changed state.
+  void Signal(int tag) {
+    Mutex::Lock lock(mutex_);
+    if (tag >= static_cast<int>(queued_.size()))
+      queued_.resize(tag + 1, false);
+    if (!queued_[tag]) {
+      queued_[tag] = true;
+      changed_.push_back(tag);
+    }
+    cond_.signal();
+  }
+
+  // Wakes the waiter without reporting any stream.
+  void Wake() {
+    Mutex::Lock lock(mutex_);
+    woken_ = true;
+    cond_.signal();
+  }
+
+  // Blocks until a stream is signaled, Wake is called or abstime
+  // passes. On wakeup, moves the tags signaled since the last call into
+  // |changed| and returns 0. Returns the pthread_cond_timedwait error
+  // otherwise.
+  int Wait(const timespec* abstime, std::vector<int>* changed) {
+    Mutex::Lock lock(mutex_);
+    while (!woken_ && changed_.empty()) {
+      int ret = abstime ? cond_.timedwait(mutex_, abstime)
+                        : cond_.wait(mutex_);
+      if (ret)
+        return ret;
+    }
+    woken_ = false;
+    changed->swap(changed_);
+    changed_.clear();
+    for (size_t i = 0; i < changed->size(); i++)
+      queued_[(*changed)[i]] = false;
+    return 0;
+  }
+
+ private:
+  Mutex mutex_;
+  Cond cond_;
+  bool woken_;
+  // Tags signaled since the last Wait, without duplicates.
+  std::vector<int> changed_;
+  std::vector<bool> queued_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamWaiter);
+};
+
 class FileStream {
  public:
+  FileStream() {}
   virtual ~FileStream() {}
 
+  // Every stream has its own lock. FileSystem holds it across calls
+  // into the stream, and Pepper callbacks take it before touching
+  // stream state. Threads blocked inside a stream wait on cond().
+  Mutex& mutex() { return mutex_; }
+  Cond& cond() { return cond_; }
+
+  // Which Stats bucket this stream's I/O is counted under.
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kOtherStream;
+  }
+
+  // Subscribes a waiter to state changes of this stream. The
+  // stream reports |tag| to the waiter on every change. Must be called
+  // with mutex() held.
+  virtual void AddWaiter(StreamWaiter* waiter, int tag) {
+    Subscription subscription = { waiter, tag };
+    waiters_.push_back(subscription);
+  }
+  virtual void RemoveWaiter(StreamWaiter* waiter, int tag) {
+    for (size_t i = 0; i < waiters_.size(); i++) {
+      if (waiters_[i].waiter == waiter && waiters_[i].tag == tag) {
+        waiters_.erase(waiters_.begin() + i);
+        return;
+      }
+    }
+  }
+
   virtual void addref() = 0;
   virtual void release() = 0;
 
   virtual void close() = 0;
   virtual int read(char* buf, size_t count, size_t* nread) = 0;
   virtual int write(const char* buf, size_t count, size_t* nwrote) = 0;
+  // Vectored read() and write(). The default readv fills only the first
+  // non-empty buffer, which is a valid short read. The default writev
+  // writes the buffers in turn and stops at the first short write.
+  virtual int readv(const iovec* iov, int iovcnt, size_t* nread) {
+    for (int i = 0; i < iovcnt; i++) {
+      if (iov[i].iov_len) {
+        return read(static_cast<char*>(iov[i].iov_base), iov[i].iov_len,
+                    nread);
+      }
+    }
+    *nread = 0;
+    return 0;
+  }
+  virtual int writev(const iovec* iov, int iovcnt, size_t* nwrote) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+      size_t n;
+      int error = write(static_cast<const char*>(iov[i].iov_base),
+                        iov[i].iov_len, &n);
+      if (error) {
+        if (!total)
+          return error;
+        break;
+      }
+      total += n;
+      if (n < iov[i].iov_len)
+        break;
+    }
+    *nwrote = total;
+    return 0;
+  }
   virtual int seek(nacl_abi_off_t offset, int whence,
                    nacl_abi_off_t* new_offset) {
     return ESPIPE;
@@ -38,6 +164,17 @@ class FileStream {
   virtual int getdents(dirent* buf, size_t count, size_t* nread) {
     return ENOTDIR;
   }
+  // Writes out anything the stream buffers. Streams that don't support
+  // syncing fail with EINVAL, as on Linux.
+  virtual int fsync() {
+    return EINVAL;
+  }
+  // Called by close() on every descriptor for the stream, before it goes
+  // away, to write out buffered data. Returns 0 or the errno of a write
+  // that failed, for close() to report.
+  virtual int flush() {
+    return 0;
+  }
 
   virtual int isatty() {
     errno = EINVAL;
@@ -71,6 +208,37 @@ class FileStream {
     return -1;
   }
 
+  // Message versions of the above. For streams the address and control
+  // data are ignored and these are readv() and writev().
+  virtual ssize_t recvmsg(msghdr* msg, int flags) {
+    size_t nread;
+    int error = readv(msg->msg_iov, msg->msg_iovlen, &nread);
+    if (error) {
+      errno = error;
+      return -1;
+    }
+    msg->msg_namelen = 0;
+    msg->msg_controllen = 0;
+    msg->msg_flags = 0;
+    return nread;
+  }
+  virtual ssize_t sendmsg(const msghdr* msg, int flags) {
+    size_t nwrote;
+    int error = writev(msg->msg_iov, msg->msg_iovlen, &nwrote);
+    if (error) {
+      errno = error;
+      return -1;
+    }
+    return nwrote;
+  }
+
+  // Options nobody implements read back as zero.
+  virtual int getsockopt(int level, int optname, void* optval,
+                         socklen_t* optlen) {
+    memset(optval, 0, *optlen);
+    return 0;
+  }
+
   virtual bool is_read_ready() {
     return true;
   }
@@ -80,6 +248,37 @@ class FileStream {
   virtual bool is_exception() {
     return false;
   }
+
+ protected:
+  // Waits on cond() once, counting the time blocked in Stats. Must be
+  // called with mutex() held.
+  void WaitForStateChange() {
+    uint64_t start = Stats::NowMicroseconds();
+    cond_.wait(mutex_);
+    uint64_t end = Stats::NowMicroseconds();
+    Stats::Get()->RecordBlocked(stream_type(),
+                                end > start ? end - start : 0);
+  }
+
+  // Wakes threads blocked in this stream and select() callers waiting
+  // on it. Must be called with mutex() held.
+  void NotifyStateChanged() {
+    cond_.broadcast();
+    for (size_t i = 0; i < waiters_.size(); i++)
+      waiters_[i].waiter->Signal(waiters_[i].tag);
+  }
+
+ private:
+  struct Subscription {
+    StreamWaiter* waiter;
+    int tag;
+  };
+
+  Mutex mutex_;
+  Cond cond_;
+  std::vector<Subscription> waiters_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileStream);
 };
 
 class PathHandler {
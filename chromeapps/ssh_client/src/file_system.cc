@@ -19,12 +19,14 @@
 #include "dev_null.h"
 #include "dev_random.h"
 #include "dev_tty.h"
+#include "epoll.h"
 #include "js_file.h"
 #include "pepper_file.h"
+#include "static_file.h"
+#include "stats.h"
 #include "tcp_server_socket.h"
 #include "tcp_socket.h"
 #include "udp_socket.h"
-#include "url_file.h"
 
 extern "C" void DoWrapSysCalls();
 
@@ -34,14 +36,54 @@ static const int64_t kNanosecondsPerMicrosecond = 1000;
 FileStream* const FileSystem::kBadFileStream = (FileStream*)-1;
 FileSystem* FileSystem::file_system_ = NULL;
 
+namespace {
+
+// Keeps a stream alive for the duration of a syscall, so a concurrent
+// close() of the descriptor cannot destroy it underneath us.
+class ScopedStream {
+ public:
+  explicit ScopedStream(FileStream* stream) : stream_(stream) {}
+  ~ScopedStream() {
+    if (stream_)
+      stream_->release();
+  }
+
+  FileStream* get() const { return stream_; }
+  FileStream* operator->() const { return stream_; }
+
+ private:
+  FileStream* stream_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedStream);
+};
+
+// Converts a relative timeout into the absolute time pthread expects.
+void GetDeadline(const timespec& timeout, timespec* abstime) {
+  timeval tv_now;
+  gettimeofday(&tv_now, NULL);
+  int64_t current_time_us =
+      tv_now.tv_sec * kMicrosecondsPerSecond + tv_now.tv_usec;
+  int64_t wakeup_time_us =
+      current_time_us +
+      timeout.tv_sec * kMicrosecondsPerSecond +
+      timeout.tv_nsec / kNanosecondsPerMicrosecond;
+  abstime->tv_sec = wakeup_time_us / kMicrosecondsPerSecond;
+  abstime->tv_nsec =
+      (wakeup_time_us - abstime->tv_sec * kMicrosecondsPerSecond) *
+      kNanosecondsPerMicrosecond;
+}
+
+}  // namespace
+
 FileSystem::FileSystem(pp::Instance* instance, OutputInterface* out)
     : instance_(instance),
       output_(out),
+      first_free_word_(kFileIDOffset / 32),
       ppfs_(NULL),
       ppfs_path_handler_(NULL),
       fs_initialized_(false),
       factory_(this),
-      host_resolver_(NULL),
+      resolver_(new Resolver(instance)),
       first_unused_addr_(kFirstAddr),
       use_js_socket_(false),
       col_(80), row_(24),
@@ -95,11 +137,10 @@ FileSystem::FileSystem(pp::Instance* instance, OutputInterface* out)
   }
   AddPathHandler("/dev/js", new JsFileHandler(out, "/dev/js"));
 
-  // Add /lib/locale for glibc.
-  UrlFileHandler *locale_mount = new UrlFileHandler("/plugin/locale-data");
-  locale_mount->AddDirectory("/en_US.UTF-8");
-  locale_mount->AddDirectory("/en_US.UTF-8/LC_MESSAGES");
-  AddPathHandler("/lib/locale", locale_mount);
+  // Add /lib/locale for glibc. The data is compiled in, so setting up a
+  // locale costs no fetches.
+  AddPathHandler("/lib/locale",
+                 new StaticFileHandler(kLocaleFiles, kLocaleFilesCount));
 
   // Add localhost 127.0.0.1
   AddHostAddress("localhost", 0x7F000001);
@@ -110,17 +151,19 @@ FileSystem::FileSystem(pp::Instance* instance, OutputInterface* out)
 FileSystem::~FileSystem() {
   for (PathHandlerMap::iterator it = paths_.begin(); it != paths_.end(); ++it)
     it->second->release();
-  for (FileStreamMap::iterator it = streams_.begin(); it != streams_.end();
-       ++it) {
-    it->second->release();
+  for (size_t fd = 0; fd < streams_.size(); fd++) {
+    if (streams_[fd] && streams_[fd] != kBadFileStream)
+      streams_[fd]->release();
   }
   if (ppfs_path_handler_)
     ppfs_path_handler_->release();
   delete ppfs_;
+  delete resolver_;
   file_system_ = NULL;
 }
 
 void FileSystem::OnOpen(int32_t result, pp::FileSystem* fs) {
+  Mutex::Lock lock(mutex_);
   if (result == PP_OK) {
     ppfs_ = fs;
     ppfs_path_handler_ = new PepperFileHandler(fs);
@@ -146,13 +189,23 @@ void FileSystem::AddPathHandler(const std::string& path, PathHandler* handler) {
 }
 
 void FileSystem::AddFileStream(int fd, FileStream* stream) {
-  assert(streams_.find(fd) == streams_.end() || !streams_.find(fd)->second);
+  assert(fd >= 0);
+  assert(!IsKnowDescriptor(fd) || !streams_[fd]);
+  if (static_cast<size_t>(fd) >= streams_.size()) {
+    streams_.resize(fd + 1, NULL);
+    used_.resize(fd / 32 + 1, 0);
+  }
+  used_[fd / 32] |= 1u << (fd % 32);
   streams_[fd] = stream;
 }
 
 void FileSystem::RemoveFileStream(int fd) {
-  assert(streams_.find(fd) != streams_.end());
-  streams_.erase(fd);
+  assert(IsKnowDescriptor(fd));
+  used_[fd / 32] &= ~(1u << (fd % 32));
+  streams_[fd] = NULL;
+  reserved_oflags_.erase(fd);
+  if (fd >= kFileIDOffset)
+    first_free_word_ = std::min(first_free_word_, static_cast<size_t>(fd / 32));
 }
 
 PathHandler* FileSystem::GetPathHandler(const char* pathname,
@@ -180,33 +233,96 @@ PathHandler* FileSystem::GetPathHandler(const char* pathname,
 }
 
 int FileSystem::GetFirstUnusedDescriptor() {
-  int fd = kFileIDOffset;
-  while (IsKnowDescriptor(fd))
-    fd++;
-  return fd;
+  // Every word before first_free_word_ is full from kFileIDOffset up,
+  // so the search starts there and usually ends in the first word.
+  size_t word = first_free_word_;
+  for (; word < used_.size(); word++) {
+    uint32_t free_bits = ~used_[word];
+    if (word == kFileIDOffset / 32)
+      free_bits &= ~0u << (kFileIDOffset % 32);
+    if (free_bits) {
+      first_free_word_ = word;
+      return word * 32 + __builtin_ctz(free_bits);
+    }
+  }
+
+  // Everything allocated so far is in use; take the next descriptor.
+  first_free_word_ = word;
+  int fd = word * 32;
+  return fd > kFileIDOffset ? fd : kFileIDOffset;
 }
 
 bool FileSystem::IsKnowDescriptor(int fd) {
-  return streams_.find(fd) != streams_.end();
+  return fd >= 0 && static_cast<size_t>(fd) < streams_.size() &&
+      (used_[fd / 32] & (1u << (fd % 32)));
 }
 
 FileStream* FileSystem::GetStream(int fd) {
-  FileStreamMap::iterator it = streams_.find(fd);
-  return it != streams_.end() ? it->second : (FileStream*)NULL;
+  // Free and reserved descriptors both hold NULL.
+  if (static_cast<size_t>(fd) >= streams_.size())
+    return NULL;
+  return streams_[fd];
+}
+
+FileStream* FileSystem::AcquireStream(int fd) {
+  Mutex::Lock lock(mutex_);
+  FileStream* stream = GetStream(fd);
+  if (!stream || stream == kBadFileStream)
+    return NULL;
+  stream->addref();
+  return stream;
+}
+
+void FileSystem::RemoveFromEpollSets(int fd, FileStream* stream) {
+  // The descriptor table holds a reference to every open epoll set, so
+  // they can be collected under mutex_. Their locks are taken after
+  // mutex_ is dropped.
+  std::vector<FileStream*> sets;
+  {
+    Mutex::Lock lock(mutex_);
+    for (size_t i = 0; i < streams_.size(); i++) {
+      FileStream* set = streams_[i];
+      if (!set || set == kBadFileStream || set == stream ||
+          set->stream_type() != Stats::kEpoll ||
+          std::find(sets.begin(), sets.end(), set) != sets.end()) {
+        continue;
+      }
+      set->addref();
+      sets.push_back(set);
+    }
+  }
+
+  for (size_t i = 0; i < sets.size(); i++) {
+    {
+      Mutex::Lock lock(sets[i]->mutex());
+      static_cast<EpollStream*>(sets[i])->RemoveDescriptor(fd, stream);
+    }
+    sets[i]->release();
+  }
 }
 
 int FileSystem::open(const char* pathname, int oflag, mode_t cmode,
                      int* newfd) {
-  Mutex::Lock lock(mutex_);
+  SyscallTimer timer(Stats::kOpen);
   std::string remainder;
-  PathHandler* handler = GetPathHandler(pathname, &remainder);
-  if (!handler)
-    return ENOENT;
+  PathHandler* handler;
+  int fd;
+  {
+    Mutex::Lock lock(mutex_);
+    handler = GetPathHandler(pathname, &remainder);
+    if (!handler)
+      return ENOENT;
+
+    fd = GetFirstUnusedDescriptor();
+    // mark descriptor as used
+    AddFileStream(fd, NULL);
+  }
 
-  int fd = GetFirstUnusedDescriptor();
-  // mark descriptor as used
-  AddFileStream(fd, NULL);
+  // Opening may block on the main thread, so don't hold the descriptor
+  // table while doing it.
   FileStream* stream = handler->open(fd, remainder.c_str(), oflag);
+
+  Mutex::Lock lock(mutex_);
   if (!stream) {
     RemoveFileStream(fd);
     return EACCES;
@@ -218,44 +334,100 @@ int FileSystem::open(const char* pathname, int oflag, mode_t cmode,
 }
 
 int FileSystem::close(int fd) {
-  Mutex::Lock lock(mutex_);
-  if (!IsKnowDescriptor(fd))
-    return EBADF;
+  SyscallTimer timer(Stats::kClose);
+  // Buffered writes may still fail. Flush them while the descriptor is
+  // there so the error can be returned; it is closed either way.
+  int error = 0;
+  {
+    ScopedStream stream(AcquireStream(fd));
+    if (stream.get()) {
+      Mutex::Lock lock(stream->mutex());
+      error = stream->flush();
+    }
+  }
 
-  FileStream* stream = GetStream(fd);
+  FileStream* stream;
+  {
+    Mutex::Lock lock(mutex_);
+    if (!IsKnowDescriptor(fd))
+      return EBADF;
+
+    stream = GetStream(fd);
+    RemoveFileStream(fd);
+  }
+
+  // The last release closes the stream, which may block.
   if (stream && stream != kBadFileStream) {
+    RemoveFromEpollSets(fd, stream);
     stream->release();
   }
-  RemoveFileStream(fd);
-  return 0;
+  return error;
 }
 
 int FileSystem::read(int fd, char* buf, size_t count, size_t* nread) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream)
-    return stream->read(buf, count, nread);
-  else
+  SyscallTimer timer(Stats::kRead);
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
     return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  int error = stream->read(buf, count, nread);
+  if (!error) {
+    Stats::Get()->RecordRead(stream->stream_type(), *nread, timer.elapsed());
+  }
+  return error;
 }
 
 int FileSystem::write(int fd, const char* buf, size_t count, size_t* nwrote) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream)
-    return stream->write(buf, count, nwrote);
-  else
+  SyscallTimer timer(Stats::kWrite);
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
     return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  int error = stream->write(buf, count, nwrote);
+  if (!error) {
+    Stats::Get()->RecordWrite(stream->stream_type(), *nwrote, timer.elapsed());
+  }
+  return error;
+}
+
+int FileSystem::readv(int fd, const iovec* iov, int iovcnt, size_t* nread) {
+  SyscallTimer timer(Stats::kReadv);
+  if (iovcnt < 0 || iovcnt > UIO_MAXIOV)
+    return EINVAL;
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
+    return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  int error = stream->readv(iov, iovcnt, nread);
+  if (!error) {
+    Stats::Get()->RecordRead(stream->stream_type(), *nread, timer.elapsed());
+  }
+  return error;
+}
+
+int FileSystem::writev(int fd, const iovec* iov, int iovcnt, size_t* nwrote) {
+  SyscallTimer timer(Stats::kWritev);
+  if (iovcnt < 0 || iovcnt > UIO_MAXIOV)
+    return EINVAL;
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
+    return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  int error = stream->writev(iov, iovcnt, nwrote);
+  if (!error) {
+    Stats::Get()->RecordWrite(stream->stream_type(), *nwrote, timer.elapsed());
+  }
+  return error;
 }
 
 int FileSystem::seek(int fd, nacl_abi_off_t offset, int whence,
                      nacl_abi_off_t* new_offset) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream)
-    return stream->seek(offset, whence, new_offset);
-  else
+  SyscallTimer timer(Stats::kSeek);
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
     return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  return stream->seek(offset, whence, new_offset);
 }
 
 int FileSystem::dup(int fd, int *newfd) {
@@ -271,32 +443,46 @@ int FileSystem::dup(int fd, int *newfd) {
 }
 
 int FileSystem::dup2(int fd, int newfd) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (!stream || stream == kBadFileStream)
+  if (newfd < 0 || newfd >= kMaxDescriptors)
     return EBADF;
 
-  FileStream* new_stream = GetStream(newfd);
+  FileStream* new_stream;
+  {
+    Mutex::Lock lock(mutex_);
+    FileStream* stream = GetStream(fd);
+    if (!stream || stream == kBadFileStream)
+      return EBADF;
+    // Replacing a descriptor with itself must not close it, or drop it
+    // from the epoll sets it is in.
+    if (fd == newfd)
+      return 0;
+
+    new_stream = GetStream(newfd);
+    if (new_stream)
+      RemoveFileStream(newfd);
+
+    stream->addref();
+    AddFileStream(newfd, stream);
+  }
+
   if (new_stream && new_stream != kBadFileStream) {
+    RemoveFromEpollSets(newfd, new_stream);
     new_stream->release();
-    RemoveFileStream(newfd);
   }
-
-  stream->addref();
-  AddFileStream(newfd, stream);
   return 0;
 }
 
 int FileSystem::fstat(int fd, nacl_abi_stat* out) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream)
-    return stream->fstat(out);
-  else
+  SyscallTimer timer(Stats::kFstat);
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
     return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  return stream->fstat(out);
 }
 
 int FileSystem::stat(const char *pathname, nacl_abi_stat* out) {
+  SyscallTimer timer(Stats::kStat);
   Mutex::Lock lock(mutex_);
   PathHandlerMap::iterator it = paths_.find(pathname);
   PathHandler* handler = (it != paths_.end()) ? it->second : ppfs_path_handler_;
@@ -307,55 +493,77 @@ int FileSystem::stat(const char *pathname, nacl_abi_stat* out) {
 }
 
 int FileSystem::getdents(int fd, dirent* buf, size_t count, size_t* nread) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream)
-    return stream->getdents(buf, count, nread);
-  else
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get())
     return EBADF;
+  Mutex::Lock lock(stream->mutex());
+  return stream->getdents(buf, count, nread);
+}
+
+int FileSystem::fsync(int fd) {
+  SyscallTimer timer(Stats::kFsync);
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
+    errno = EBADF;
+    return -1;
+  }
+  Mutex::Lock lock(stream->mutex());
+  int error = stream->fsync();
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
 }
 
 int FileSystem::isatty(int fd) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
-    return stream->isatty();
-  } else {
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
     errno = EBADF;
     return 0;
   }
+  Mutex::Lock lock(stream->mutex());
+  return stream->isatty();
 }
 
 int FileSystem::tcgetattr(int fd, struct termios* termios_p) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
-    return stream->tcgetattr(termios_p);
-  } else {
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
+  Mutex::Lock lock(stream->mutex());
+  return stream->tcgetattr(termios_p);
 }
 
 int FileSystem::tcsetattr(int fd, int optional_actions,
                           const termios* termios_p) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
-    return stream->tcsetattr(optional_actions, termios_p);
-  } else {
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
+  Mutex::Lock lock(stream->mutex());
+  return stream->tcsetattr(optional_actions, termios_p);
 }
 
 int FileSystem::fcntl(int fd, int cmd, va_list ap) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
+  ScopedStream stream(AcquireStream(fd));
+  if (stream.get()) {
+    Mutex::Lock lock(stream->mutex());
     return stream->fcntl(cmd, ap);
-  } else if (IsKnowDescriptor(fd)) {
-    // Socket with reserved FD but not allocated yet, for now just ignore.
+  }
+
+  Mutex::Lock lock(mutex_);
+  if (IsKnowDescriptor(fd)) {
+    // Socket with reserved FD but not allocated yet. Keep its flags for
+    // the stream connect() creates.
+    if (cmd == F_GETFL) {
+      ReservedFlagsMap::iterator it = reserved_oflags_.find(fd);
+      return it != reserved_oflags_.end() ? it->second : O_RDWR;
+    } else if (cmd == F_SETFL) {
+      reserved_oflags_[fd] = va_arg(ap, long);
+    }
     return 0;
   } else {
     errno = EBADF;
@@ -364,104 +572,332 @@ int FileSystem::fcntl(int fd, int cmd, va_list ap) {
 }
 
 int FileSystem::ioctl(int fd, int request, va_list ap) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
-    return stream->ioctl(request, ap);
-  } else {
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
+  Mutex::Lock lock(stream->mutex());
+  return stream->ioctl(request, ap);
 }
 
-int FileSystem::IsReady(int nfds, fd_set* fds, bool (FileStream::*is_ready)(),
-                        bool apply) {
-  if (!fds)
-    return 0;
+int FileSystem::select(int nfds, fd_set* readfds, fd_set* writefds,
+                       fd_set* exceptfds, struct timeval* timeout) {
+  SyscallTimer timer(Stats::kSelect);
+  timespec ts;
+  if (timeout)
+    TIMEVAL_TO_TIMESPEC(timeout, &ts);
 
-  int nset = 0;
-  for (int i = 0; i < nfds; i++) {
-    if (FD_ISSET(i, fds)) {
-      FileStream* stream = GetStream(i);
-      if (!stream)
+  // Hold a reference to every stream of interest so we can wait on them
+  // without the descriptor table locked.
+  std::vector<SelectEntry> entries;
+  {
+    Mutex::Lock lock(mutex_);
+    for (int i = 0; i < nfds; i++) {
+      SelectEntry entry;
+      entry.fd = i;
+      entry.read = readfds && FD_ISSET(i, readfds);
+      entry.write = writefds && FD_ISSET(i, writefds);
+      entry.except = exceptfds && FD_ISSET(i, exceptfds);
+      entry.read_ready = entry.write_ready = entry.except_ready = false;
+      if (!entry.read && !entry.write && !entry.except)
+        continue;
+
+      entry.stream = GetStream(i);
+      if (!entry.stream || entry.stream == kBadFileStream) {
+        for (size_t j = 0; j < entries.size(); j++)
+          entries[j].stream->release();
+        errno = EBADF;
         return -1;
-      if ((stream->*is_ready)()) {
-        if (!apply)
-          return 1;
-        else
-          nset++;
-      } else {
-        if (apply)
-          FD_CLR(i, fds);
       }
+      entry.stream->addref();
+      entries.push_back(entry);
+    }
+  }
+
+  int error = WaitForEntries(&entries, timeout ? &ts : NULL);
+
+  int nset = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    const SelectEntry& entry = entries[i];
+    entry.stream->release();
+
+    if (entry.read) {
+      if (entry.read_ready)
+        nset++;
+      else
+        FD_CLR(entry.fd, readfds);
+    }
+    if (entry.write) {
+      if (entry.write_ready)
+        nset++;
+      else
+        FD_CLR(entry.fd, writefds);
+    }
+    if (entry.except) {
+      if (entry.except_ready)
+        nset++;
+      else
+        FD_CLR(entry.fd, exceptfds);
     }
   }
+
+  if (error) {
+    errno = error;
+    return -1;
+  }
+
+  if (DeliverResize()) {
+    errno = EINTR;
+    return -1;
+  }
+
   return nset;
 }
 
-int FileSystem::select(int nfds, fd_set* readfds, fd_set* writefds,
-                       fd_set* exceptfds, struct timeval* timeout) {
-  Mutex::Lock lock(mutex_);
+int FileSystem::poll(pollfd* fds, nfds_t nfds, const timespec* timeout) {
+  SyscallTimer timer(Stats::kPoll);
+  // Same as select(), except that entry.fd is the index into |fds| and
+  // bad descriptors are reported through revents rather than failing
+  // the call.
+  std::vector<SelectEntry> entries;
+  int nset = 0;
+  {
+    Mutex::Lock lock(mutex_);
+    for (nfds_t i = 0; i < nfds; i++) {
+      fds[i].revents = 0;
+      if (fds[i].fd < 0)
+        continue;
+
+      FileStream* stream = GetStream(fds[i].fd);
+      if (!stream || stream == kBadFileStream) {
+        fds[i].revents = POLLNVAL;
+        nset++;
+        continue;
+      }
+
+      SelectEntry entry;
+      entry.fd = i;
+      entry.stream = stream;
+      entry.read = fds[i].events & (POLLIN | POLLRDNORM);
+      entry.write = fds[i].events & (POLLOUT | POLLWRNORM);
+      entry.except = fds[i].events & POLLPRI;
+      entry.read_ready = entry.write_ready = entry.except_ready = false;
+      stream->addref();
+      entries.push_back(entry);
+    }
+  }
+
+  // Don't block if a bad descriptor is already being reported.
+  timespec zero = { 0, 0 };
+  int error = WaitForEntries(&entries, nset ? &zero : timeout);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    const SelectEntry& entry = entries[i];
+    entry.stream->release();
+
+    pollfd* pfd = &fds[entry.fd];
+    if (entry.read_ready)
+      pfd->revents |= pfd->events & (POLLIN | POLLRDNORM);
+    if (entry.write_ready)
+      pfd->revents |= pfd->events & (POLLOUT | POLLWRNORM);
+    if (entry.except_ready)
+      pfd->revents |= POLLPRI;
+    if (pfd->revents)
+      nset++;
+  }
+
+  if (error) {
+    errno = error;
+    return -1;
+  }
+
+  if (DeliverResize()) {
+    errno = EINTR;
+    return -1;
+  }
 
+  return nset;
+}
+
+int FileSystem::WaitForEntries(std::vector<SelectEntry>* entries,
+                               const timespec* timeout) {
+  bool nonblocking = timeout && !timeout->tv_sec && !timeout->tv_nsec;
   timespec ts_abs;
-  if (timeout) {
-    timespec ts;
-    TIMEVAL_TO_TIMESPEC(timeout, &ts);
-    timeval tv_now;
-    gettimeofday(&tv_now, NULL);
-    int64_t current_time_us =
-        tv_now.tv_sec * kMicrosecondsPerSecond + tv_now.tv_usec;
-    int64_t wakeup_time_us =
-        current_time_us +
-        timeout->tv_sec * kMicrosecondsPerSecond + timeout->tv_usec;
-     ts_abs.tv_sec = wakeup_time_us / kMicrosecondsPerSecond;
-     ts_abs.tv_nsec =
-        (wakeup_time_us - ts_abs.tv_sec * kMicrosecondsPerSecond) *
-        kNanosecondsPerMicrosecond;
-  }
-
-  while(!(IsReady(nfds, readfds, &FileStream::is_read_ready, false) ||
-          IsReady(nfds, writefds, &FileStream::is_write_ready, false) ||
-          IsReady(nfds, exceptfds, &FileStream::is_exception, false) ||
-          is_resize_)) {
-    if (timeout) {
-      if (!timeout->tv_sec && !timeout->tv_usec)
+  if (timeout)
+    GetDeadline(*timeout, &ts_abs);
+
+  // Subscribe to every stream, tagged with its entry index, and take
+  // the initial readiness snapshot. After this only the entries whose
+  // streams report a change are examined again.
+  StreamWaiter waiter;
+  {
+    Mutex::Lock lock(mutex_);
+    select_waiters_.push_back(&waiter);
+  }
+
+  int nready = 0;
+  for (size_t i = 0; i < entries->size(); i++) {
+    SelectEntry* entry = &(*entries)[i];
+    Mutex::Lock lock(entry->stream->mutex());
+    entry->stream->AddWaiter(&waiter, i);
+    if (UpdateReadiness(entry))
+      nready++;
+  }
+
+  int error = 0;
+  size_t wakeups = 0;
+  size_t idle_wakeups = 0;
+  std::vector<int> changed;
+  while (!nready) {
+    {
+      Mutex::Lock lock(mutex_);
+      if (is_resize_)
         break;
+    }
 
-      if (cond_.timedwait(mutex_, &ts_abs)) {
-        // For some reason, this likes stuffing -EINTR in errno. A bug
-        // in NaCl somewhere? They occasionally transform error codes
-        // and stuff in IRT.
-        if (errno < 0) errno = -errno;
-        if (errno == ETIMEDOUT)
-          break;
-        else
-          return -1;
-      }
-    } else {
-      cond_.wait(mutex_);
+    if (nonblocking)
+      break;
+
+    int ret = waiter.Wait(timeout ? &ts_abs : NULL, &changed);
+    if (ret) {
+      // For some reason, this likes stuffing -EINTR in errno. A bug
+      // in NaCl somewhere? They occasionally transform error codes
+      // and stuff in IRT.
+      if (errno < 0) errno = -errno;
+      if (ret != ETIMEDOUT && errno != ETIMEDOUT)
+        error = errno;
+      break;
+    }
+
+    wakeups++;
+    for (size_t i = 0; i < changed.size(); i++) {
+      SelectEntry* entry = &(*entries)[changed[i]];
+      Mutex::Lock lock(entry->stream->mutex());
+      bool was_ready = entry->read_ready || entry->write_ready ||
+                       entry->except_ready;
+      bool is_ready = UpdateReadiness(entry);
+      if (is_ready != was_ready)
+        nready += is_ready ? 1 : -1;
     }
+    if (!nready)
+      idle_wakeups++;
   }
+  Stats::Get()->RecordWait(wakeups, idle_wakeups, nready);
 
-  if (is_resize_) {
-    is_resize_ = false;
-    if (handler_sigwinch_ != SIG_IGN &&
-        handler_sigwinch_ != SIG_DFL &&
-        handler_sigwinch_ != SIG_ERR) {
-      handler_sigwinch_(SIGWINCH);
-      errno = EINTR;
-      return -1;
+  {
+    Mutex::Lock lock(mutex_);
+    select_waiters_.erase(std::find(select_waiters_.begin(),
+                                    select_waiters_.end(), &waiter));
+  }
+
+  for (size_t i = 0; i < entries->size(); i++) {
+    SelectEntry* entry = &(*entries)[i];
+    Mutex::Lock lock(entry->stream->mutex());
+    entry->stream->RemoveWaiter(&waiter, i);
+  }
+
+  return error;
+}
+
+bool FileSystem::DeliverResize() {
+  void (*handler_sigwinch)(int) = NULL;
+  {
+    Mutex::Lock lock(mutex_);
+    if (is_resize_) {
+      is_resize_ = false;
+      handler_sigwinch = handler_sigwinch_;
     }
   }
+  // The handler usually queries the terminal size, so call it without
+  // mutex_ held.
+  if (handler_sigwinch &&
+      handler_sigwinch != SIG_IGN &&
+      handler_sigwinch != SIG_DFL &&
+      handler_sigwinch != SIG_ERR) {
+    handler_sigwinch(SIGWINCH);
+    return true;
+  }
+  return false;
+}
+
+bool FileSystem::UpdateReadiness(SelectEntry* entry) {
+  FileStream* stream = entry->stream;
+  entry->read_ready = entry->read && stream->is_read_ready();
+  entry->write_ready = entry->write && stream->is_write_ready();
+  entry->except_ready = entry->except && stream->is_exception();
+  return entry->read_ready || entry->write_ready || entry->except_ready;
+}
+
+int FileSystem::epoll_create(int flags) {
+  Mutex::Lock lock(mutex_);
+  int fd = GetFirstUnusedDescriptor();
+  AddFileStream(fd, new EpollStream(fd));
+  return fd;
+}
+
+int FileSystem::epoll_ctl(int epfd, int op, int fd, epoll_event* event) {
+  if (epfd == fd) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ScopedStream stream(AcquireStream(epfd));
+  ScopedStream target(AcquireStream(fd));
+  if (!stream.get() || !target.get()) {
+    errno = EBADF;
+    return -1;
+  }
+
+  // Nested epoll sets are not supported: the inner one never reports
+  // ready, and locking one set from another could deadlock.
+  if (stream->stream_type() != Stats::kEpoll ||
+      target->stream_type() == Stats::kEpoll) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  EpollStream* epoll = static_cast<EpollStream*>(stream.get());
+  Mutex::Lock lock(epoll->mutex());
+  int ret = epoll->Control(op, fd, target.get(), event);
+  if (ret) {
+    errno = ret;
+    return -1;
+  }
+  return 0;
+}
 
-  int nread = IsReady(nfds, readfds, &FileStream::is_read_ready, true);
-  int nwrite = IsReady(nfds, writefds, &FileStream::is_write_ready, true);
-  int nexcpt = IsReady(nfds, exceptfds, &FileStream::is_exception, true);
-  if (nread < 0 || nwrite < 0 || nexcpt < 0) {
+int FileSystem::epoll_wait(int epfd, epoll_event* events, int maxevents,
+                           const timespec* timeout) {
+  SyscallTimer timer(Stats::kEpollWait);
+  ScopedStream stream(AcquireStream(epfd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
-  return nread + nwrite + nexcpt;
+
+  if (stream->stream_type() != Stats::kEpoll || maxevents <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  EpollStream* epoll = static_cast<EpollStream*>(stream.get());
+
+  bool nonblocking = timeout && !timeout->tv_sec && !timeout->tv_nsec;
+  timespec ts_abs;
+  if (timeout)
+    GetDeadline(*timeout, &ts_abs);
+
+  // EpollStream::Wait takes its lock itself, so epoll_ctl from other
+  // threads can proceed while this one sleeps.
+  int nevents;
+  int ret = epoll->Wait(events, maxevents, nonblocking,
+                        timeout ? &ts_abs : NULL, &nevents);
+  if (ret) {
+    errno = ret;
+    return -1;
+  }
+  return nevents;
 }
 
 uint32_t FileSystem::AddHostAddress(const char* name, uint32_t addr) {
@@ -474,28 +910,23 @@ uint32_t FileSystem::AddHostAddress(const char* name, uint32_t addr) {
 addrinfo* FileSystem::CreateAddrInfo(const PP_NetAddress_Private& netaddr,
                                      const addrinfo* hints,
                                      const char* name) {
-  addrinfo* ai = new addrinfo();
-  sockaddr_in6* addr = new sockaddr_in6();
-
-  ai->ai_addr = reinterpret_cast<sockaddr*>(addr);
-  ai->ai_addrlen = sizeof(*addr);
+  sockaddr_in6 addr;
+  Resolver::ToSockAddr(netaddr, &addr);
+  return CreateAddrInfo(addr, addr.sin6_port, hints, name);
+}
 
-  PP_NetAddressFamily_Private family =
-      pp::NetAddressPrivate::GetFamily(netaddr);
-  if (family == PP_NETADDRESSFAMILY_IPV4)
-    ai->ai_addr->sa_family = ai->ai_family = AF_INET;
-  else if (family == PP_NETADDRESSFAMILY_IPV6)
-    ai->ai_addr->sa_family = ai->ai_family = AF_INET6;
+addrinfo* FileSystem::CreateAddrInfo(const sockaddr_in6& addr, uint16_t port,
+                                     const addrinfo* hints,
+                                     const char* name) {
+  addrinfo* ai = new addrinfo();
+  sockaddr_in6* ai_addr = new sockaddr_in6(addr);
 
+  ai->ai_addr = reinterpret_cast<sockaddr*>(ai_addr);
+  ai->ai_addrlen = sizeof(*ai_addr);
+  ai->ai_family = ai_addr->sin6_family;
   ai->ai_canonname = strdup(name);
-  addr->sin6_port = pp::NetAddressPrivate::GetPort(netaddr);
-  if (family == PP_NETADDRESSFAMILY_IPV6) {
-    pp::NetAddressPrivate::GetAddress(
-        netaddr, &addr->sin6_addr, sizeof(in6_addr));
-  } else {
-    pp::NetAddressPrivate::GetAddress(
-        netaddr, &((sockaddr_in*)addr)->sin_addr, sizeof(in_addr));
-  }
+  // sin_port and sin6_port are at the same offset.
+  ai_addr->sin6_port = port;
 
   if(hints && hints->ai_socktype)
     ai->ai_socktype = hints->ai_socktype;
@@ -538,48 +969,70 @@ addrinfo* FileSystem::GetFakeAddress(const char* hostname, uint16_t port,
 
 int FileSystem::getaddrinfo(const char* hostname, const char* servname,
     const addrinfo* hints, addrinfo** res) {
-  Mutex::Lock lock(mutex_);
-  GetAddrInfoParams params;
-  params.hostname = hostname;
-  params.servname = servname;
-  params.hints = hints;
-  params.res = res;
-  int32_t result = PP_OK_COMPLETIONPENDING;
-  pp::Module::Get()->core()->CallOnMainThread(0, factory_.NewCallback(
-      &FileSystem::Resolve, &params, &result));
-  while(result == PP_OK_COMPLETIONPENDING)
-    cond_.wait(mutex_);
-  return result == PP_OK ? 0 : EAI_FAIL;
+  SyscallTimer timer(Stats::kGetAddrInfo);
+  int family = hints ? hints->ai_family : AF_UNSPEC;
+  if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+    return EAI_FAIL;
+
+  uint16_t port = 0;
+  if (servname != NULL) {
+    char* cp;
+    long value = strtol(servname, &cp, 10);
+    if (value > 0 && value <= 65535 && *cp == '\0')
+      port = htons(value);
+    else
+      LOG("Bad port number %s\n", servname);
+  }
+
+  in6_addr in = {};
+  bool needs_lookup = hostname &&
+      !inet_pton(family == AF_INET6 ? AF_INET6 : AF_INET, hostname, &in) &&
+      !(hints && hints->ai_flags & (AI_PASSIVE | AI_NUMERICHOST));
+
+  {
+    Mutex::Lock lock(mutex_);
+    // In case of JS socket don't use local host resolver.
+    if (!needs_lookup || use_js_socket_ || !resolver_->is_available()) {
+      GetAddrInfoParams params;
+      params.hostname = hostname;
+      params.port = port;
+      params.hints = hints;
+      params.res = res;
+      int32_t result = PP_OK_COMPLETIONPENDING;
+      pp::Module::Get()->core()->CallOnMainThread(0, factory_.NewCallback(
+          &FileSystem::Resolve, &params, &result));
+      while(result == PP_OK_COMPLETIONPENDING)
+        cond_.wait(mutex_);
+      return result == PP_OK ? 0 : EAI_FAIL;
+    }
+  }
+
+  Resolver::Result answer;
+  resolver_->Lookup(hostname, family, &answer);
+  if (answer.result != PP_OK) {
+    Mutex::Lock lock(mutex_);
+    *res = GetFakeAddress(hostname, port, hints);
+    return 0;
+  }
+
+  const char* name = "";
+  if (hints && hints->ai_flags & AI_CANONNAME)
+    name = answer.canonical_name.c_str();
+  for (size_t i = 0; i < answer.addrs.size(); i++) {
+    *res = CreateAddrInfo(answer.addrs[i], port, hints, name);
+    res = &(*res)->ai_next;
+  }
+  return 0;
 }
 
 void FileSystem::Resolve(int32_t result, GetAddrInfoParams* params,
                          int32_t* pres) {
   Mutex::Lock lock(mutex_);
   const char* hostname = params->hostname;
-  const char* servname = params->servname;
+  uint16_t port = params->port;
   const addrinfo* hints = params->hints;
   addrinfo** res = params->res;
 
-  if (hints && hints->ai_family != AF_UNSPEC &&
-      hints->ai_family != AF_INET &&
-      hints->ai_family != AF_INET6) {
-    *pres = PP_ERROR_FAILED;
-    cond_.broadcast();
-    return;
-  }
-
-  long port = 0;
-  if (servname != NULL) {
-    char* cp;
-    port = strtol(servname, &cp, 10);
-    if (port > 0 && port <= 65535 && *cp == '\0') {
-      port = htons(port);
-    } else {
-      LOG("Bad port number %s\n", servname);
-      port = 0;
-    }
-  }
-
   bool is_ipv6 = hints ? hints->ai_family == AF_INET6 : false;
   in6_addr in = {};
   bool is_numeric = hostname &&
@@ -661,60 +1114,8 @@ void FileSystem::Resolve(int32_t result, GetAddrInfoParams* params,
     return;
   }
 
-  // In case of JS socket don't use local host resolver.
-  if (!use_js_socket_ && pp::HostResolverPrivate::IsAvailable()) {
-    PP_HostResolver_Private_Hint hint = { PP_NETADDRESSFAMILY_UNSPECIFIED, 0 };
-    if (hints) {
-      if (hints->ai_family == AF_INET)
-        hint.family = PP_NETADDRESSFAMILY_IPV4;
-      else if (hints->ai_family == AF_INET6)
-        hint.family = PP_NETADDRESSFAMILY_IPV6;
-      if (hints->ai_flags & AI_CANONNAME)
-        hint.flags = PP_HOST_RESOLVER_FLAGS_CANONNAME;
-    }
-
-    assert(host_resolver_ == NULL);
-    host_resolver_ = new pp::HostResolverPrivate(instance_);
-    *pres = host_resolver_->Resolve(hostname, port, hint,
-        factory_.NewCallback(&FileSystem::OnResolve, params, pres));
-    if (*pres != PP_OK_COMPLETIONPENDING) {
-      delete host_resolver_;
-      host_resolver_ = NULL;
-      cond_.broadcast();
-    }
-  } else {
-    *res = GetFakeAddress(hostname, port, hints);
-    *pres = PP_OK;
-    cond_.broadcast();
-    return;
-  }
-}
-
-void FileSystem::OnResolve(int32_t result, GetAddrInfoParams* params,
-                           int32_t* pres) {
-  Mutex::Lock lock(mutex_);
-  assert(host_resolver_);
-  const addrinfo* hints = params->hints;
-  addrinfo** res = params->res;
-  std::string host_name = host_resolver_->GetCanonicalName().AsString();
-  if (result == PP_OK) {
-    size_t size  = host_resolver_->GetSize();
-    for (size_t i = 0; i < size; i++) {
-      PP_NetAddress_Private address = {};
-      if (host_resolver_->GetNetAddress(i, &address)) {
-        *res = CreateAddrInfo(address, hints, host_name.c_str());
-        res = &(*res)->ai_next;
-      }
-    }
-  } else {
-    char* cp;
-    uint16_t port = htons(strtol(params->servname, &cp, 10));
-    *res = GetFakeAddress(params->hostname, port, hints);
-    result = PP_OK;
-  }
-  delete host_resolver_;
-  host_resolver_ = NULL;
-  *pres = result;
+  *res = GetFakeAddress(hostname, port, hints);
+  *pres = PP_OK;
   cond_.broadcast();
 }
 
@@ -748,33 +1149,41 @@ int FileSystem::getnameinfo(const sockaddr *sa, socklen_t salen,
 }
 
 int FileSystem::socket(int socket_family, int socket_type, int protocol) {
-  Mutex::Lock lock(mutex_);
-  int fd = GetFirstUnusedDescriptor();
+  int fd;
+  {
+    Mutex::Lock lock(mutex_);
+    fd = GetFirstUnusedDescriptor();
 
-  if (socket_family == AF_INET || socket_family == AF_INET6) {
-    if (socket_type == SOCK_STREAM) {
-      // Mark descriptor as used. We should put a TCPSocket here, but
-      // TCPSocket and TCPServer socket are implemented by different
-      // classes, so the fd is in an awkward state right now..
-      AddFileStream(fd, NULL);
-    } else if (socket_type == SOCK_DGRAM) {
-      // Mark descriptor as used, so UDPSocket's ctor can block if it
-      // wants.
-      AddFileStream(fd, NULL);
-      UDPSocket* sock = new UDPSocket(socket_family, socket_type, fd, O_RDWR);
-      if (!sock->open()) {
-        RemoveFileStream(fd);
-        delete sock;
-        return -1;
-      }
-      AddFileStream(fd, sock);
-    } else {
+    if (socket_family != AF_INET && socket_family != AF_INET6) {
+      errno = EAFNOSUPPORT;
+      return -1;
+    }
+    if (socket_type != SOCK_STREAM && socket_type != SOCK_DGRAM) {
       errno = EPROTONOSUPPORT;
       return -1;
     }
-  } else {
-    errno = EAFNOSUPPORT;
-    return -1;
+
+    // Mark descriptor as used. For SOCK_STREAM we should put a TCPSocket
+    // here, but TCPSocket and TCPServer socket are implemented by
+    // different classes, so the fd is in an awkward state right now..
+    AddFileStream(fd, NULL);
+  }
+
+  if (socket_type == SOCK_DGRAM) {
+    UDPSocket* sock = new UDPSocket(socket_family, socket_type, fd, O_RDWR);
+    bool opened;
+    {
+      Mutex::Lock lock(sock->mutex());
+      opened = sock->open();
+    }
+
+    Mutex::Lock lock(mutex_);
+    if (!opened) {
+      RemoveFileStream(fd);
+      delete sock;
+      return -1;
+    }
+    AddFileStream(fd, sock);
   }
   return fd;
 }
@@ -803,63 +1212,112 @@ bool FileSystem::GetHostPort(const sockaddr* serv_addr, socklen_t addrlen,
 }
 
 int FileSystem::connect(int fd, const sockaddr* serv_addr, socklen_t addrlen) {
-  Mutex::Lock lock(mutex_);
-  if (streams_.find(fd) == streams_.end()) {
-    errno = EBADF;
-    return -1;
-  }
-
+  SyscallTimer timer(Stats::kConnect);
   uint16_t port;
   std::string hostname;
-  if (!GetHostPort(serv_addr, addrlen, &hostname, &port)) {
-    errno = EAFNOSUPPORT;
-    return -1;
+  bool use_js_socket;
+  int oflag = O_RDWR;
+  {
+    // Only TCP sockets get a stream on connect, so this is a second
+    // connect. The stream's lock can't be taken under mutex_.
+    ScopedStream stream(AcquireStream(fd));
+    if (stream.get()) {
+      Mutex::Lock lock(stream->mutex());
+      if (stream->stream_type() == Stats::kTcpSocket)
+        errno = static_cast<TCPSocket*>(stream.get())->GetConnectError();
+      else
+        errno = EISCONN;
+      return -1;
+    }
   }
-  LOG("FileSystem::connect: [%s] port %d\n", hostname.c_str(), port);
+  {
+    Mutex::Lock lock(mutex_);
+    if (!IsKnowDescriptor(fd)) {
+      errno = EBADF;
+      return -1;
+    }
+    if (GetStream(fd)) {
+      // Another thread's connect got there first.
+      errno = EALREADY;
+      return -1;
+    }
+
+    if (!GetHostPort(serv_addr, addrlen, &hostname, &port)) {
+      errno = EAFNOSUPPORT;
+      return -1;
+    }
 
-  FileStream* stream = NULL;
-  if (use_js_socket_) {
     // Only first socket will use JS proxy, other sockets are created for
     // connections made localhost so use Pepper sockets for them.
+    use_js_socket = use_js_socket_;
     use_js_socket_ = false;
+
+    ReservedFlagsMap::iterator it = reserved_oflags_.find(fd);
+    if (it != reserved_oflags_.end()) {
+      oflag = it->second;
+      reserved_oflags_.erase(it);
+    }
+  }
+  LOG("FileSystem::connect: [%s] port %d\n", hostname.c_str(), port);
+
+  // Try the other addresses the name resolved to alongside this one.
+  std::vector<sockaddr_in6> addrs;
+  if (!use_js_socket)
+    resolver_->GetConnectOrder(serv_addr, &addrs);
+
+  FileStream* stream = NULL;
+  int error;
+  if (use_js_socket) {
     JsSocket* socket = new JsSocket(O_RDWR, output_);
-    if (!socket->connect(fd, hostname.c_str(), port)) {
-      errno = ECONNREFUSED;
-      socket->release();
-      return -1;
+    {
+      Mutex::Lock lock(socket->mutex());
+      error = socket->connect(fd, hostname.c_str(), port) ? 0 : ECONNREFUSED;
     }
     stream = socket;
   } else {
-    TCPSocket* socket = new TCPSocket(fd, O_RDWR);
-    if (!socket->connect(hostname.c_str(), port)) {
-      errno = ECONNREFUSED;
-      socket->release();
-      return -1;
+    TCPSocket* socket = new TCPSocket(fd, oflag);
+    {
+      Mutex::Lock lock(socket->mutex());
+      if (!addrs.empty())
+        error = socket->connect(addrs, port);
+      else
+        error = socket->connect(hostname.c_str(), port);
     }
     stream = socket;
   }
 
+  if (error && error != EINPROGRESS) {
+    errno = error;
+    stream->release();
+    return -1;
+  }
+
+  Mutex::Lock lock(mutex_);
   AddFileStream(fd, stream);
+  if (error) {
+    // Finishes in the background; select() reports it writable when done.
+    errno = error;
+    return -1;
+  }
   return 0;
 }
 
 int FileSystem::shutdown(int fd, int how) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(fd);
-  if (stream && stream != kBadFileStream) {
-    // Actually shutdown should be something more complicated but for now
-    // it works. Method close can be called multiple time.
-    stream->close();
-    return 0;
-  } else {
+  ScopedStream stream(AcquireStream(fd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
+  // Actually shutdown should be something more complicated but for now
+  // it works. Method close can be called multiple time.
+  Mutex::Lock lock(stream->mutex());
+  stream->close();
+  return 0;
 }
 
 int FileSystem::bind(int fd, const sockaddr* addr, socklen_t addrlen) {
   Mutex::Lock lock(mutex_);
-  if (streams_.find(fd) == streams_.end()) {
+  if (!IsKnowDescriptor(fd)) {
     errno = EBADF;
     return -1;
   }
@@ -868,67 +1326,204 @@ int FileSystem::bind(int fd, const sockaddr* addr, socklen_t addrlen) {
 }
 
 int FileSystem::listen(int sockfd, int backlog) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(sockfd);
-  if (stream && stream != kBadFileStream) {
-    if (static_cast<TCPServerSocket*>(stream)->listen(backlog)) {
-      return 0;
-    } else {
-      errno = EACCES;
-      return -1;
-    }
-  } else {
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
+  Mutex::Lock lock(stream->mutex());
+  if (static_cast<TCPServerSocket*>(stream.get())->listen(backlog)) {
+    return 0;
+  } else {
+    errno = EACCES;
+    return -1;
+  }
 }
 
 int FileSystem::accept(int sockfd, sockaddr* addr, socklen_t* addrlen) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(sockfd);
-  if (stream && stream != kBadFileStream) {
-    PP_Resource resource = static_cast<TCPServerSocket*>(stream)->accept();
-    if (resource) {
-      int fd = GetFirstUnusedDescriptor();
-      TCPSocket* socket = new TCPSocket(fd, O_RDWR);
-      if (socket->accept(resource)) {
-        AddFileStream(fd, socket);
-        return fd;
-      } else {
-        socket->release();
-      }
+  SyscallTimer timer(Stats::kAccept);
+  PP_Resource resource;
+  {
+    ScopedStream stream(AcquireStream(sockfd));
+    if (!stream.get()) {
+      errno = EBADF;
+      return -1;
     }
+    Mutex::Lock lock(stream->mutex());
+    resource = static_cast<TCPServerSocket*>(stream.get())->accept();
+  }
+  if (!resource) {
     errno = EINVAL;
     return -1;
-  } else {
-    errno = EBADF;
+  }
+
+  int fd;
+  {
+    Mutex::Lock lock(mutex_);
+    fd = GetFirstUnusedDescriptor();
+    AddFileStream(fd, NULL);
+  }
+
+  TCPSocket* socket = new TCPSocket(fd, O_RDWR);
+  bool accepted;
+  {
+    Mutex::Lock lock(socket->mutex());
+    accepted = socket->accept(resource);
+  }
+
+  if (!accepted) {
+    socket->release();
+    Mutex::Lock lock(mutex_);
+    RemoveFileStream(fd);
+    errno = EINVAL;
     return -1;
   }
+
+  Mutex::Lock lock(mutex_);
+  AddFileStream(fd, socket);
+  return fd;
 }
 
 ssize_t FileSystem::recvfrom(int sockfd, void *buf, size_t len, int flags,
                              sockaddr *src_addr, socklen_t *addrlen) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(sockfd);
-  if (!stream || stream == kBadFileStream) {
+  SyscallTimer timer(Stats::kRecvFrom);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
-  return stream->recvfrom(buf, len, flags, src_addr, addrlen);
+  Mutex::Lock lock(stream->mutex());
+  ssize_t ret = stream->recvfrom(buf, len, flags, src_addr, addrlen);
+  if (ret >= 0)
+    Stats::Get()->RecordRead(stream->stream_type(), ret, timer.elapsed());
+  return ret;
 }
 
 ssize_t FileSystem::sendto(int sockfd, const void *buf, size_t len, int flags,
                            const sockaddr *dest_addr,
                            socklen_t addrlen) {
-  Mutex::Lock lock(mutex_);
-  FileStream* stream = GetStream(sockfd);
-  if (!stream || stream == kBadFileStream) {
+  SyscallTimer timer(Stats::kSendTo);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
+    errno = EBADF;
+    return -1;
+  }
+  Mutex::Lock lock(stream->mutex());
+  ssize_t ret = stream->sendto(buf, len, flags, dest_addr, addrlen);
+  if (ret >= 0)
+    Stats::Get()->RecordWrite(stream->stream_type(), ret, timer.elapsed());
+  return ret;
+}
+
+ssize_t FileSystem::recvmsg(int sockfd, msghdr* msg, int flags) {
+  SyscallTimer timer(Stats::kRecvMsg);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
+    errno = EBADF;
+    return -1;
+  }
+  Mutex::Lock lock(stream->mutex());
+  ssize_t ret = stream->recvmsg(msg, flags);
+  if (ret >= 0)
+    Stats::Get()->RecordRead(stream->stream_type(), ret, timer.elapsed());
+  return ret;
+}
+
+ssize_t FileSystem::sendmsg(int sockfd, const msghdr* msg, int flags) {
+  SyscallTimer timer(Stats::kSendMsg);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
+    errno = EBADF;
+    return -1;
+  }
+  Mutex::Lock lock(stream->mutex());
+  ssize_t ret = stream->sendmsg(msg, flags);
+  if (ret >= 0)
+    Stats::Get()->RecordWrite(stream->stream_type(), ret, timer.elapsed());
+  return ret;
+}
+
+int FileSystem::recvmmsg(int sockfd, mmsghdr* msgvec, unsigned int vlen,
+                         int flags, const timespec* timeout) {
+  SyscallTimer timer(Stats::kRecvMmsg);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
     errno = EBADF;
     return -1;
   }
-  return stream->sendto(buf, len, flags, dest_addr, addrlen);
+  timespec ts_abs;
+  if (timeout)
+    GetDeadline(*timeout, &ts_abs);
+
+  Mutex::Lock lock(stream->mutex());
+  unsigned int count = 0;
+  size_t bytes = 0;
+  while (count < vlen) {
+    ssize_t ret = stream->recvmsg(&msgvec[count].msg_hdr, flags);
+    if (ret < 0)
+      break;
+    msgvec[count].msg_len = ret;
+    bytes += ret;
+    count++;
+    if (flags & MSG_WAITFORONE)
+      flags |= MSG_DONTWAIT;
+    if (timeout) {
+      timeval now;
+      gettimeofday(&now, NULL);
+      if (now.tv_sec > ts_abs.tv_sec ||
+          (now.tv_sec == ts_abs.tv_sec &&
+           now.tv_usec * kNanosecondsPerMicrosecond >= ts_abs.tv_nsec)) {
+        break;
+      }
+    }
+  }
+  if (count)
+    Stats::Get()->RecordRead(stream->stream_type(), bytes, timer.elapsed());
+  // Errors after the first message are left for the next call.
+  return count ? count : -1;
+}
+
+int FileSystem::sendmmsg(int sockfd, mmsghdr* msgvec, unsigned int vlen,
+                         int flags) {
+  SyscallTimer timer(Stats::kSendMmsg);
+  ScopedStream stream(AcquireStream(sockfd));
+  if (!stream.get()) {
+    errno = EBADF;
+    return -1;
+  }
+  Mutex::Lock lock(stream->mutex());
+  unsigned int count = 0;
+  size_t bytes = 0;
+  for (; count < vlen; count++) {
+    ssize_t ret = stream->sendmsg(&msgvec[count].msg_hdr, flags);
+    if (ret < 0)
+      break;
+    msgvec[count].msg_len = ret;
+    bytes += ret;
+  }
+  if (count)
+    Stats::Get()->RecordWrite(stream->stream_type(), bytes, timer.elapsed());
+  return count ? count : -1;
 }
 
+int FileSystem::getsockopt(int sockfd, int level, int optname,
+                           void* optval, socklen_t* optlen) {
+  ScopedStream stream(AcquireStream(sockfd));
+  if (stream.get()) {
+    Mutex::Lock lock(stream->mutex());
+    return stream->getsockopt(level, optname, optval, optlen);
+  }
+
+  Mutex::Lock lock(mutex_);
+  if (IsKnowDescriptor(sockfd)) {
+    // Socket with reserved FD but not allocated yet.
+    memset(optval, 0, *optlen);
+    return 0;
+  } else {
+    errno = EBADF;
+    return -1;
+  }
+}
 
 int FileSystem::mkdir(const char* pathname, mode_t mode) {
   Mutex::Lock lock(mutex_);
@@ -997,6 +1592,8 @@ void FileSystem::SetTerminalSize(unsigned short col, unsigned short row) {
   row_ = row;
   is_resize_ = true;
   cond_.broadcast();
+  for (size_t i = 0; i < select_waiters_.size(); i++)
+    select_waiters_[i]->Wake();
 }
 
 bool FileSystem::GetTerminalSize(unsigned short* col, unsigned short* row) {
@@ -1008,5 +1605,6 @@ bool FileSystem::GetTerminalSize(unsigned short* col, unsigned short* row) {
 }
 
 void FileSystem::UseJsSocket(bool use_js) {
+  Mutex::Lock lock(mutex_);
   use_js_socket_ = use_js;
 }
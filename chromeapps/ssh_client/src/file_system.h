@@ -9,8 +9,10 @@
 #include <errno.h>
 #include <memory.h>
 #include <netdb.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <termios.h>
@@ -18,14 +20,26 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "ppapi/cpp/file_ref.h"
 #include "ppapi/cpp/file_system.h"
-#include "ppapi/cpp/private/host_resolver_private.h"
 #include "ppapi/utility/completion_callback_factory.h"
 
 #include "file_interfaces.h"
 #include "pthread_helpers.h"
+#include "resolver.h"
+
+// Older glibc headers, which the NaCl toolchain may have, predate
+// recvmmsg and sendmmsg. FileSystem implements them itself, so only the
+// types are needed.
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0x10000
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+#endif
 
 class FileSystem {
  public:
@@ -40,8 +54,6 @@ class FileSystem {
   // Same as above function but return NULL if FileSystem doesn't exist yet.
   static FileSystem* GetFileSystemNoCrash();
 
-  Cond& cond() { return cond_; }
-  Mutex& mutex() { return mutex_; }
   pp::Instance* instance() { return instance_; }
 
   void SetTerminalSize(unsigned short col, unsigned short row);
@@ -55,6 +67,8 @@ class FileSystem {
   int close(int fd);
   int read(int fd, char* buf, size_t count, size_t* nread);
   int write(int fd, const char* buf, size_t count, size_t* nwrote);
+  int readv(int fd, const iovec* iov, int iovcnt, size_t* nread);
+  int writev(int fd, const iovec* iov, int iovcnt, size_t* nwrote);
   int seek(int fd, nacl_abi_off_t offset, int whence,
            nacl_abi_off_t* new_offset);
   int dup(int fd, int *newfd);
@@ -62,6 +76,7 @@ class FileSystem {
   int fstat(int fd, nacl_abi_stat* out);
   int stat(const char *pathname, nacl_abi_stat* out);
   int getdents(int fd, dirent*, size_t count, size_t* nread);
+  int fsync(int fd);
 
   int isatty(int fd);
   int tcgetattr(int fd, struct termios* termios_p);
@@ -70,6 +85,13 @@ class FileSystem {
   int ioctl(int fd, int request, va_list ap);
   int select(int nfds, fd_set *readfds, fd_set *writefds,
              fd_set *exceptfds, struct timeval *timeout);
+  // |timeout| is relative; NULL waits forever.
+  int poll(pollfd* fds, nfds_t nfds, const timespec* timeout);
+
+  int epoll_create(int flags);
+  int epoll_ctl(int epfd, int op, int fd, epoll_event* event);
+  int epoll_wait(int epfd, epoll_event* events, int maxevents,
+                 const timespec* timeout);
 
   int getaddrinfo(const char* hostname, const char* servname,
                   const addrinfo* hints, addrinfo** res);
@@ -88,6 +110,16 @@ class FileSystem {
                    sockaddr *src_addr, socklen_t *addrlen);
   ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
                  const sockaddr *dest_addr, socklen_t addrlen);
+  ssize_t recvmsg(int sockfd, msghdr* msg, int flags);
+  ssize_t sendmsg(int sockfd, const msghdr* msg, int flags);
+  // Move up to |vlen| messages in one go. As on Linux, recvmmsg checks
+  // the relative |timeout| only after each message, so a blocking
+  // receive can still wait past it.
+  int recvmmsg(int sockfd, mmsghdr* msgvec, unsigned int vlen, int flags,
+               const timespec* timeout);
+  int sendmmsg(int sockfd, mmsghdr* msgvec, unsigned int vlen, int flags);
+  int getsockopt(int sockfd, int level, int optname,
+                 void* optval, socklen_t* optlen);
 
   int mkdir(const char* pathname, mode_t mode);
 
@@ -97,14 +129,27 @@ class FileSystem {
   void exit(int status);
 
  private:
-  typedef std::map<int, FileStream*> FileStreamMap;
   typedef std::map<std::string, PathHandler*> PathHandlerMap;
   typedef std::map<std::string, unsigned long> HostMap;
   typedef std::map<unsigned long, std::string> AddressMap;
+  typedef std::map<int, int> ReservedFlagsMap;
+
+  // A descriptor passed to select() or poll(), the events it was asked
+  // about and which of them were ready when last checked.
+  struct SelectEntry {
+    int fd;
+    FileStream* stream;
+    bool read;
+    bool write;
+    bool except;
+    bool read_ready;
+    bool write_ready;
+    bool except_ready;
+  };
 
   struct GetAddrInfoParams {
     const char* hostname;
-    const char* servname;
+    uint16_t port;
     const struct addrinfo* hints;
     struct addrinfo** res;
   };
@@ -117,17 +162,27 @@ class FileSystem {
 
   bool IsKnowDescriptor(int fd);
   FileStream* GetStream(int fd);
+  // Removes |fd| from every epoll set it is registered in under |stream|.
+  // Called after |fd| has been closed, without mutex_ held.
+  void RemoveFromEpollSets(int fd, FileStream* stream);
+  // Returns the stream for |fd| with a reference added, or NULL if |fd|
+  // is not an open stream. The caller must release() the result.
+  FileStream* AcquireStream(int fd);
 
   uint32_t AddHostAddress(const char* name, uint32_t addr);
   addrinfo* CreateAddrInfo(const PP_NetAddress_Private& addr,
                            const addrinfo* hints,
                            const char* name);
+  // |port| is in network byte order.
+  addrinfo* CreateAddrInfo(const sockaddr_in6& addr, uint16_t port,
+                           const addrinfo* hints,
+                           const char* name);
   addrinfo* GetFakeAddress(const char* hostname, uint16_t port,
                            const addrinfo* hints);
   bool GetHostPort(const sockaddr* serv_addr, socklen_t addrlen,
                    std::string* hostname, uint16_t* port);
+  // Handles the getaddrinfo cases that don't need a name lookup.
   void Resolve(int32_t result, GetAddrInfoParams* params, int32_t* pres);
-  void OnResolve(int32_t result, GetAddrInfoParams* params, int32_t* pres);
 
   void OnOpen(int32_t result, pp::FileSystem* fs);
 
@@ -135,27 +190,55 @@ class FileSystem {
   void OnMakeDirectory(int32_t result, pp::FileRef* file_ref, int32_t* pres);
 
   int GetFirstUnusedDescriptor();
-  int IsReady(int nfds, fd_set* fds, bool (FileStream::*is_ready)(),
-              bool apply);
+  // Blocks until one of |entries| is ready, the terminal is resized or
+  // the relative |timeout| passes, leaving each entry's readiness filled
+  // in. Returns 0 or an errno value.
+  int WaitForEntries(std::vector<SelectEntry>* entries,
+                     const timespec* timeout);
+  // Runs the SIGWINCH handler if the terminal was resized. Returns true
+  // if it ran and the waiting call should fail with EINTR.
+  bool DeliverResize();
+  // Refreshes the readiness of |entry| and returns whether any of its
+  // events are ready. Must be called with entry->stream's lock held.
+  static bool UpdateReadiness(SelectEntry* entry);
 
   static const int kFileIDOffset = 100;
+  // dup2() refuses target descriptors at or above this, so the table
+  // can't be grown without bound.
+  static const int kMaxDescriptors = 65536;
   static const unsigned long kFirstAddr = 0x00000000;
 
   static FileSystem* file_system_;
 
   pp::Instance* instance_;
   OutputInterface* output_;
+  // Guards the descriptor table and the rest of the FileSystem state
+  // below. Streams have their own locks; mutex_ may be taken while
+  // holding a stream's lock but never the other way around.
   Cond cond_;
   Mutex mutex_;
 
   PathHandlerMap paths_;
-  FileStreamMap streams_;
+  // The descriptor table, indexed by fd. Free and reserved descriptors
+  // both hold NULL; used_ has a bit set for every descriptor that is
+  // open or reserved. Descriptors below kFileIDOffset are only ever
+  // assigned explicitly (stdio, dup2), never allocated.
+  std::vector<FileStream*> streams_;
+  std::vector<uint32_t> used_;
+  // No word of used_ before this one has a free bit at or above
+  // kFileIDOffset.
+  size_t first_free_word_;
   pp::FileSystem* ppfs_;
   PathHandler* ppfs_path_handler_;
   bool fs_initialized_;
   pp::CompletionCallbackFactory<FileSystem, ThreadSafeRefCount> factory_;
 
-  pp::HostResolverPrivate* host_resolver_;
+  // Looks up and caches host names for getaddrinfo. Has its own lock, so
+  // lookups don't hold mutex_.
+  Resolver* resolver_;
+
+  // fcntl() flags set on sockets that don't have a stream yet.
+  ReservedFlagsMap reserved_oflags_;
 
   HostMap hosts_;
   AddressMap addrs_;
@@ -166,6 +249,8 @@ class FileSystem {
   unsigned short row_;
   bool is_resize_;
   void (*handler_sigwinch_)(int);
+  // Threads blocked in select(), woken on terminal resize.
+  std::vector<StreamWaiter*> select_waiters_;
 
   DISALLOW_COPY_AND_ASSIGN(FileSystem);
 };
@@ -12,6 +12,7 @@
 #include "ppapi/cpp/module.h"
 
 #include "file_system.h"
+#include "task_queue.h"
 
 termios JsFile::tio_ = {};
 
@@ -43,11 +44,15 @@ FileStream* JsFileHandler::open(int fd, const char* pathname, int oflag) {
   pp::Module::Get()->core()->CallOnMainThread(
       0, factory_.NewCallback(&JsFileHandler::Open, fd, stream, fullpath.c_str()));
 
-  FileSystem* sys = FileSystem::GetFileSystem();
-  while(!stream->is_open())
-    sys->cond().wait(sys->mutex());
+  bool failed;
+  {
+    Mutex::Lock lock(stream->mutex());
+    while(!stream->is_open())
+      stream->cond().wait(stream->mutex());
+    failed = stream->stream_id() == -1;
+  }
 
-  if (stream->stream_id() == -1) {
+  if (failed) {
     stream->release();
     return NULL;
   }
@@ -73,17 +78,15 @@ JsFile::~JsFile() {
 }
 
 void JsFile::OnOpen(int stream_id) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   is_open_ = true;
   stream_id_ = stream_id;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void JsFile::OnRead(const char* buf, size_t size) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  in_buf_.insert(in_buf_.end(), buf, buf + size);
+  Mutex::Lock lock(mutex());
+  in_buf_.Append(buf, size);
   // TODO(dpolukhin): implement simple line editing.
   if (isatty() && (tio_.c_lflag & ECHO)) {
     for (size_t i = 0; i < size; i++) {
@@ -94,32 +97,33 @@ void JsFile::OnRead(const char* buf, size_t size) {
       }
     }
   }
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void JsFile::OnWriteAcknowledge(uint64_t count) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(write_acknowledged_ <= write_sent_);
   write_acknowledged_ = count;
   PostWriteTask(false);
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void JsFile::OnClose() {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   is_open_ = false;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void JsFile::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void JsFile::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -130,11 +134,10 @@ void JsFile::close() {
     pp::Module::Get()->core()->CallOnMainThread(0,
         factory_.NewCallback(&JsFile::Close));
 
-    FileSystem* sys = FileSystem::GetFileSystem();
     while(out_task_sent_)
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
     while(is_open_)
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
 
     stream_id_ = -1;
   }
@@ -142,24 +145,15 @@ void JsFile::close() {
 
 int JsFile::read(char* buf, size_t count, size_t* nread) {
   if (is_open() && in_buf_.empty()) {
-    pp::Module::Get()->core()->CallOnMainThread(0,
-        factory_.NewCallback(&JsFile::Read, count));
+    TaskQueue::Get()->Post(factory_.NewCallback(&JsFile::Read, count));
   }
 
-  FileSystem* sys = FileSystem::GetFileSystem();
   if (is_block()) {
     while(is_open() && in_buf_.empty())
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
   }
 
-  *nread = 0;
-  while (*nread < count) {
-    if (in_buf_.empty())
-      break;
-
-    buf[(*nread)++] = in_buf_.front();
-    in_buf_.pop_front();
-  }
+  *nread = in_buf_.Read(buf, count);
 
   if (*nread == 0 && !is_block() && is_open()) {
     *nread = -1;
@@ -173,21 +167,42 @@ int JsFile::write(const char* buf, size_t count, size_t* nwrote) {
   if (!is_open())
     return EIO;
 
-  out_buf_.insert(out_buf_.end(), buf, buf + count);
+  AppendOutput(buf, count);
+  *nwrote = count;
+  PostWriteTask(true);
+  return 0;
+}
+
+int JsFile::writev(const iovec* iov, int iovcnt, size_t* nwrote) {
+  if (!is_open())
+    return EIO;
+
+  *nwrote = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    AppendOutput(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    *nwrote += iov[i].iov_len;
+  }
+  PostWriteTask(true);
+  return 0;
+}
 
+void JsFile::AppendOutput(const char* buf, size_t count) {
   if (isatty() && (tio_.c_lflag & ICANON)) {
-    // It could be performance issue to do this conversion in-place but
-    // fortunately it's used only for first few lines like password prompt.
-    for (size_t i = out_buf_.size() - count; i < out_buf_.size(); i++) {
-      if (out_buf_[i] == '\n') {
-        out_buf_.insert(out_buf_.begin() + i++, '\r');
+    // Translate LF to CRLF, copying the runs in between in bulk.
+    const char* end = buf + count;
+    for (const char* p = buf; p < end; ) {
+      const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (!nl) {
+        out_buf_.Append(p, end - p);
+        break;
       }
+      out_buf_.Append(p, nl - p);
+      out_buf_.Append("\r\n", 2);
+      p = nl + 1;
     }
+  } else {
+    out_buf_.Append(buf, count);
   }
-
-  *nwrote = count;
-  PostWriteTask(true);
-  return 0;
 }
 
 int JsFile::fstat(nacl_abi_stat* out) {
@@ -279,8 +294,7 @@ void JsFile::PostWriteTask(bool always_post) {
   if (!out_task_sent_ && !out_buf_.empty() &&
       (write_sent_ - write_acknowledged_) < out_->GetWriteWindow()) {
     if (always_post || !pp::Module::Get()->core()->IsMainThread()) {
-      pp::Module::Get()->core()->CallOnMainThread(
-          0, factory_.NewCallback(&JsFile::Write));
+      TaskQueue::Get()->Post(factory_.NewCallback(&JsFile::Write));
       out_task_sent_ = true;
     } else {
       // If on main Pepper thread and delay is not required call it directly.
@@ -294,8 +308,7 @@ void JsFile::Read(int32_t result, size_t size) {
 }
 
 void JsFile::Write(int32_t result) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   out_task_sent_ = false;
 
   size_t count = std::min(
@@ -307,19 +320,22 @@ void JsFile::Write(int32_t result) {
     return;
   }
 
-  // Use temporary buffer in vector because std::deque doesn't use continuous
-  // memory inside. Alternative solution is to use vector as out_buf_ but erase
-  // below will require copy for the whole remaining bytes (will be slow with
-  // small writeWindow).
-  std::vector<char> buf(out_buf_.begin(), out_buf_.begin() + count);
-  if (out_->Write(stream_id_, &buf[0], count)) {
-    write_sent_ += count;
-    out_buf_.erase(out_buf_.begin(), out_buf_.begin() + count);
-    sys->cond().broadcast();
-  } else {
-    assert(0);
-    PostWriteTask(true);
+  // Hand the queue's memory straight to the bridge. If the data wraps
+  // around the ring it goes out in two pieces.
+  while (count) {
+    size_t span;
+    const char* data = out_buf_.Peek(&span);
+    span = std::min(span, count);
+    if (!out_->Write(stream_id_, data, span)) {
+      assert(0);
+      PostWriteTask(true);
+      break;
+    }
+    write_sent_ += span;
+    out_buf_.Consume(span);
+    count -= span;
   }
+  NotifyStateChanged();
 }
 
 void JsFile::Close(int32_t result) {
@@ -338,9 +354,8 @@ JsSocket::~JsSocket() {
 bool JsSocket::connect(int fd, const char* host, uint16_t port) {
   pp::Module::Get()->core()->CallOnMainThread(
       0, factory_.NewCallback(&JsSocket::Connect, fd, host, port));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(!is_open())
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
 
   if (stream_id() == -1)
     return false;
@@ -354,7 +369,6 @@ bool JsSocket::is_read_ready() {
 
 void JsSocket::Connect(int32_t result, int fd,
                        const char* host, uint16_t port) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   out_->OpenSocket(fd, host, port, this);
 }
@@ -5,10 +5,9 @@
 #ifndef JS_FILE_H
 #define JS_FILE_H
 
-#include <queue>
-
 #include "ppapi/cpp/completion_callback.h"
 
+#include "byte_queue.h"
 #include "file_system.h"
 #include "pthread_helpers.h"
 
@@ -33,9 +32,14 @@ class JsFile : public FileStream,
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kJsFile;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
+  virtual int writev(const iovec* iov, int iovcnt, size_t* nwrote);
   virtual int fstat(nacl_abi_stat* out);
 
   virtual int isatty();
@@ -48,6 +52,8 @@ class JsFile : public FileStream,
   virtual bool is_write_ready();
 
  protected:
+  // Queues |count| bytes for JS, translating newlines for the terminal.
+  void AppendOutput(const char* buf, size_t count);
   void PostWriteTask(bool always_post);
 
   void Read(int32_t result, size_t size);
@@ -59,8 +65,8 @@ class JsFile : public FileStream,
   int oflag_;
   OutputInterface* out_;
   pp::CompletionCallbackFactory<JsFile, ThreadSafeRefCount> factory_;
-  std::deque<char> in_buf_;
-  std::deque<char> out_buf_;
+  ByteQueue in_buf_;
+  ByteQueue out_buf_;
   bool out_task_sent_;
   bool is_open_;
   uint64_t write_sent_;
@@ -97,6 +103,10 @@ class JsSocket : public JsFile {
   JsSocket(int oflag, OutputInterface* out);
   virtual ~JsSocket();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kJsSocket;
+  }
+
   bool connect(int fd, const char* host, uint16_t port);
 
   bool is_read_ready();
@@ -5,14 +5,23 @@
 #include "pepper_file.h"
 
 #include <assert.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "ppapi/c/pp_errors.h"
 #include "ppapi/c/ppb_file_io.h"
 #include "ppapi/cpp/file_ref.h"
 
 #include "file_system.h"
+#include "task_queue.h"
 
 const size_t FileRefStream::kBufSize;
+const size_t FileRefStream::kBlockSize;
+const size_t FileRefStream::kMaxReadAhead;
+const size_t FileRefStream::kMaxCachedBlocks;
+const size_t FileRefStream::kMaxUnflushed;
+const int32_t FileRefStream::kWriteBehindDelayMs;
 
 PepperFileHandler::PepperFileHandler(pp::FileSystem* file_system)
     : ref_(1), file_system_(file_system) {
@@ -34,7 +43,12 @@ void PepperFileHandler::release() {
 
 FileStream* PepperFileHandler::open(int fd, const char* pathname, int oflag) {
   PepperFile* file = new PepperFile(fd, oflag, file_system_);
-  if (file->open(pathname)) {
+  bool opened;
+  {
+    Mutex::Lock lock(file->mutex());
+    opened = file->open(pathname);
+  }
+  if (opened) {
     return file;
   } else {
     file->release();
@@ -51,7 +65,11 @@ int PepperFileHandler::stat(const char* pathname, nacl_abi_stat* out) {
 
 FileRefStream::FileRefStream(int fd, int oflag)
   : ref_(1), fd_(fd), oflag_(oflag), factory_(this),
-    file_io_(NULL), offset_(0), file_info_(), write_sent_(false) {
+    file_io_(NULL), offset_(0), file_info_(), out_offset_(0),
+    write_offset_(0), write_done_(0), write_posted_(false),
+    flush_timer_set_(false), write_error_(0), use_clock_(0),
+    last_read_end_(0), read_ahead_(1), fetch_pending_(false),
+    cache_generation_(0) {
 }
 
 FileRefStream::~FileRefStream() {
@@ -59,12 +77,15 @@ FileRefStream::~FileRefStream() {
 }
 
 void FileRefStream::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void FileRefStream::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -73,48 +94,69 @@ bool FileRefStream::open(const char* pathname) {
   int32_t result = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(0,
       factory_.NewCallback(&FileRefStream::Open, pathname, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
   return result == PP_OK;
 }
 
 void FileRefStream::close() {
+  // FileSystem::close() has flushed already and reported any failure.
+  // This only catches the streams that go away without it.
+  Flush();
   int32_t result = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(0,
       factory_.NewCallback(&FileRefStream::Close, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
 }
 
 int FileRefStream::read(char* buf, size_t count, size_t* nread) {
   if (!is_open())
     return EIO;
 
-  FileSystem* sys = FileSystem::GetFileSystem();
-  if (is_block() && in_buf_.empty()) {
-    int32_t result = PP_OK_COMPLETIONPENDING;
-    pp::Module::Get()->core()->CallOnMainThread(0,
-        factory_.NewCallback(&FileRefStream::Read, count, &result));
-    while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
-    if (result < 0) {
+  // Reads have to see buffered writes.
+  if (!out_buf_.empty() || !write_buf_.empty()) {
+    int error = EAGAIN;
+    if (is_block())
+      error = Flush();
+    else
+      PostWrite();
+    if (error) {
       *nread = -1;
-      return EIO;
+      return error;
     }
   }
 
+  if (offset_ == last_read_end_)
+    read_ahead_ = std::min(read_ahead_ * 2, kMaxReadAhead);
+  else
+    read_ahead_ = 1;
+
   *nread = 0;
-  while (*nread < count) {
-    if (in_buf_.empty())
+  while (true) {
+    *nread += CopyFromCache(buf + *nread, count - *nread);
+    if (*nread == count || IsAtEnd())
       break;
-
-    buf[(*nread)++] = in_buf_.front();
-    offset_++;
-    in_buf_.pop_front();
+    if (!is_open()) {
+      if (*nread)
+        break;
+      *nread = -1;
+      return EIO;
+    }
+    // The block at offset_ isn't cached. Wait out any fetch in flight
+    // before starting the one we need.
+    StartFetch(offset_ / kBlockSize, read_ahead_);
+    if (!is_block())
+      break;
+    WaitForStateChange();
   }
+  last_read_end_ = offset_;
+  ReadAhead();
 
+  if (!*nread && count && !IsAtEnd()) {
+    *nread = -1;
+    return EAGAIN;
+  }
   return 0;
 }
 
@@ -122,30 +164,47 @@ int FileRefStream::write(const char* buf, size_t count, size_t* nwrote) {
   if (!is_open())
     return EIO;
 
-  out_buf_.insert(out_buf_.end(), buf, buf + count);
-  if (is_block()) {
-    int32_t result = PP_OK_COMPLETIONPENDING;
-    pp::Module::Get()->core()->CallOnMainThread(0,
-        factory_.NewCallback(&FileRefStream::Write, &result));
-    FileSystem* sys = FileSystem::GetFileSystem();
-    while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
-    if ((size_t)result != count) {
-      *nwrote = -1;
-      return EIO;
+  int error = TakeWriteError();
+  while (!error) {
+    // Only a write that continues the buffered data joins it, and the
+    // unflushed total is bounded unless nothing else is outstanding.
+    size_t unflushed = out_buf_.size() + write_buf_.size();
+    bool adjacent = out_buf_.empty() ||
+        offset_ == out_offset_ + static_cast<int64_t>(out_buf_.size());
+    if (adjacent && (!unflushed || unflushed + count <= kMaxUnflushed))
+      break;
+    PostWrite();
+    if (!is_block()) {
+      error = EAGAIN;
+    } else if (!is_open()) {
+      error = EIO;
     } else {
-      *nwrote = count;
-      return 0;
+      WaitForStateChange();
+      error = TakeWriteError();
     }
-  } else {
-    if (!write_sent_) {
-      write_sent_ = true;
-      pp::Module::Get()->core()->CallOnMainThread(0,
-        factory_.NewCallback(&FileRefStream::Write, (int32_t*)NULL));
-    }
-    *nwrote = count;
-    return 0;
   }
+  if (error) {
+    *nwrote = -1;
+    return error;
+  }
+
+  if (out_buf_.empty())
+    out_offset_ = offset_;
+  out_buf_.insert(out_buf_.end(), buf, buf + count);
+  InvalidateCache(offset_, count);
+  offset_ += count;
+  if (offset_ > file_info_.size)
+    file_info_.size = offset_;
+  *nwrote = count;
+
+  if (out_buf_.size() >= kBufSize) {
+    PostWrite();
+  } else if (!flush_timer_set_) {
+    flush_timer_set_ = true;
+    pp::Module::Get()->core()->CallOnMainThread(kWriteBehindDelayMs,
+        factory_.NewCallback(&FileRefStream::OnFlushTimer));
+  }
+  return 0;
 }
 
 int FileRefStream::seek(nacl_abi_off_t offset, int whence,
@@ -182,16 +241,32 @@ int FileRefStream::fstat(nacl_abi_stat* out) {
   return 0;
 }
 
+int FileRefStream::fsync() {
+  if (!is_open())
+    return EIO;
+  int error = Flush();
+  if (error)
+    return error;
+
+  int32_t result = PP_OK_COMPLETIONPENDING;
+  TaskQueue::Get()->Post(
+      factory_.NewCallback(&FileRefStream::Sync, &result));
+  while (result == PP_OK_COMPLETIONPENDING)
+    WaitForStateChange();
+  return result == PP_OK ? 0 : EIO;
+}
+
+int FileRefStream::flush() {
+  return Flush();
+}
+
 int FileRefStream::fcntl(int cmd, va_list ap) {
   if (cmd == F_GETFL) {
     return oflag_;
   } else if (cmd == F_SETFL) {
     int oflag = va_arg(ap, long);
-    if (is_block() && (oflag & O_NONBLOCK)) {
-      pp::Module::Get()->core()->CallOnMainThread(0,
-          factory_.NewCallback(&FileRefStream::Read,
-                                       kBufSize, (int32_t*)NULL));
-    }
+    if (is_block() && (oflag & O_NONBLOCK))
+      StartFetch(offset_ / kBlockSize, kMaxReadAhead);
     oflag_ = oflag;
     return 0;
   } else {
@@ -200,11 +275,93 @@ int FileRefStream::fcntl(int cmd, va_list ap) {
 }
 
 bool FileRefStream::is_read_ready() {
-  return !in_buf_.empty();
+  // A cached block either has data at offset_ or marks end of file.
+  return IsAtEnd() || cache_.count(offset_ / kBlockSize) != 0;
+}
+
+size_t FileRefStream::CopyFromCache(char* buf, size_t count) {
+  size_t copied = 0;
+  while (copied < count) {
+    int64_t index = offset_ / kBlockSize;
+    BlockCache::iterator it = cache_.find(index);
+    if (it == cache_.end())
+      break;
+    Block& block = it->second;
+    size_t pos = offset_ - index * kBlockSize;
+    if (pos >= block.data.size())
+      break;
+    size_t n = std::min(count - copied, block.data.size() - pos);
+    memcpy(buf + copied, &block.data[pos], n);
+    block.last_used = ++use_clock_;
+    copied += n;
+    offset_ += n;
+  }
+  return copied;
+}
+
+bool FileRefStream::IsAtEnd() {
+  if (offset_ >= file_info_.size)
+    return true;
+  int64_t index = offset_ / kBlockSize;
+  BlockCache::iterator it = cache_.find(index);
+  if (it == cache_.end())
+    return false;
+  const std::vector<char>& data = it->second.data;
+  size_t pos = offset_ - index * kBlockSize;
+  return data.size() < kBlockSize && pos >= data.size();
+}
+
+void FileRefStream::StartFetch(int64_t index, size_t count) {
+  // Stop at the first cached block and don't read ahead past what we
+  // believe is end of file. A read there returns nothing, and would make
+  // OnFetch move end of file out to |index|.
+  int64_t end = (file_info_.size + kBlockSize - 1) / kBlockSize;
+  if (fetch_pending_ || !is_open() || index >= end)
+    return;
+  size_t n = 1;
+  while (n < count && index + static_cast<int64_t>(n) < end &&
+         !cache_.count(index + n)) {
+    n++;
+  }
+  fetch_pending_ = true;
+  TaskQueue::Get()->Post(factory_.NewCallback(
+      &FileRefStream::Fetch, index, n, cache_generation_));
+}
+
+void FileRefStream::ReadAhead() {
+  // Only sequential readers get read-ahead.
+  if (read_ahead_ < 2 || fetch_pending_ || !is_open())
+    return;
+  int64_t index = offset_ / kBlockSize;
+  int64_t end = (file_info_.size + kBlockSize - 1) / kBlockSize;
+  int64_t last = std::min(index + static_cast<int64_t>(read_ahead_), end - 1);
+  for (int64_t next = index; next <= last; next++) {
+    if (!cache_.count(next)) {
+      StartFetch(next, last - next + 1);
+      return;
+    }
+  }
+}
+
+void FileRefStream::InvalidateCache(int64_t offset, size_t count) {
+  cache_generation_++;
+  if (!count)
+    return;
+  int64_t first = offset / kBlockSize;
+  int64_t last = (offset + count - 1) / kBlockSize;
+  for (BlockCache::iterator it = cache_.begin(); it != cache_.end(); ) {
+    // Short blocks record end of file, which the write may move.
+    if ((it->first >= first && it->first <= last) ||
+        it->second.data.size() < kBlockSize) {
+      cache_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
 }
 
 bool FileRefStream::is_write_ready() {
-  return out_buf_.size() < kBufSize;
+  return out_buf_.size() + write_buf_.size() < kMaxUnflushed;
 }
 
 bool FileRefStream::is_exception() {
@@ -212,8 +369,7 @@ bool FileRefStream::is_exception() {
 }
 
 void FileRefStream::Open(int32_t result, const char* pathname, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   GetFileRef(pathname, pres);
 }
 
@@ -235,13 +391,12 @@ void FileRefStream::GotFileRef(const pp::FileRef& file_ref,
   *pres = file_io_->Open(file_ref, open_flags,
       factory_.NewCallback(&FileRefStream::OnOpen, pres));
   if (*pres != PP_OK_COMPLETIONPENDING)
-    sys->cond().broadcast();
+    NotifyStateChanged();
   LOG("*pres = %d\n", *pres);
 }
 
 void FileRefStream::OnOpen(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   if (result == PP_OK) {
     result = file_io_->Query(&file_info_,
         factory_.NewCallback(&FileRefStream::OnQuery, pres));
@@ -252,18 +407,17 @@ void FileRefStream::OnOpen(int32_t result, int32_t* pres) {
   file_io_ = NULL;
   CleanupOnMainThread();
   *pres = result;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void FileRefStream::OnQuery(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   if (result == PP_OK) {
     if (oflag_ & O_APPEND) {
       offset_ = file_info_.size;
     } else {
       if (!is_block())
-        Read(PP_OK, kBufSize, NULL);
+        StartFetch(0, kMaxReadAhead);
     }
   } else {
     delete file_io_;
@@ -271,97 +425,184 @@ void FileRefStream::OnQuery(int32_t result, int32_t* pres) {
     CleanupOnMainThread();
   }
   *pres = result;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
-void FileRefStream::Read(int32_t result, size_t count, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  assert(file_io_);
-  read_buf_.resize(count);
-  result = file_io_->Read(offset_, &read_buf_[0], read_buf_.size(),
-      factory_.NewCallback(&FileRefStream::OnRead, pres));
+void FileRefStream::Fetch(int32_t result, int64_t index, size_t count,
+                          uint32_t generation) {
+  Mutex::Lock lock(mutex());
+  if (!file_io_) {
+    // Closed before we got here.
+    fetch_pending_ = false;
+    NotifyStateChanged();
+    return;
+  }
+  fetch_buf_.resize(count * kBlockSize);
+  result = file_io_->Read(index * kBlockSize, &fetch_buf_[0],
+      fetch_buf_.size(),
+      factory_.NewCallback(&FileRefStream::OnFetch, index, generation));
   if (result != PP_OK_COMPLETIONPENDING) {
     delete file_io_;
     file_io_ = NULL;
     CleanupOnMainThread();
-    if (pres)
-      *pres = result;
-    sys->cond().broadcast();
+    fetch_pending_ = false;
+    NotifyStateChanged();
   }
 }
 
-void FileRefStream::OnRead(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  if (result >= 0) {
-    in_buf_.insert(in_buf_.end(), &read_buf_[0], &read_buf_[0] + result);
-    if (result && !is_block() && in_buf_.size() < kBufSize)
-      Read(PP_OK, kBufSize, NULL);
-  } else {
-    delete file_io_;
-    file_io_ = NULL;
-    CleanupOnMainThread();
+void FileRefStream::OnFetch(int32_t result, int64_t index,
+                            uint32_t generation) {
+  Mutex::Lock lock(mutex());
+  fetch_pending_ = false;
+  if (result < 0) {
+    if (file_io_) {
+      delete file_io_;
+      file_io_ = NULL;
+      CleanupOnMainThread();
+    }
+    NotifyStateChanged();
+    return;
   }
-  if (pres)
-    *pres = result;
-  sys->cond().broadcast();
-}
 
-void FileRefStream::Write(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  assert(file_io_);
-  if (result == PP_OK) {
-    if (write_buf_.size()) {
-      // Previous write operation is in progress.
-      pp::Module::Get()->core()->CallOnMainThread(1,
-          factory_.NewCallback(&FileRefStream::Write, &result));
-      return;
+  // Anything read before a write to the file may be stale.
+  if (generation == cache_generation_) {
+    size_t size = result;
+    for (size_t i = 0; i * kBlockSize < fetch_buf_.size(); i++) {
+      size_t start = i * kBlockSize;
+      if (start > size)
+        break;
+      size_t n = std::min(kBlockSize, size - start);
+      Block& block = cache_[index + i];
+      block.data.assign(fetch_buf_.begin() + start,
+                        fetch_buf_.begin() + start + n);
+      block.last_used = ++use_clock_;
+      if (n < kBlockSize) {
+        // A short read ends at end of file, which may have moved since
+        // we opened it.
+        file_info_.size = (index + i) * kBlockSize + n;
+        break;
+      }
+    }
+
+    while (cache_.size() > kMaxCachedBlocks) {
+      BlockCache::iterator oldest = cache_.begin();
+      for (BlockCache::iterator it = cache_.begin(); it != cache_.end(); ++it) {
+        if (it->second.last_used < oldest->second.last_used)
+          oldest = it;
+      }
+      cache_.erase(oldest);
     }
-    assert(out_buf_.size());
-    write_buf_.swap(out_buf_);
-    result = file_io_->Write(offset_, &write_buf_[0], write_buf_.size(),
-        factory_.NewCallback(&FileRefStream::OnWrite, pres));
-    write_sent_ = false;
-  } else {
-    result = PP_ERROR_FAILED;
   }
-  if (result != PP_OK_COMPLETIONPENDING) {
-    delete file_io_;
-    file_io_ = NULL;
-    CleanupOnMainThread();
-    if (pres)
-      *pres = result;
-    sys->cond().broadcast();
+
+  NotifyStateChanged();
+}
+
+int FileRefStream::Flush() {
+  while (!out_buf_.empty() || !write_buf_.empty()) {
+    if (!is_open())
+      return EIO;
+    PostWrite();
+    WaitForStateChange();
   }
+  return TakeWriteError();
 }
 
-void FileRefStream::OnWrite(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  if ((size_t)result != write_buf_.size()) {
-    delete file_io_;
-    file_io_ = NULL;
-    CleanupOnMainThread();
-  } else {
-    offset_ += result;
+void FileRefStream::PostWrite() {
+  if (write_posted_)
+    return;
+  write_posted_ = true;
+  TaskQueue::Get()->Post(factory_.NewCallback(&FileRefStream::Write));
+}
+
+int FileRefStream::TakeWriteError() {
+  int error = write_error_;
+  write_error_ = 0;
+  return error;
+}
+
+void FileRefStream::Write(int32_t result) {
+  Mutex::Lock lock(mutex());
+  write_posted_ = false;
+  StartWrite();
+}
+
+void FileRefStream::OnFlushTimer(int32_t result) {
+  Mutex::Lock lock(mutex());
+  flush_timer_set_ = false;
+  StartWrite();
+}
+
+void FileRefStream::StartWrite() {
+  if (!file_io_ || !write_buf_.empty() || out_buf_.empty())
+    return;
+  write_buf_.swap(out_buf_);
+  write_offset_ = out_offset_;
+  write_done_ = 0;
+  IssueWrite();
+}
+
+void FileRefStream::IssueWrite() {
+  int32_t result = file_io_->Write(write_offset_ + write_done_,
+      &write_buf_[write_done_], write_buf_.size() - write_done_,
+      factory_.NewCallback(&FileRefStream::OnWrite));
+  if (result != PP_OK_COMPLETIONPENDING)
+    OnWrite(result < 0 ? result : PP_ERROR_FAILED);
+}
+
+void FileRefStream::OnWrite(int32_t result) {
+  Mutex::Lock lock(mutex());
+  if (result <= 0) {
+    // The buffered data is lost; tell whoever writes or syncs next.
+    if (file_io_) {
+      delete file_io_;
+      file_io_ = NULL;
+      CleanupOnMainThread();
+    }
+    write_buf_.clear();
+    out_buf_.clear();
+    write_error_ = EIO;
+    NotifyStateChanged();
+    return;
+  }
+
+  write_done_ += result;
+  if (write_done_ < write_buf_.size()) {
+    IssueWrite();
+    return;
   }
-  if (pres)
-    *pres = result;
   write_buf_.clear();
-  sys->cond().broadcast();
+  // Whatever was buffered meanwhile goes out as one write.
+  StartWrite();
+  NotifyStateChanged();
+}
+
+void FileRefStream::Sync(int32_t result, int32_t* pres) {
+  Mutex::Lock lock(mutex());
+  if (!file_io_) {
+    *pres = PP_ERROR_FAILED;
+    NotifyStateChanged();
+    return;
+  }
+  result = file_io_->Flush(
+      factory_.NewCallback(&FileRefStream::OnSync, pres));
+  if (result != PP_OK_COMPLETIONPENDING)
+    OnSync(result, pres);
+}
+
+void FileRefStream::OnSync(int32_t result, int32_t* pres) {
+  Mutex::Lock lock(mutex());
+  *pres = result;
+  NotifyStateChanged();
 }
 
 void FileRefStream::Close(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   delete file_io_;
   file_io_ = NULL;
   CleanupOnMainThread();
   if (pres)
     *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 //------------------------------------------------------------------------------
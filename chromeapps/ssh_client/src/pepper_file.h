@@ -5,7 +5,7 @@
 #ifndef PEPPER_FILE_H
 #define PEPPER_FILE_H
 
-#include <deque>
+#include <map>
 #include <vector>
 
 #include "ppapi/utility/completion_callback_factory.h"
@@ -46,12 +46,18 @@ class FileRefStream : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kPepperFile;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
   virtual int seek(nacl_abi_off_t offset, int whence,
                    nacl_abi_off_t* new_offset);
   virtual int fstat(nacl_abi_stat* out);
+  virtual int fsync();
+  virtual int flush();
 
   virtual int fcntl(int cmd,  va_list ap);
 
@@ -70,15 +76,71 @@ class FileRefStream : public FileStream {
   void OnOpen(int32_t result, int32_t* pres);
   void OnQuery(int32_t result, int32_t* pres);
 
-  void Read(int32_t result, size_t count, int32_t* pres);
-  void OnRead(int32_t result, int32_t* pres);
-
-  void Write(int32_t result, int32_t* pres);
-  void OnWrite(int32_t result, int32_t* pres);
+  // A kBlockSize-aligned piece of the file. A block shorter than
+  // kBlockSize ends at what was end of file when it was read.
+  struct Block {
+    std::vector<char> data;
+    // Value of use_clock_ when the block was last read from.
+    uint64_t last_used;
+  };
+  typedef std::map<int64_t, Block> BlockCache;
+
+  // Copies cached data at offset_ into |buf|, advancing offset_. Stops
+  // at the first block that isn't cached or at end of file.
+  size_t CopyFromCache(char* buf, size_t count);
+  // Whether offset_ is at or past end of file, according to the cache or
+  // the file size.
+  bool IsAtEnd();
+  // Posts a fetch of up to |count| blocks from block |index|, fewer if
+  // some are already cached. Does nothing if a fetch is in flight or
+  // |index| is past end of file.
+  void StartFetch(int64_t index, size_t count);
+  // Keeps the next read_ahead_ blocks after offset_ cached or on their
+  // way.
+  void ReadAhead();
+  // Drops cached blocks overlapping [offset, offset + count) and any
+  // fetch in flight.
+  void InvalidateCache(int64_t offset, size_t count);
+
+  void Fetch(int32_t result, int64_t index, size_t count,
+             uint32_t generation);
+  void OnFetch(int32_t result, int64_t index, uint32_t generation);
+
+  // Waits until every buffered write has reached FileIO. Returns 0 or
+  // the errno of a failed write.
+  int Flush();
+  // Queues a Write task unless one is queued already.
+  void PostWrite();
+  // Returns and clears the error from a failed write-behind.
+  int TakeWriteError();
+
+  void Write(int32_t result);
+  void OnFlushTimer(int32_t result);
+  // Hands out_buf_ to FileIO unless a write is already in flight. Must
+  // be called on the main thread with mutex() held.
+  void StartWrite();
+  void IssueWrite();
+  void OnWrite(int32_t result);
+
+  void Sync(int32_t result, int32_t* pres);
+  void OnSync(int32_t result, int32_t* pres);
 
   void Close(int32_t result, int32_t* pres);
 
   static const size_t kBufSize = 64 * 1024;
+  // Reads go through a per-stream cache of aligned blocks. Sequential
+  // reads double the read-ahead window up to kMaxReadAhead blocks; a
+  // seek or a non-sequential read resets it.
+  static const size_t kBlockSize = 16 * 1024;
+  static const size_t kMaxReadAhead = 8;
+  static const size_t kMaxCachedBlocks = 16;
+  // write() returns once the data is buffered. The buffer goes to FileIO
+  // when it reaches kBufSize, kWriteBehindDelayMs after it was started,
+  // or at a flush point: fsync, close, a read, or a write that doesn't
+  // continue the buffered data. Writers wait, or get EAGAIN, while
+  // kMaxUnflushed bytes are outstanding.
+  static const size_t kMaxUnflushed = 1024 * 1024;
+  static const int32_t kWriteBehindDelayMs = 100;
 
   int ref_;
   int fd_;
@@ -87,11 +149,30 @@ class FileRefStream : public FileStream {
   pp::FileIO* file_io_;
   int64_t offset_;
   PP_FileInfo file_info_;
-  std::deque<char> in_buf_;
+  // Data accepted by write() but not yet handed to FileIO. It belongs at
+  // out_offset_.
   std::vector<char> out_buf_;
-  std::vector<char> read_buf_;
+  int64_t out_offset_;
+  // The FileIO::Write in flight, if any: write_buf_ goes at
+  // write_offset_, and its first write_done_ bytes are already written.
   std::vector<char> write_buf_;
-  bool write_sent_;
+  int64_t write_offset_;
+  size_t write_done_;
+  bool write_posted_;
+  bool flush_timer_set_;
+  // Reported by the next write or fsync.
+  int write_error_;
+
+  BlockCache cache_;
+  uint64_t use_clock_;
+  // Where the last read() stopped, to detect sequential reads.
+  int64_t last_read_end_;
+  size_t read_ahead_;
+  // Only one fetch is in flight at a time.
+  bool fetch_pending_;
+  // Bumped on every write; fetches started before it are discarded.
+  uint32_t cache_generation_;
+  std::vector<char> fetch_buf_;
 
   DISALLOW_COPY_AND_ASSIGN(FileRefStream);
 };
@@ -8,12 +8,16 @@
 #include <string.h>
 #include <resolv.h>
 
+#include "ppapi/c/ppb_var_array_buffer.h"
 #include "ppapi/cpp/module.h"
+#include "ppapi/cpp/var_array_buffer.h"
 
 #include "json/reader.h"
 #include "json/writer.h"
 
 #include "file_system.h"
+#include "stats.h"
+#include "task_queue.h"
 
 const char kMessageNameAttr[] = "name";
 const char kMessageArgumentsAttr[] = "arguments";
@@ -26,6 +30,7 @@ const char kOnReadMethodId[] = "onRead";
 const char kOnWriteAcknowledgeMethodId[] = "onWriteAcknowledge";
 const char kOnCloseMethodId[] = "onClose";
 const char kOnResizeMethodId[] = "onResize";
+const char kGetStatsMethodId[] = "getStats";
 
 // Known startSession attributes.
 const char kTerminalWidthAttr[] = "terminalWidth";
@@ -33,6 +38,7 @@ const char kTerminalHeightAttr[] = "terminalHeight";
 const char kUseJsSocketAttr[] = "useJsSocket";
 const char kEnvironmentAttr[] = "environment";
 const char kWriteWindowAttr[] = "writeWindow";
+const char kBinaryMessagesAttr[] = "binaryMessages";
 
 // These are JavaScript method names as C++ code sees them.
 const char kPrintLogMethodId[] = "printLog";
@@ -42,9 +48,48 @@ const char kOpenSocketMethodId[] = "openSocket";
 const char kWriteMethodId[] = "write";
 const char kReadMethodId[] = "read";
 const char kCloseMethodId[] = "close";
+const char kStatsMethodId[] = "stats";
+const char kSessionStartedMethodId[] = "sessionStarted";
 
 const size_t kDefaultWriteWindow = 64 * 1024;
 
+// Binary messages carry stream data as an ArrayBuffer instead of base64
+// inside a JSON string. They start with a fixed header:
+//   byte 0     message type, one of the values below
+//   bytes 1-3  zero
+//   bytes 4-7  stream id, little-endian int32
+// and the rest of the buffer is the payload. Keep in sync with
+// nassh.PluginCommand.BINARY_* on the JavaScript side.
+const uint8_t kBinaryWriteMessage = 1;  // C++ -> JS, same as "write".
+const uint8_t kBinaryReadMessage = 2;  // JS -> C++, same as "onRead".
+const size_t kBinaryHeaderSize = 8;
+
+namespace {
+
+// The JSON library only has 32-bit integers, so counters go out as
+// doubles. They are exact up to 2^53.
+Json::Value CounterToJson(uint64_t value) {
+  return Json::Value(static_cast<double>(value));
+}
+
+// "buckets" follows Histogram's bucket layout, minus trailing empty
+// buckets.
+Json::Value HistogramToJson(const Histogram& histogram) {
+  Json::Value result(Json::objectValue);
+  result["count"] = CounterToJson(histogram.count());
+  result["totalUs"] = CounterToJson(histogram.total_us());
+  result["maxUs"] = CounterToJson(histogram.max_us());
+  int used = Histogram::kBuckets;
+  while (used > 0 && !histogram.bucket(used - 1))
+    used--;
+  Json::Value& buckets = result["buckets"] = Json::Value(Json::arrayValue);
+  for (int i = 0; i < used; i++)
+    buckets.append(CounterToJson(histogram.bucket(i)));
+  return result;
+}
+
+}  // namespace
+
 //------------------------------------------------------------------------------
 
 PluginInstance* PluginInstance::instance_ = NULL;
@@ -54,6 +99,7 @@ PluginInstance::PluginInstance(PP_Instance instance)
       core_(pp::Module::Get()->core()),
       plugin_thread_(NULL),
       factory_(this),
+      binary_messages_(false),
       file_system_(this, this) {
   instance_ = this;
 }
@@ -63,7 +109,25 @@ PluginInstance::~PluginInstance() {
 }
 
 void PluginInstance::HandleMessage(const pp::Var& message_data) {
-  if (message_data.is_string()) {
+  if (message_data.is_array_buffer()) {
+    pp::VarArrayBuffer buffer(message_data);
+    uint32_t size = buffer.ByteLength();
+    const char* data = static_cast<const char*>(buffer.Map());
+    if (!data) {
+      PrintLogImpl(0, "HandleMessage: can't map binary message\n");
+      return;
+    }
+    if (size >= kBinaryHeaderSize &&
+        data[0] == static_cast<char>(kBinaryReadMessage)) {
+      // NaCl only runs on little-endian targets.
+      int32_t id;
+      memcpy(&id, data + 4, sizeof(id));
+      OnReadData(id, data + kBinaryHeaderSize, size - kBinaryHeaderSize);
+    } else {
+      PrintLogImpl(0, "HandleMessage: invalid binary message\n");
+    }
+    buffer.Unmap();
+  } else if (message_data.is_string()) {
     Json::Value root;
     if (Json::Reader().parse(message_data.AsString(), root) &&
         root.isObject()) {
@@ -90,6 +154,8 @@ void PluginInstance::Invoke(const std::string& function,
     OnClose(args);
   } else if (function == kOnResizeMethodId) {
     OnResize(args);
+  } else if (function == kGetStatsMethodId) {
+    OnGetStats(args);
   }
 }
 
@@ -159,6 +225,24 @@ bool PluginInstance::OpenSocket(int fd, const char* host, uint16_t port,
 }
 
 bool PluginInstance::Write(int id, const char* data, size_t size) {
+  if (binary_messages_) {
+    pp::VarArrayBuffer buffer(kBinaryHeaderSize + size);
+    char* buf = static_cast<char*>(buffer.Map());
+    if (!buf) {
+      PrintLog("Write: can't map binary message\n");
+      return false;
+    }
+    memset(buf, 0, kBinaryHeaderSize);
+    buf[0] = kBinaryWriteMessage;
+    int32_t stream_id = id;
+    memcpy(buf + 4, &stream_id, sizeof(stream_id));
+    memcpy(buf + kBinaryHeaderSize, data, size);
+    buffer.Unmap();
+    PostMessage(buffer);
+    return true;
+  }
+
+  // Fallback for browsers that can't post ArrayBuffers to NaCl.
   const size_t kMaxWriteSize = 24*1024;
   std::vector<char> buf(kMaxWriteSize * 4 / 3 + 4);
   size_t start = 0;
@@ -223,6 +307,19 @@ void PluginInstance::StartSession(const Json::Value& args) {
       session_args_[kUseJsSocketAttr].isBool()) {
     file_system_.UseJsSocket(session_args_[kUseJsSocketAttr].asBool());
   }
+  if (session_args_.isMember(kBinaryMessagesAttr) &&
+      session_args_[kBinaryMessagesAttr].isBool() &&
+      session_args_[kBinaryMessagesAttr].asBool()) {
+    binary_messages_ = pp::Module::Get()->GetBrowserInterface(
+        PPB_VAR_ARRAY_BUFFER_INTERFACE) != NULL;
+  }
+  // JS can't tell whether we have the ArrayBuffer interface, so it
+  // waits for this before sending binary messages.
+  Json::Value options(Json::objectValue);
+  options[kBinaryMessagesAttr] = binary_messages_;
+  Json::Value call_args(Json::arrayValue);
+  call_args.append(options);
+  InvokeJS(kSessionStartedMethodId, call_args);
 
   if (session_args_.isMember(kEnvironmentAttr) &&
       session_args_[kEnvironmentAttr].isObject()) {
@@ -267,21 +364,25 @@ void PluginInstance::OnRead(const Json::Value& args) {
   const Json::Value& id = args[(size_t)0];
   const Json::Value& data = args[(size_t)1];
   if (id.isNumeric() && data.isString()) {
-    InputStreams::iterator it = streams_.find(id.asInt());
-    if (it != streams_.end()) {
-      const std::string& str = data.asString();
-      std::vector<char> buf(str.size() * 3 / 4);
-      int res = b64_pton(str.c_str(), (unsigned char*)&buf[0], buf.size());
-      assert(res >= 0);
-      it->second->OnRead(&buf[0], res);
-    } else {
-      PrintLogImpl(0, "onRead: for unknown file descriptor\n");
-    }
+    const std::string& str = data.asString();
+    std::vector<char> buf(str.size() * 3 / 4);
+    int res = b64_pton(str.c_str(), (unsigned char*)&buf[0], buf.size());
+    assert(res >= 0);
+    OnReadData(id.asInt(), &buf[0], res);
   } else {
     PrintLogImpl(0, "onRead: invalid arguments\n");
   }
 }
 
+void PluginInstance::OnReadData(int id, const char* data, size_t size) {
+  InputStreams::iterator it = streams_.find(id);
+  if (it != streams_.end()) {
+    it->second->OnRead(data, size);
+  } else {
+    PrintLogImpl(0, "onRead: for unknown file descriptor\n");
+  }
+}
+
 void PluginInstance::OnWriteAcknowledge(const Json::Value& args) {
   const Json::Value& id = args[(size_t)0];
   const Json::Value& count = args[(size_t)1];
@@ -314,3 +415,59 @@ void PluginInstance::OnResize(const Json::Value& args) {
   file_system_.SetTerminalSize(args[(size_t)0].asInt(),
                                args[(size_t)1].asInt());
 }
+
+void PluginInstance::OnGetStats(const Json::Value& args) {
+  Stats* stats = Stats::Get();
+  Json::Value snapshot(Json::objectValue);
+
+  // Only stream types and syscalls that have seen use are included.
+  Json::Value& streams = snapshot["streams"] = Json::Value(Json::objectValue);
+  for (int i = 0; i < Stats::kStreamTypeCount; i++) {
+    Stats::StreamType type = static_cast<Stats::StreamType>(i);
+    const Stats::StreamCounters& counters = stats->stream(type);
+    if (!counters.reads && !counters.writes && !counters.blocked.count())
+      continue;
+    Json::Value& stream = streams[Stats::StreamTypeName(type)];
+    stream["reads"] = CounterToJson(counters.reads);
+    stream["writes"] = CounterToJson(counters.writes);
+    stream["bytesIn"] = CounterToJson(counters.bytes_in);
+    stream["bytesOut"] = CounterToJson(counters.bytes_out);
+    stream["readLatency"] = HistogramToJson(counters.read_latency);
+    stream["writeLatency"] = HistogramToJson(counters.write_latency);
+    stream["blocked"] = HistogramToJson(counters.blocked);
+  }
+
+  Json::Value& syscalls = snapshot["syscalls"] =
+      Json::Value(Json::objectValue);
+  for (int i = 0; i < Stats::kSyscallCount; i++) {
+    Stats::Syscall syscall = static_cast<Stats::Syscall>(i);
+    if (stats->syscall(syscall).count()) {
+      syscalls[Stats::SyscallName(syscall)] =
+          HistogramToJson(stats->syscall(syscall));
+    }
+  }
+
+  const Stats::WaitCounters& wait = stats->wait();
+  Json::Value& waits = snapshot["wait"] = Json::Value(Json::objectValue);
+  waits["calls"] = CounterToJson(wait.calls);
+  waits["wakeups"] = CounterToJson(wait.wakeups);
+  waits["idleWakeups"] = CounterToJson(wait.idle_wakeups);
+  waits["ready"] = CounterToJson(wait.ready);
+
+  snapshot["mainThreadHop"] = HistogramToJson(stats->main_thread_hop());
+
+  TaskQueue::Stats queue_stats;
+  TaskQueue::Get()->GetStats(&queue_stats);
+  Json::Value& queue = snapshot["taskQueue"] = Json::Value(Json::objectValue);
+  queue["posted"] = CounterToJson(queue_stats.posted);
+  queue["run"] = CounterToJson(queue_stats.run);
+  queue["pumps"] = CounterToJson(queue_stats.pumps);
+  queue["depth"] = CounterToJson(queue_stats.depth);
+  queue["maxDepth"] = CounterToJson(queue_stats.max_depth);
+  queue["maxDrainLatencyUs"] =
+      CounterToJson(queue_stats.max_drain_latency_us);
+
+  Json::Value call_args(Json::arrayValue);
+  call_args.append(snapshot);
+  InvokeJS(kStatsMethodId, call_args);
+}
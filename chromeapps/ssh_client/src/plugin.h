@@ -53,9 +53,12 @@ class PluginInstance : public pp::Instance,
   void StartSession(const Json::Value& args);
   void OnOpen(const Json::Value& args);
   void OnRead(const Json::Value& args);
+  void OnReadData(int id, const char* data, size_t size);
   void OnWriteAcknowledge(const Json::Value& args);
   void OnClose(const Json::Value& args);
   void OnResize(const Json::Value& args);
+  // Replies with a "stats" message holding a snapshot of Stats.
+  void OnGetStats(const Json::Value& args);
 
   static void* SessionThread(void* arg);
 
@@ -75,6 +78,8 @@ class PluginInstance : public pp::Instance,
   // response. streams_ is keyed by the JavaScript-side stream ID.
   PendingOpens pending_opens_;
   InputStreams streams_;
+  // Whether stream data is exchanged as ArrayBuffers rather than base64.
+  bool binary_messages_;
   FileSystem file_system_;
 
   DISALLOW_COPY_AND_ASSIGN(PluginInstance);
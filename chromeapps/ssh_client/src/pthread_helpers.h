@@ -61,6 +61,22 @@ class Mutex {
     Mutex& mutex_;
   };
 
+  // Releases a mutex the caller holds (once) for the rest of the scope.
+  class Unlock {
+   public:
+    Unlock(Mutex& mutex) : mutex_(mutex) {
+      pthread_mutex_unlock(mutex_.get());
+    }
+
+    ~Unlock() {
+      pthread_mutex_lock(mutex_.get());
+    }
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(Unlock);
+    Mutex& mutex_;
+  };
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Mutex);
   pthread_mutex_t mutex_;
@@ -0,0 +1,233 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "resolver.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "ppapi/c/pp_errors.h"
+#include "ppapi/cpp/module.h"
+#include "ppapi/cpp/var.h"
+
+Resolver::Resolver(pp::Instance* instance)
+  : instance_(instance),
+    is_available_(pp::HostResolverPrivate::IsAvailable()),
+    factory_(this) {
+}
+
+Resolver::~Resolver() {
+}
+
+// static
+bool Resolver::ToSockAddr(const PP_NetAddress_Private& netaddr,
+                          sockaddr_in6* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sin6_port = pp::NetAddressPrivate::GetPort(netaddr);
+  PP_NetAddressFamily_Private family =
+      pp::NetAddressPrivate::GetFamily(netaddr);
+  if (family == PP_NETADDRESSFAMILY_IPV6) {
+    addr->sin6_family = AF_INET6;
+    addr->sin6_scope_id = pp::NetAddressPrivate::GetScopeID(netaddr);
+    return pp::NetAddressPrivate::GetAddress(
+        netaddr, &addr->sin6_addr, sizeof(in6_addr));
+  } else if (family == PP_NETADDRESSFAMILY_IPV4) {
+    sockaddr_in* sin4 = reinterpret_cast<sockaddr_in*>(addr);
+    sin4->sin_family = AF_INET;
+    return pp::NetAddressPrivate::GetAddress(
+        netaddr, &sin4->sin_addr, sizeof(in_addr));
+  }
+  return false;
+}
+
+// static
+time_t Resolver::Now() {
+  timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec;
+}
+
+void Resolver::Lookup(const std::string& hostname, int family,
+                      Result* result) {
+  assert(!pp::Module::Get()->core()->IsMainThread());
+  Key key(hostname, family);
+  Mutex::Lock lock(mutex_);
+  Query* query;
+  Cache::iterator it = cache_.find(key);
+  if (it != cache_.end() && it->second.pending) {
+    // Someone else is resolving this name already.
+    query = it->second.query;
+    query->refs++;
+  } else if (it != cache_.end() && it->second.expires > Now()) {
+    *result = it->second.result;
+    return;
+  } else {
+    query = new Query();
+    query->key = key;
+    query->resolver = NULL;
+    query->done = false;
+    query->refs = 2;
+
+    Entry& entry = cache_[key];
+    entry.query = query;
+    entry.pending = true;
+    entry.result = Result();
+    pp::Module::Get()->core()->CallOnMainThread(0,
+        factory_.NewCallback(&Resolver::StartQuery, query));
+  }
+
+  while (!query->done)
+    cond_.wait(mutex_);
+  *result = query->result;
+  ReleaseQuery(query);
+}
+
+// static
+void Resolver::ReleaseQuery(Query* query) {
+  if (!--query->refs)
+    delete query;
+}
+
+bool Resolver::GetConnectOrder(const sockaddr* addr,
+                               std::vector<sockaddr_in6>* addrs) {
+  if (addr->sa_family != AF_INET && addr->sa_family != AF_INET6)
+    return false;
+
+  Mutex::Lock lock(mutex_);
+  // The same address may be in the answers for several families; the one
+  // with the most addresses is usually the AF_UNSPEC answer.
+  const Result* best = NULL;
+  size_t index = 0;
+  time_t now = Now();
+  for (Cache::const_iterator it = cache_.begin(); it != cache_.end(); ++it) {
+    const Entry& entry = it->second;
+    if (entry.pending || entry.expires <= now)
+      continue;
+    if (best && entry.result.addrs.size() <= best->addrs.size())
+      continue;
+    for (size_t i = 0; i < entry.result.addrs.size(); i++) {
+      if (SameAddress(entry.result.addrs[i], addr)) {
+        best = &entry.result;
+        index = i;
+        break;
+      }
+    }
+  }
+  if (!best)
+    return false;
+
+  std::vector<sockaddr_in6> same, other;
+  for (size_t i = 0; i < best->addrs.size(); i++) {
+    if (i == index)
+      continue;
+    if (best->addrs[i].sin6_family == addr->sa_family)
+      same.push_back(best->addrs[i]);
+    else
+      other.push_back(best->addrs[i]);
+  }
+  addrs->clear();
+  addrs->push_back(best->addrs[index]);
+  for (size_t i = 0; i < std::max(same.size(), other.size()); i++) {
+    if (i < other.size())
+      addrs->push_back(other[i]);
+    if (i < same.size())
+      addrs->push_back(same[i]);
+  }
+  return true;
+}
+
+// static
+bool Resolver::SameAddress(const sockaddr_in6& a, const sockaddr* b) {
+  if (a.sin6_family != b->sa_family)
+    return false;
+  if (a.sin6_family == AF_INET6) {
+    const sockaddr_in6* b6 = reinterpret_cast<const sockaddr_in6*>(b);
+    return !memcmp(&a.sin6_addr, &b6->sin6_addr, sizeof(in6_addr));
+  }
+  const sockaddr_in* a4 = reinterpret_cast<const sockaddr_in*>(&a);
+  const sockaddr_in* b4 = reinterpret_cast<const sockaddr_in*>(b);
+  return a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+void Resolver::StartQuery(int32_t result, Query* query) {
+  PP_HostResolver_Private_Hint hint = {
+    PP_NETADDRESSFAMILY_UNSPECIFIED, PP_HOST_RESOLVER_FLAGS_CANONNAME
+  };
+  if (query->key.second == AF_INET)
+    hint.family = PP_NETADDRESSFAMILY_IPV4;
+  else if (query->key.second == AF_INET6)
+    hint.family = PP_NETADDRESSFAMILY_IPV6;
+
+  query->resolver = new pp::HostResolverPrivate(instance_);
+  result = query->resolver->Resolve(query->key.first, 0, hint,
+      factory_.NewCallback(&Resolver::OnQueryDone, query));
+  if (result != PP_OK_COMPLETIONPENDING)
+    OnQueryDone(result, query);
+}
+
+void Resolver::OnQueryDone(int32_t result, Query* query) {
+  Result answer;
+  answer.result = result;
+  if (result == PP_OK) {
+    answer.canonical_name =
+        query->resolver->GetCanonicalName().AsString();
+    size_t size = query->resolver->GetSize();
+    for (size_t i = 0; i < size; i++) {
+      PP_NetAddress_Private netaddr = {};
+      if (!query->resolver->GetNetAddress(i, &netaddr))
+        continue;
+      sockaddr_in6 addr;
+      if (ToSockAddr(netaddr, &addr))
+        answer.addrs.push_back(addr);
+    }
+    if (answer.addrs.empty())
+      answer.result = PP_ERROR_FAILED;
+  }
+  LOG("Resolver: %s resolved (%d), %d addresses\n",
+      query->key.first.c_str(), answer.result, answer.addrs.size());
+
+  delete query->resolver;
+  query->resolver = NULL;
+
+  Mutex::Lock lock(mutex_);
+  query->done = true;
+  query->result = answer;
+  // Pending entries are never evicted or replaced, so this is ours.
+  Entry& entry = cache_[query->key];
+  entry.query = NULL;
+  entry.pending = false;
+  entry.expires = Now() +
+      (answer.result == PP_OK ? kPositiveTTL : kNegativeTTL);
+  entry.result = answer;
+  Evict();
+  cond_.broadcast();
+  ReleaseQuery(query);
+}
+
+void Resolver::Evict() {
+  time_t now = Now();
+  for (Cache::iterator it = cache_.begin();
+       cache_.size() > kMaxEntries && it != cache_.end(); ) {
+    if (!it->second.pending && it->second.expires <= now)
+      cache_.erase(it++);
+    else
+      ++it;
+  }
+  while (cache_.size() > kMaxEntries) {
+    Cache::iterator oldest = cache_.end();
+    for (Cache::iterator it = cache_.begin(); it != cache_.end(); ++it) {
+      if (!it->second.pending &&
+          (oldest == cache_.end() ||
+           it->second.expires < oldest->second.expires)) {
+        oldest = it;
+      }
+    }
+    if (oldest == cache_.end())
+      break;
+    cache_.erase(oldest);
+  }
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <netinet/in.h>
+#include <sys/time.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ppapi/cpp/instance.h"
+#include "ppapi/cpp/private/host_resolver_private.h"
+#include "ppapi/cpp/private/net_address_private.h"
+#include "ppapi/utility/completion_callback_factory.h"
+
+#include "pthread_helpers.h"
+
+// Resolves host names with pp::HostResolverPrivate and caches the
+// answers. Any number of lookups may be in flight at once; a lookup for
+// a name that is already being resolved waits for that query instead of
+// starting another.
+class Resolver {
+ public:
+  struct Result {
+    // PP_OK or the error from the resolver.
+    int32_t result;
+    std::string canonical_name;
+    // Resolved addresses with a zero port. IPv4 addresses are stored as
+    // sockaddr_in in the same space.
+    std::vector<sockaddr_in6> addrs;
+  };
+
+  // Must be created on the main thread.
+  explicit Resolver(pp::Instance* instance);
+  ~Resolver();
+
+  // Converts |netaddr| into a sockaddr_in6, or a sockaddr_in stored in the
+  // same space for IPv4. The port is copied as is. Returns false for
+  // unknown address families. Must be called on the main thread.
+  static bool ToSockAddr(const PP_NetAddress_Private& netaddr,
+                         sockaddr_in6* addr);
+
+  // Whether the browser provides a resolver at all.
+  bool is_available() const { return is_available_; }
+
+  // Resolves |hostname| for |family| (AF_UNSPEC, AF_INET or AF_INET6),
+  // blocking until the answer is known. Must not be called on the main
+  // thread.
+  void Lookup(const std::string& hostname, int family, Result* result);
+
+  // Finds a cached answer containing |addr| and returns its addresses in
+  // the order a connect should try them: |addr| first, then alternating
+  // between the other family and |addr|'s own (RFC 6555). Ports are left
+  // zero. Returns false if no cached answer has |addr|.
+  bool GetConnectOrder(const sockaddr* addr,
+                       std::vector<sockaddr_in6>* addrs);
+
+ private:
+  typedef std::pair<std::string, int> Key;
+
+  // One resolution in flight. Every Lookup waiting for it gets its answer
+  // from here rather than from the cache, which may have evicted it by
+  // the time the waiter wakes up.
+  struct Query {
+    Key key;
+    pp::HostResolverPrivate* resolver;
+    bool done;
+    Result result;
+    // Lookups waiting on this query, plus one for the resolve itself.
+    // The last to let go deletes it. Guarded by mutex_.
+    int refs;
+  };
+
+  struct Entry {
+    // While pending, the query that will answer.
+    Query* query;
+    bool pending;
+    // Seconds since the epoch.
+    time_t expires;
+    Result result;
+  };
+
+  typedef std::map<Key, Entry> Cache;
+
+  // Answers are kept this long. The browser doesn't tell us the real TTL.
+  static const time_t kPositiveTTL = 60;
+  static const time_t kNegativeTTL = 10;
+  static const size_t kMaxEntries = 64;
+
+  static time_t Now();
+  // Whether |a| and |b| hold the same address, ignoring the port.
+  static bool SameAddress(const sockaddr_in6& a, const sockaddr* b);
+
+  void StartQuery(int32_t result, Query* query);
+  void OnQueryDone(int32_t result, Query* query);
+  // Drops a reference to |query|. Must be called with mutex_ held.
+  static void ReleaseQuery(Query* query);
+  // Drops answers past their TTL and, if the cache is still too big, the
+  // ones that would expire first. Must be called with mutex_ held.
+  void Evict();
+
+  pp::Instance* instance_;
+  bool is_available_;
+  pp::CompletionCallbackFactory<Resolver, ThreadSafeRefCount> factory_;
+  Mutex mutex_;
+  // Broadcast whenever a query finishes.
+  Cond cond_;
+  Cache cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(Resolver);
+};
+
+#endif  // RESOLVER_H
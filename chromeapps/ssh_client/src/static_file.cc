@@ -0,0 +1,202 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "static_file.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+const nacl_abi_blksize_t kBlockSize = 4096;
+
+void FillStat(const StaticFileEntry* entry, nacl_abi_stat* out) {
+  memset(out, 0, sizeof(nacl_abi_stat));
+  if (entry) {
+    out->nacl_abi_st_mode = S_IFREG | 0444;
+    out->nacl_abi_st_nlink = 1;
+    out->nacl_abi_st_size = entry->size;
+    out->nacl_abi_st_blksize = kBlockSize;
+    out->nacl_abi_st_blocks = (entry->size + 511) / 512;
+  } else {
+    out->nacl_abi_st_mode = S_IFDIR | 0555;
+    out->nacl_abi_st_nlink = 2;
+    out->nacl_abi_st_blksize = kBlockSize;
+  }
+}
+
+class StaticDirectory : public FileStream {
+ public:
+  StaticDirectory() : ref_(1) { }
+  virtual ~StaticDirectory() { }
+
+  virtual void addref() { __sync_add_and_fetch(&ref_, 1); }
+  virtual void release() {
+    if (!__sync_sub_and_fetch(&ref_, 1)) {
+      {
+        Mutex::Lock lock(mutex());
+        close();
+      }
+      delete this;
+    }
+  }
+  virtual void close() { }
+  virtual int read(char* buf, size_t count, size_t* nread) { return EISDIR; }
+  virtual int write(const char* buf, size_t count, size_t* nwrote) {
+    return EBADF;
+  }
+
+  virtual int fstat(nacl_abi_stat* out) {
+    FillStat(NULL, out);
+    return 0;
+  }
+
+  virtual int getdents(dirent* buf, size_t count, size_t* nread) {
+    return ENOSYS;
+  }
+
+ private:
+  int ref_;
+};
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
+StaticFileHandler::StaticFileHandler(const StaticFileEntry* entries,
+                                     size_t count)
+  : ref_(1) {
+  // The mount point itself is "".
+  directories_.insert("");
+  for (size_t i = 0; i < count; i++) {
+    std::string path = entries[i].path;
+    entries_[path] = &entries[i];
+    for (size_t slash = path.rfind('/'); slash != 0 && slash != path.npos;
+         slash = path.rfind('/', slash - 1)) {
+      directories_.insert(path.substr(0, slash));
+    }
+  }
+}
+
+StaticFileHandler::~StaticFileHandler() {
+  assert(!ref_);
+}
+
+void StaticFileHandler::addref() {
+  ++ref_;
+}
+
+void StaticFileHandler::release() {
+  if (!--ref_)
+    delete this;
+}
+
+FileStream* StaticFileHandler::open(int fd, const char* pathname, int oflag) {
+  if ((oflag & O_ACCMODE) != O_RDONLY || (oflag & O_TRUNC))
+    return NULL;
+
+  if (directories_.find(pathname) != directories_.end())
+    return new StaticDirectory();
+
+  EntryMap::const_iterator it = entries_.find(pathname);
+  if (it == entries_.end())
+    return NULL;
+  return new StaticFile(fd, oflag, it->second);
+}
+
+int StaticFileHandler::stat(const char* pathname, nacl_abi_stat* out) {
+  if (directories_.find(pathname) != directories_.end()) {
+    FillStat(NULL, out);
+    return 0;
+  }
+
+  EntryMap::const_iterator it = entries_.find(pathname);
+  if (it == entries_.end())
+    return ENOENT;
+  FillStat(it->second, out);
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+StaticFile::StaticFile(int fd, int oflag, const StaticFileEntry* entry)
+  : fd_(fd), oflag_(oflag), ref_(1), entry_(entry), offset_(0) {
+}
+
+StaticFile::~StaticFile() {
+  assert(!ref_);
+}
+
+void StaticFile::addref() {
+  __sync_add_and_fetch(&ref_, 1);
+}
+
+void StaticFile::release() {
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
+    delete this;
+  }
+}
+
+void StaticFile::close() {
+  fd_ = 0;
+}
+
+int StaticFile::read(char* buf, size_t count, size_t* nread) {
+  size_t left = offset_ < entry_->size ? entry_->size - offset_ : 0;
+  if (count > left)
+    count = left;
+  memcpy(buf, entry_->data + offset_, count);
+  offset_ += count;
+  *nread = count;
+  return 0;
+}
+
+int StaticFile::write(const char* buf, size_t count, size_t* nwrote) {
+  return EBADF;
+}
+
+int StaticFile::seek(nacl_abi_off_t offset, int whence,
+                     nacl_abi_off_t* new_offset) {
+  nacl_abi_off_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = offset_;
+      break;
+    case SEEK_END:
+      base = entry_->size;
+      break;
+    default:
+      return EINVAL;
+  }
+  if (base + offset < 0)
+    return EINVAL;
+
+  offset_ = base + offset;
+  if (new_offset)
+    *new_offset = offset_;
+  return 0;
+}
+
+int StaticFile::fstat(nacl_abi_stat* out) {
+  FillStat(entry_, out);
+  return 0;
+}
+
+int StaticFile::fcntl(int cmd, va_list ap) {
+  if (cmd == F_GETFL) {
+    return oflag_;
+  } else if (cmd == F_SETFL) {
+    oflag_ = va_arg(ap, long);
+    return 0;
+  } else {
+    return -1;
+  }
+}
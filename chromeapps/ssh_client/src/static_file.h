@@ -0,0 +1,85 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STATIC_FILE_H
+#define STATIC_FILE_H
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "file_interfaces.h"
+#include "pthread_helpers.h"
+
+// A read-only file compiled into the plugin by embed_files.py.
+struct StaticFileEntry {
+  // Relative to where the files are mounted, starting with a slash.
+  const char* path;
+  const char* data;
+  size_t size;
+};
+
+// The en_US.UTF-8 locale data, for glibc. Generated into
+// output/locale_files.cc by the Makefile.
+extern const StaticFileEntry kLocaleFiles[];
+extern const size_t kLocaleFilesCount;
+
+// Serves a table of StaticFileEntry. Every directory that holds an entry
+// can be opened too. Nothing is fetched or copied: reads come straight
+// out of the table.
+class StaticFileHandler : public PathHandler {
+ public:
+  StaticFileHandler(const StaticFileEntry* entries, size_t count);
+  virtual ~StaticFileHandler();
+
+  virtual void addref();
+  virtual void release();
+
+  virtual FileStream* open(int fd, const char* pathname, int oflag);
+  virtual int stat(const char* pathname, nacl_abi_stat* out);
+
+ private:
+  typedef std::map<std::string, const StaticFileEntry*> EntryMap;
+
+  int ref_;
+  EntryMap entries_;
+  std::set<std::string> directories_;
+
+  DISALLOW_COPY_AND_ASSIGN(StaticFileHandler);
+};
+
+class StaticFile : public FileStream {
+ public:
+  StaticFile(int fd, int oflag, const StaticFileEntry* entry);
+  virtual ~StaticFile();
+
+  virtual void addref();
+  virtual void release();
+
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kStaticFile;
+  }
+
+  virtual void close();
+  virtual int read(char* buf, size_t count, size_t* nread);
+  virtual int write(const char* buf, size_t count, size_t* nwrote);
+  virtual int seek(nacl_abi_off_t offset, int whence,
+                   nacl_abi_off_t* new_offset);
+  virtual int fstat(nacl_abi_stat* out);
+
+  virtual int fcntl(int cmd,  va_list ap);
+
+  virtual bool is_write_ready() { return false; }
+
+ private:
+  int fd_;
+  int oflag_;
+  int ref_;
+  const StaticFileEntry* entry_;
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(StaticFile);
+};
+
+#endif  // STATIC_FILE_H
@@ -0,0 +1,148 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "stats.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+namespace {
+
+const char* const kStreamTypeNames[] = {
+  "tcpSocket",
+  "tcpServerSocket",
+  "udpSocket",
+  "jsFile",
+  "jsSocket",
+  "pepperFile",
+  "staticFile",
+  "devTty",
+  "devNull",
+  "devRandom",
+  "epoll",
+  "other",
+};
+
+const char* const kSyscallNames[] = {
+  "open",
+  "close",
+  "read",
+  "write",
+  "readv",
+  "writev",
+  "seek",
+  "fstat",
+  "stat",
+  "fsync",
+  "select",
+  "poll",
+  "epoll_wait",
+  "getaddrinfo",
+  "connect",
+  "accept",
+  "recvfrom",
+  "sendto",
+  "recvmsg",
+  "sendmsg",
+  "recvmmsg",
+  "sendmmsg",
+};
+
+static_assert(sizeof(kStreamTypeNames) / sizeof(kStreamTypeNames[0]) ==
+              Stats::kStreamTypeCount, "kStreamTypeNames is out of date");
+static_assert(sizeof(kSyscallNames) / sizeof(kSyscallNames[0]) ==
+              Stats::kSyscallCount, "kSyscallNames is out of date");
+
+void AtomicMax(volatile uint64_t* value, uint64_t sample) {
+  for (uint64_t old = *value; sample > old; old = *value) {
+    if (__sync_bool_compare_and_swap(value, old, sample))
+      break;
+  }
+}
+
+}  // namespace
+
+Histogram::Histogram()
+    : count_(0), total_us_(0), max_us_(0) {
+  memset(const_cast<uint64_t*>(buckets_), 0, sizeof(buckets_));
+}
+
+void Histogram::Add(uint64_t us) {
+  int bucket = us ? 64 - __builtin_clzll(us) : 0;
+  if (bucket >= kBuckets)
+    bucket = kBuckets - 1;
+  __sync_add_and_fetch(&buckets_[bucket], 1);
+  __sync_add_and_fetch(&count_, 1);
+  __sync_add_and_fetch(&total_us_, us);
+  AtomicMax(&max_us_, us);
+}
+
+// static
+Stats* Stats::Get() {
+  static Stats stats;
+  return &stats;
+}
+
+Stats::Stats() {
+  for (int i = 0; i < kStreamTypeCount; i++) {
+    streams_[i].reads = 0;
+    streams_[i].writes = 0;
+    streams_[i].bytes_in = 0;
+    streams_[i].bytes_out = 0;
+  }
+  wait_.calls = 0;
+  wait_.wakeups = 0;
+  wait_.idle_wakeups = 0;
+  wait_.ready = 0;
+}
+
+// static
+uint64_t Stats::NowMicroseconds() {
+  timeval now;
+  gettimeofday(&now, NULL);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+}
+
+// static
+const char* Stats::StreamTypeName(StreamType type) {
+  return kStreamTypeNames[type];
+}
+
+// static
+const char* Stats::SyscallName(Syscall syscall) {
+  return kSyscallNames[syscall];
+}
+
+void Stats::RecordRead(StreamType type, size_t bytes, uint64_t us) {
+  StreamCounters& counters = streams_[type];
+  __sync_add_and_fetch(&counters.reads, 1);
+  __sync_add_and_fetch(&counters.bytes_in, bytes);
+  counters.read_latency.Add(us);
+}
+
+void Stats::RecordWrite(StreamType type, size_t bytes, uint64_t us) {
+  StreamCounters& counters = streams_[type];
+  __sync_add_and_fetch(&counters.writes, 1);
+  __sync_add_and_fetch(&counters.bytes_out, bytes);
+  counters.write_latency.Add(us);
+}
+
+void Stats::RecordBlocked(StreamType type, uint64_t us) {
+  streams_[type].blocked.Add(us);
+}
+
+void Stats::RecordSyscall(Syscall syscall, uint64_t us) {
+  syscalls_[syscall].Add(us);
+}
+
+void Stats::RecordMainThreadHop(uint64_t us) {
+  main_thread_hop_.Add(us);
+}
+
+void Stats::RecordWait(size_t wakeups, size_t idle_wakeups, size_t ready) {
+  __sync_add_and_fetch(&wait_.calls, 1);
+  __sync_add_and_fetch(&wait_.wakeups, wakeups);
+  __sync_add_and_fetch(&wait_.idle_wakeups, idle_wakeups);
+  __sync_add_and_fetch(&wait_.ready, ready);
+}
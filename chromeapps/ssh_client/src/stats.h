@@ -0,0 +1,169 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pthread_helpers.h"
+
+// Latency histogram with fixed power-of-two buckets. Updates are lock-free
+// and may come from any thread; readers see each field consistently but
+// not necessarily all fields from the same instant.
+class Histogram {
+ public:
+  // Bucket 0 counts samples under 1us and bucket i > 0 those in
+  // [2^(i-1), 2^i) microseconds. The last bucket also takes everything
+  // slower, from about 4 seconds up.
+  static const int kBuckets = 24;
+
+  Histogram();
+
+  void Add(uint64_t us);
+
+  uint64_t count() const { return count_; }
+  uint64_t total_us() const { return total_us_; }
+  uint64_t max_us() const { return max_us_; }
+  uint64_t bucket(int i) const { return buckets_[i]; }
+
+ private:
+  volatile uint64_t count_;
+  volatile uint64_t total_us_;
+  volatile uint64_t max_us_;
+  volatile uint64_t buckets_[kBuckets];
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// Process-wide counters for the syscall layer. They are always on and
+// cheap enough to stay that way: every update is a handful of atomic
+// adds, and nothing is formatted until someone asks for a snapshot.
+class Stats {
+ public:
+  enum StreamType {
+    kTcpSocket,
+    kTcpServerSocket,
+    kUdpSocket,
+    kJsFile,
+    kJsSocket,
+    kPepperFile,
+    kStaticFile,
+    kDevTty,
+    kDevNull,
+    kDevRandom,
+    kEpoll,
+    kOtherStream,
+    kStreamTypeCount
+  };
+
+  enum Syscall {
+    kOpen,
+    kClose,
+    kRead,
+    kWrite,
+    kReadv,
+    kWritev,
+    kSeek,
+    kFstat,
+    kStat,
+    kFsync,
+    kSelect,
+    kPoll,
+    kEpollWait,
+    kGetAddrInfo,
+    kConnect,
+    kAccept,
+    kRecvFrom,
+    kSendTo,
+    kRecvMsg,
+    kSendMsg,
+    kRecvMmsg,
+    kSendMmsg,
+    kSyscallCount
+  };
+
+  struct StreamCounters {
+    // Successful reads and writes, and the bytes they moved.
+    volatile uint64_t reads;
+    volatile uint64_t writes;
+    volatile uint64_t bytes_in;
+    volatile uint64_t bytes_out;
+    Histogram read_latency;
+    Histogram write_latency;
+    // Time threads spent waiting on the stream's cond().
+    Histogram blocked;
+  };
+
+  // select(), poll() and epoll_wait() share these.
+  struct WaitCounters {
+    volatile uint64_t calls;
+    // Times a waiting thread was woken by a stream change.
+    volatile uint64_t wakeups;
+    // Wakeups that found nothing ready after all.
+    volatile uint64_t idle_wakeups;
+    // Descriptors reported ready, summed over all calls.
+    volatile uint64_t ready;
+  };
+
+  static Stats* Get();
+
+  // Wall-clock time in microseconds, for measuring intervals.
+  static uint64_t NowMicroseconds();
+
+  static const char* StreamTypeName(StreamType type);
+  static const char* SyscallName(Syscall syscall);
+
+  void RecordRead(StreamType type, size_t bytes, uint64_t us);
+  void RecordWrite(StreamType type, size_t bytes, uint64_t us);
+  void RecordBlocked(StreamType type, uint64_t us);
+  void RecordSyscall(Syscall syscall, uint64_t us);
+  // Time from a task being posted to the main thread to it starting.
+  void RecordMainThreadHop(uint64_t us);
+  void RecordWait(size_t wakeups, size_t idle_wakeups, size_t ready);
+
+  const StreamCounters& stream(StreamType type) const {
+    return streams_[type];
+  }
+  const Histogram& syscall(Syscall syscall) const {
+    return syscalls_[syscall];
+  }
+  const Histogram& main_thread_hop() const { return main_thread_hop_; }
+  const WaitCounters& wait() const { return wait_; }
+
+ private:
+  Stats();
+
+  StreamCounters streams_[kStreamTypeCount];
+  Histogram syscalls_[kSyscallCount];
+  Histogram main_thread_hop_;
+  WaitCounters wait_;
+
+  DISALLOW_COPY_AND_ASSIGN(Stats);
+};
+
+// Records the time until it goes out of scope against a syscall.
+class SyscallTimer {
+ public:
+  explicit SyscallTimer(Stats::Syscall syscall)
+      : syscall_(syscall), start_(Stats::NowMicroseconds()) {}
+  ~SyscallTimer() {
+    Stats::Get()->RecordSyscall(syscall_, elapsed());
+  }
+
+  uint64_t elapsed() const {
+    uint64_t now = Stats::NowMicroseconds();
+    // gettimeofday can step backwards.
+    return now > start_ ? now - start_ : 0;
+  }
+
+ private:
+  Stats::Syscall syscall_;
+  uint64_t start_;
+
+  DISALLOW_COPY_AND_ASSIGN(SyscallTimer);
+};
+
+#endif  // STATS_H
@@ -2,14 +2,17 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <termios.h>
 
 #include "nacl-mounts/base/irt_syscalls.h"
@@ -124,6 +127,15 @@ int isatty(int fd) {
   return FileSystem::GetFileSystem()->isatty(fd);
 }
 
+int fsync(int fd) {
+  LOG("fsync: %d\n", fd);
+  return FileSystem::GetFileSystem()->fsync(fd);
+}
+
+int fdatasync(int fd) {
+  return fsync(fd);
+}
+
 int fcntl(int fd, int cmd, ...) {
   LOG("fcntl: %d %d\n", fd, cmd);
   va_list ap;
@@ -165,6 +177,60 @@ int pselect(int nfds, fd_set *readfds, fd_set *writefds,
                                              timeout ? &tv : NULL);
 }
 
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  VLOG("poll: %d\n", nfds);
+  struct timespec ts;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+  }
+  return FileSystem::GetFileSystem()->poll(fds, nfds,
+                                           timeout >= 0 ? &ts : NULL);
+}
+
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout,
+          const sigset_t *sigmask) {
+  VLOG("ppoll: %d\n", nfds);
+  // Signal masks are ignored, as in pselect.
+  return FileSystem::GetFileSystem()->poll(fds, nfds, timeout);
+}
+
+int epoll_create(int size) {
+  LOG("epoll_create: %d\n", size);
+  if (size <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return FileSystem::GetFileSystem()->epoll_create(0);
+}
+
+int epoll_create1(int flags) {
+  LOG("epoll_create1: %d\n", flags);
+  return FileSystem::GetFileSystem()->epoll_create(flags);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+  VLOG("epoll_ctl: %d %d %d\n", epfd, op, fd);
+  return FileSystem::GetFileSystem()->epoll_ctl(epfd, op, fd, event);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events,
+               int maxevents, int timeout) {
+  VLOG("epoll_wait: %d %d\n", epfd, maxevents);
+  struct timespec ts;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+  }
+  return FileSystem::GetFileSystem()->epoll_wait(epfd, events, maxevents,
+                                                 timeout >= 0 ? &ts : NULL);
+}
+
+int epoll_pwait(int epfd, struct epoll_event *events,
+                int maxevents, int timeout, const sigset_t *sigmask) {
+  return epoll_wait(epfd, events, maxevents, timeout);
+}
+
 //------------------------------------------------------------------------------
 
 void exit(int status) {
@@ -313,8 +379,8 @@ int setsockopt(int socket, int level, int option_name,
 int getsockopt(int socket, int level, int option_name,
                void * option_value, socklen_t * option_len) {
   LOG("getsockopt: %d %d %d\n", socket, level, option_name);
-  memset(option_value, 0, *option_len);
-  return 0;
+  return FileSystem::GetFileSystem()->getsockopt(socket, level, option_name,
+                                                 option_value, option_len);
 }
 
 int shutdown(int s, int how) {
@@ -359,6 +425,28 @@ ssize_t recv(int fd, void *buf, size_t count, int flags) {
   return rv == 0 ? recvd : -1;
 }
 
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+  VLOG("readv: %d %d\n", fd, iovcnt);
+  size_t nread = 0;
+  int rv = FileSystem::GetFileSystem()->readv(fd, iov, iovcnt, &nread);
+  if (rv) {
+    errno = rv;
+    return -1;
+  }
+  return nread;
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  VLOG("writev: %d %d\n", fd, iovcnt);
+  size_t nwrote = 0;
+  int rv = FileSystem::GetFileSystem()->writev(fd, iov, iovcnt, &nwrote);
+  if (rv) {
+    errno = rv;
+    return -1;
+  }
+  return nwrote;
+}
+
 ssize_t sendto(int sockfd, const void* buf, size_t len, int flags,
                const struct sockaddr* dest_addr, socklen_t addrlen) {
   VLOG("sendto: %d %d %d\n", sockfd, len, flags);
@@ -373,6 +461,29 @@ ssize_t recvfrom(int socket, void * buffer, size_t len, int flags,
                                                addr, addrlen);
 }
 
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+  VLOG("sendmsg: %d %d\n", sockfd, flags);
+  return FileSystem::GetFileSystem()->sendmsg(sockfd, msg, flags);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  VLOG("recvmsg: %d %d\n", sockfd, flags);
+  return FileSystem::GetFileSystem()->recvmsg(sockfd, msg, flags);
+}
+
+int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+             int flags) {
+  VLOG("sendmmsg: %d %d %d\n", sockfd, vlen, flags);
+  return FileSystem::GetFileSystem()->sendmmsg(sockfd, msgvec, vlen, flags);
+}
+
+int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen,
+             int flags, struct timespec* timeout) {
+  VLOG("recvmmsg: %d %d %d\n", sockfd, vlen, flags);
+  return FileSystem::GetFileSystem()->recvmmsg(sockfd, msgvec, vlen, flags,
+                                               timeout);
+}
+
 }
 
 extern "C" void DoWrapSysCalls() {
@@ -0,0 +1,125 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "task_queue.h"
+
+#include "ppapi/cpp/module.h"
+
+// static
+TaskQueue* TaskQueue::Get() {
+  static TaskQueue queue;
+  return &queue;
+}
+
+TaskQueue::TaskQueue()
+  : head_(&stub_), tail_(&stub_), depth_(0), posted_(0), max_depth_(0),
+    run_(0), pumps_(0), pump_scheduled_at_(0), total_drain_latency_us_(0),
+    max_drain_latency_us_(0) {
+  stub_.next = NULL;
+}
+
+void TaskQueue::Post(const pp::CompletionCallback& callback) {
+  Node* node = new Node();
+  node->next = NULL;
+  node->callback = callback;
+  node->posted_at = ::Stats::NowMicroseconds();
+  __sync_add_and_fetch(&posted_, 1);
+
+  size_t depth = __sync_add_and_fetch(&depth_, 1);
+  for (size_t max = max_depth_; depth > max; max = max_depth_) {
+    if (__sync_bool_compare_and_swap(&max_depth_, max, depth))
+      break;
+  }
+  Push(node);
+  if (depth == 1)
+    SchedulePump();
+}
+
+void TaskQueue::GetStats(Stats* stats) {
+  stats->posted = posted_;
+  stats->run = run_;
+  stats->pumps = pumps_;
+  stats->depth = depth_;
+  stats->max_depth = max_depth_;
+  stats->total_drain_latency_us = total_drain_latency_us_;
+  stats->max_drain_latency_us = max_drain_latency_us_;
+}
+
+void TaskQueue::Push(Node* node) {
+  node->next = NULL;
+  Node* prev;
+  do {
+    prev = head_;
+  } while (!__sync_bool_compare_and_swap(&head_, prev, node));
+  // Until this store lands the consumer sees the list end at prev.
+  __sync_synchronize();
+  prev->next = node;
+}
+
+TaskQueue::Node* TaskQueue::Pop() {
+  Node* tail = tail_;
+  Node* next = tail->next;
+  if (tail == &stub_) {
+    if (!next)
+      return NULL;
+    tail_ = next;
+    tail = next;
+    next = next->next;
+  }
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  if (tail != head_)
+    return NULL;
+  // tail is the last node. Put the stub back behind it so it can go.
+  Push(&stub_);
+  next = tail->next;
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  return NULL;
+}
+
+void TaskQueue::SchedulePump() {
+  pump_scheduled_at_ = ::Stats::NowMicroseconds();
+  pp::Module::Get()->core()->CallOnMainThread(0,
+      pp::CompletionCallback(&TaskQueue::PumpThunk, this));
+}
+
+// static
+void TaskQueue::PumpThunk(void* user_data, int32_t result) {
+  static_cast<TaskQueue*>(user_data)->Pump();
+}
+
+void TaskQueue::Pump() {
+  uint64_t now = ::Stats::NowMicroseconds();
+  uint64_t latency = now > pump_scheduled_at_ ? now - pump_scheduled_at_ : 0;
+  total_drain_latency_us_ += latency;
+  if (latency > max_drain_latency_us_)
+    max_drain_latency_us_ = latency;
+  pumps_++;
+
+  size_t ran = 0;
+  while (ran < kMaxBatch) {
+    Node* node = Pop();
+    if (!node)
+      break;
+    // Includes the time spent behind earlier callbacks in this batch.
+    now = ::Stats::NowMicroseconds();
+    ::Stats::Get()->RecordMainThreadHop(
+        now > node->posted_at ? now - node->posted_at : 0);
+    // Callbacks may post more work; it joins this batch.
+    node->callback.Run(PP_OK);
+    delete node;
+    ran++;
+  }
+  run_ += ran;
+
+  // Anything still counted is either past the batch limit or still being
+  // linked in by a producer. Either way nobody else will schedule it.
+  if (__sync_sub_and_fetch(&depth_, ran) != 0)
+    SchedulePump();
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ppapi/cpp/completion_callback.h"
+
+#include "pthread_helpers.h"
+#include "stats.h"
+
+// Runs callbacks on the main thread in batches. Any thread may post;
+// posting takes no lock and only schedules a Pepper main-thread call when
+// the queue was empty, so a burst of reads and writes from many streams
+// costs one main-thread wakeup instead of one each.
+class TaskQueue {
+ public:
+  struct Stats {
+    // Callbacks posted and run so far.
+    uint64_t posted;
+    uint64_t run;
+    // Main-thread wakeups that drained the queue.
+    uint64_t pumps;
+    // Callbacks waiting right now, and the most there have been.
+    size_t depth;
+    size_t max_depth;
+    // Time from a pump being scheduled to it starting to run, in
+    // microseconds.
+    uint64_t total_drain_latency_us;
+    uint64_t max_drain_latency_us;
+  };
+
+  static TaskQueue* Get();
+
+  // Queues |callback| to run with PP_OK on the main thread.
+  void Post(const pp::CompletionCallback& callback);
+
+  void GetStats(Stats* stats);
+
+ private:
+  struct Node {
+    Node* next;
+    pp::CompletionCallback callback;
+    // When Post was called, for the main-thread hop histogram.
+    uint64_t posted_at;
+  };
+
+  // A pump runs at most this many callbacks before yielding the main
+  // thread to Pepper and scheduling itself again.
+  static const size_t kMaxBatch = 256;
+
+  TaskQueue();
+
+  static void PumpThunk(void* user_data, int32_t result);
+
+  void Push(Node* node);
+  // Returns NULL if the queue is empty or the next node is still being
+  // linked in by a producer. Main thread only.
+  Node* Pop();
+  void SchedulePump();
+  void Pump();
+
+  // Producers swap themselves in at head_; the main thread pops at
+  // tail_. stub_ keeps the list from ever being empty.
+  Node* volatile head_;
+  Node* tail_;
+  Node stub_;
+  // Callbacks posted but not yet run. The post that raises it from zero
+  // schedules the pump; the pump owns scheduling until it drops to zero.
+  volatile size_t depth_;
+
+  volatile uint64_t posted_;
+  volatile size_t max_depth_;
+  uint64_t run_;
+  uint64_t pumps_;
+  volatile uint64_t pump_scheduled_at_;
+  uint64_t total_drain_latency_us_;
+  uint64_t max_drain_latency_us_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskQueue);
+};
+
+#endif  // TASK_QUEUE_H
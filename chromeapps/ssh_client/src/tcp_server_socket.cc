@@ -18,7 +18,7 @@ TCPServerSocket::TCPServerSocket(int fd, int oflag,
   : ref_(1), fd_(fd), oflag_(oflag), factory_(this), socket_(NULL),
     sin6_(), resource_(0) {
   assert(sizeof(sin6_) >= addrlen);
-  memcpy(&sin6_, saddr, std::min(sizeof(sin6_), addrlen));
+  memcpy(&sin6_, saddr, std::min(sizeof(sin6_), static_cast<size_t>(addrlen)));
 }
 
 TCPServerSocket::~TCPServerSocket() {
@@ -27,12 +27,15 @@ TCPServerSocket::~TCPServerSocket() {
 }
 
 void TCPServerSocket::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void TCPServerSocket::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -50,9 +53,8 @@ void TCPServerSocket::close() {
     int32_t result = PP_OK_COMPLETIONPENDING;
     pp::Module::Get()->core()->CallOnMainThread(0,
         factory_.NewCallback(&TCPServerSocket::Close, &result));
-    FileSystem* sys = FileSystem::GetFileSystem();
     while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
   }
 }
 
@@ -83,9 +85,8 @@ bool TCPServerSocket::listen(int backlog) {
   int32_t result = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(0,
       factory_.NewCallback(&TCPServerSocket::Listen, backlog, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
   return result == PP_OK;
 }
 
@@ -124,7 +125,7 @@ bool TCPServerSocket::CreateNetAddress(const sockaddr* saddr,
 
 void TCPServerSocket::Listen(int32_t result, int backlog, int32_t* pres) {
   FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(!socket_);
   socket_ = new pp::TCPServerSocketPrivate(sys->instance());
 
@@ -139,12 +140,11 @@ void TCPServerSocket::Listen(int32_t result, int backlog, int32_t* pres) {
   }
 
   if (*pres != PP_OK_COMPLETIONPENDING)
-    sys->cond().broadcast();
+    NotifyStateChanged();
 }
 
 void TCPServerSocket::Accept(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(socket_);
   if (result == PP_OK) {
     result = socket_->Accept(&resource_,
@@ -154,21 +154,19 @@ void TCPServerSocket::Accept(int32_t result, int32_t* pres) {
   }
   if (pres)
     *pres = result;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void TCPServerSocket::OnAccept(int32_t result) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(socket_);
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void TCPServerSocket::Close(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   delete socket_;
   socket_ = NULL;
   *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
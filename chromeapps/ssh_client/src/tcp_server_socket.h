@@ -25,6 +25,10 @@ class TCPServerSocket : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kTcpServerSocket;
+  }
+
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
   virtual void close();
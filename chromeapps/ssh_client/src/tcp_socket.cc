@@ -4,82 +4,134 @@
 
 #include "tcp_socket.h"
 
-#include <algorithm>
 #include <assert.h>
 #include <string.h>
 
 #include "ppapi/c/pp_errors.h"
 #include "ppapi/cpp/module.h"
+#include "ppapi/cpp/private/net_address_private.h"
 
 #include "file_system.h"
+#include "task_queue.h"
+
+// A pending read keeps using the current segment while at least this much
+// of it is free.
+static const size_t kMinReadSize = 4 * 1024;
 
 TCPSocket::TCPSocket(int fd, int oflag)
   : ref_(1), fd_(fd), oflag_(oflag), factory_(this), socket_(NULL),
-    read_buf_(kBufSize), read_sent_(false), write_sent_(false) {
+    race_(NULL), connect_result_(PP_OK), so_error_(0),
+    read_segment_(NULL), write_size_(0), bytes_queued_(0), bytes_sent_(0),
+    read_sent_(false), write_sent_(false) {
 }
 
 TCPSocket::~TCPSocket() {
   assert(!socket_);
+  assert(!race_);
   assert(!ref_);
+  if (read_segment_)
+    read_segment_->release();
 }
 
 void TCPSocket::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void TCPSocket::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
 
-bool TCPSocket::connect(const char* host, uint16_t port) {
-  int32_t result = PP_OK_COMPLETIONPENDING;
+int TCPSocket::connect(const char* host, uint16_t port) {
+  connect_result_ = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(0,
-      factory_.NewCallback(&TCPSocket::Connect, host, port, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
-  while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
-  return result == PP_OK;
+      factory_.NewCallback(&TCPSocket::Connect, std::string(host), port));
+  return WaitForConnect();
+}
+
+int TCPSocket::connect(const std::vector<sockaddr_in6>& addrs,
+                       uint16_t port) {
+  assert(!race_);
+  assert(!addrs.empty());
+  race_ = new ConnectRace();
+  race_->addrs = addrs;
+  race_->port = port;
+  race_->next = 0;
+  race_->attempts.resize(addrs.size(), NULL);
+  race_->result = PP_ERROR_FAILED;
+  connect_result_ = PP_OK_COMPLETIONPENDING;
+  pp::Module::Get()->core()->CallOnMainThread(0,
+      factory_.NewCallback(&TCPSocket::StartAttempt));
+  return WaitForConnect();
+}
+
+int TCPSocket::WaitForConnect() {
+  if (!is_block())
+    return EINPROGRESS;
+  while (is_connecting())
+    WaitForStateChange();
+  int error = so_error_;
+  so_error_ = 0;
+  return error;
+}
+
+int TCPSocket::GetConnectError() {
+  if (is_connecting())
+    return EALREADY;
+  if (connect_result_ == PP_OK)
+    return EISCONN;
+  so_error_ = 0;
+  return PPErrorToErrno(connect_result_);
 }
 
 bool TCPSocket::accept(PP_Resource resource) {
   int32_t result = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(0,
       factory_.NewCallback(&TCPSocket::Accept, resource, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
   return result == PP_OK;
 }
 
 void TCPSocket::close() {
-  if (socket_) {
+  if (socket_ || is_connecting()) {
     int32_t result = PP_OK_COMPLETIONPENDING;
     pp::Module::Get()->core()->CallOnMainThread(0,
         factory_.NewCallback(&TCPSocket::Close, &result));
-    FileSystem* sys = FileSystem::GetFileSystem();
     while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
   }
 }
 
 int TCPSocket::read(char* buf, size_t count, size_t* nread) {
-  FileSystem* sys = FileSystem::GetFileSystem();
+  iovec iov = { buf, count };
+  return readv(&iov, 1, nread);
+}
+
+int TCPSocket::write(const char* buf, size_t count, size_t* nwrote) {
+  iovec iov = { const_cast<char*>(buf), count };
+  return writev(&iov, 1, nwrote);
+}
+
+int TCPSocket::readv(const iovec* iov, int iovcnt, size_t* nread) {
   if (is_block()) {
-    while (in_buf_.empty() && is_open())
-      sys->cond().wait(sys->mutex());
+    while (in_buf_.empty() && (is_open() || is_connecting()))
+      WaitForStateChange();
   }
 
-  *nread = std::min(count, in_buf_.size());
-  if (*nread) {
-    std::copy(in_buf_.begin(), in_buf_.begin() + *nread, buf);
-    in_buf_.erase(in_buf_.begin(), in_buf_.begin() + *nread);
+  *nread = 0;
+  for (int i = 0; i < iovcnt && !in_buf_.empty(); i++) {
+    *nread += in_buf_.Read(static_cast<char*>(iov[i].iov_base),
+                           iov[i].iov_len);
   }
 
   if (*nread == 0) {
-    if (!is_open()) {
+    if (!is_open() && !is_connecting()) {
       return 0;
     } else {
       *nread = -1;
@@ -92,29 +144,38 @@ int TCPSocket::read(char* buf, size_t count, size_t* nread) {
   return 0;
 }
 
-int TCPSocket::write(const char* buf, size_t count, size_t* nwrote) {
+int TCPSocket::writev(const iovec* iov, int iovcnt, size_t* nwrote) {
+  if (is_connecting()) {
+    if (!is_block()) {
+      *nwrote = -1;
+      return EAGAIN;
+    }
+    while (is_connecting())
+      WaitForStateChange();
+  }
   if (!is_open())
     return EIO;
 
-  out_buf_.insert(out_buf_.end(), buf, buf + count);
+  // The whole batch goes out with one write task.
+  size_t count = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    out_buf_.Append(static_cast<const char*>(iov[i].iov_base),
+                    iov[i].iov_len);
+    count += iov[i].iov_len;
+  }
+  bytes_queued_ += count;
+  PostWriteTask(true);
   if (is_block()) {
-    int32_t result = PP_OK_COMPLETIONPENDING;
-    PostWriteTask(&result, true);
-    FileSystem* sys = FileSystem::GetFileSystem();
-    while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
-    if ((size_t)result != count) {
+    uint64_t target = bytes_queued_;
+    while (bytes_sent_ < target && is_open())
+      WaitForStateChange();
+    if (bytes_sent_ < target) {
       *nwrote = -1;
       return EIO;
-    } else {
-      *nwrote = count;
-      return 0;
     }
-  } else {
-    PostWriteTask(NULL, true);
-    *nwrote = count;
-    return 0;
   }
+  *nwrote = count;
+  return 0;
 }
 
 int TCPSocket::fcntl(int cmd, va_list ap) {
@@ -128,24 +189,55 @@ int TCPSocket::fcntl(int cmd, va_list ap) {
   }
 }
 
+int TCPSocket::getsockopt(int level, int optname, void* optval,
+                          socklen_t* optlen) {
+  if (level == SOL_SOCKET && optname == SO_ERROR && *optlen >= sizeof(int)) {
+    *static_cast<int*>(optval) = so_error_;
+    *optlen = sizeof(int);
+    so_error_ = 0;
+    return 0;
+  }
+  return FileStream::getsockopt(level, optname, optval, optlen);
+}
+
 bool TCPSocket::is_read_ready() {
-  return !is_open() || !in_buf_.empty();
+  return !is_connecting() && (!is_open() || !in_buf_.empty());
 }
 
 bool TCPSocket::is_write_ready() {
-  return !is_open() || out_buf_.size() < kBufSize;
+  return !is_connecting() && (!is_open() || out_buf_.size() < kBufSize);
 }
 
 bool TCPSocket::is_exception() {
-  return !is_open();
+  return !is_connecting() && !is_open();
+}
+
+// static
+int TCPSocket::PPErrorToErrno(int32_t result) {
+  switch (result) {
+    case PP_OK:
+      return 0;
+    case PP_ERROR_TIMEDOUT:
+      return ETIMEDOUT;
+    case PP_ERROR_ABORTED:
+      return ECONNABORTED;
+    default:
+      // Pepper doesn't say why a connect failed.
+      return ECONNREFUSED;
+  }
+}
+
+void TCPSocket::SetConnectResult(int32_t result) {
+  connect_result_ = result;
+  so_error_ = PPErrorToErrno(result);
+  NotifyStateChanged();
 }
 
 void TCPSocket::PostReadTask() {
   if (!read_sent_ && in_buf_.size() < kBufSize / 2) {
     read_sent_ = true;
     if (!pp::Module::Get()->core()->IsMainThread()) {
-      pp::Module::Get()->core()->CallOnMainThread(
-          0, factory_.NewCallback(&TCPSocket::Read));
+      TaskQueue::Get()->Post(factory_.NewCallback(&TCPSocket::Read));
     } else {
       // If on main Pepper thread and delay is not required call it directly.
       Read(PP_OK);
@@ -153,168 +245,247 @@ void TCPSocket::PostReadTask() {
   }
 }
 
-void TCPSocket::PostWriteTask(int32_t* pres, bool always_post) {
+void TCPSocket::PostWriteTask(bool always_post) {
   if (!write_sent_ && !out_buf_.empty()) {
     write_sent_ = true;
     if (always_post || !pp::Module::Get()->core()->IsMainThread()) {
-      pp::Module::Get()->core()->CallOnMainThread(0,
-          factory_.NewCallback(&TCPSocket::Write, pres));
+      TaskQueue::Get()->Post(factory_.NewCallback(&TCPSocket::Write));
     } else {
       // If on main Pepper thread and delay is not required call it directly.
-      Write(PP_OK, pres);
+      Write(PP_OK);
     }
   }
 }
 
-void TCPSocket::Connect(int32_t result, const char* host, uint16_t port,
-                        int32_t* pres) {
+void TCPSocket::Connect(int32_t result, const std::string& host,
+                        uint16_t port) {
   FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
+  // Closed before we got here.
+  if (!is_connecting())
+    return;
   assert(!socket_);
   socket_ = new pp::TCPSocketPrivate(sys->instance());
-  *pres = socket_->Connect(host, port,
-      factory_.NewCallback(&TCPSocket::OnConnect, pres));
-  if (*pres != PP_OK_COMPLETIONPENDING)
-    sys->cond().broadcast();
+  result = socket_->Connect(host.c_str(), port,
+      factory_.NewCallback(&TCPSocket::OnConnect));
+  if (result != PP_OK_COMPLETIONPENDING)
+    OnConnect(result);
 }
 
-void TCPSocket::OnConnect(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+void TCPSocket::OnConnect(int32_t result) {
+  Mutex::Lock lock(mutex());
+  // Aborted by Close, which has already cleaned up.
+  if (!is_connecting())
+    return;
   if (result == PP_OK) {
     PostReadTask();
   } else {
     delete socket_;
     socket_ = NULL;
   }
-  *pres = result;
-  sys->cond().broadcast();
+  SetConnectResult(result);
 }
 
-void TCPSocket::Read(int32_t result) {
+void TCPSocket::StartAttempt(int32_t result) {
   FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
+  if (!race_)
+    return;
+
+  while (race_->next < race_->addrs.size()) {
+    size_t index = race_->next++;
+    const sockaddr_in6& addr = race_->addrs[index];
+    PP_NetAddress_Private netaddr = {};
+    bool created;
+    if (addr.sin6_family == AF_INET6) {
+      created = pp::NetAddressPrivate::CreateFromIPv6Address(
+          addr.sin6_addr.s6_addr, addr.sin6_scope_id, race_->port, &netaddr);
+    } else {
+      const sockaddr_in* sin4 = reinterpret_cast<const sockaddr_in*>(&addr);
+      created = pp::NetAddressPrivate::CreateFromIPv4Address(
+          reinterpret_cast<const uint8_t*>(&sin4->sin_addr), race_->port,
+          &netaddr);
+    }
+    if (!created) {
+      race_->result = PP_ERROR_FAILED;
+      continue;
+    }
+
+    pp::TCPSocketPrivate* socket = new pp::TCPSocketPrivate(sys->instance());
+    result = socket->ConnectWithNetAddress(&netaddr,
+        factory_.NewCallback(&TCPSocket::OnAttemptConnect, index));
+    if (result == PP_OK_COMPLETIONPENDING) {
+      race_->attempts[index] = socket;
+      if (race_->next < race_->addrs.size()) {
+        pp::Module::Get()->core()->CallOnMainThread(kConnectStaggerMs,
+            factory_.NewCallback(&TCPSocket::OnAttemptTimeout, race_->next));
+      }
+      return;
+    }
+    delete socket;
+    race_->result = result;
+  }
+
+  for (size_t i = 0; i < race_->attempts.size(); i++) {
+    if (race_->attempts[i])
+      return;
+  }
+  FinishRace(race_->result);
+}
+
+void TCPSocket::OnAttemptTimeout(int32_t result, size_t next) {
+  Mutex::Lock lock(mutex());
+  if (race_ && race_->next == next)
+    StartAttempt(PP_OK);
+}
+
+void TCPSocket::OnAttemptConnect(int32_t result, size_t index) {
+  Mutex::Lock lock(mutex());
+  // Attempts cancelled by FinishRace come back aborted after race_ is gone.
+  if (!race_)
+    return;
+
+  pp::TCPSocketPrivate* socket = race_->attempts[index];
+  race_->attempts[index] = NULL;
+  if (result == PP_OK) {
+    assert(!socket_);
+    socket_ = socket;
+    FinishRace(PP_OK);
+    return;
+  }
+
+  LOG("TCPSocket::OnAttemptConnect: %d address %d failed %d\n",
+      fd_, index, result);
+  delete socket;
+  race_->result = result;
+  // No point waiting out the stagger for the next one.
+  StartAttempt(PP_OK);
+}
+
+void TCPSocket::FinishRace(int32_t result) {
+  for (size_t i = 0; i < race_->attempts.size(); i++)
+    delete race_->attempts[i];
+  delete race_;
+  race_ = NULL;
+  if (result == PP_OK)
+    PostReadTask();
+  SetConnectResult(result);
+}
+
+void TCPSocket::Read(int32_t result) {
+  Mutex::Lock lock(mutex());
 
   if (!is_open()) {
     read_sent_ = false;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
-  result = socket_->Read(&read_buf_[0], read_buf_.size(),
+  if (!read_segment_ || read_segment_->available() < kMinReadSize) {
+    if (read_segment_)
+      read_segment_->release();
+    read_segment_ = new Segment(kBufSize);
+  }
+  result = socket_->Read(read_segment_->tail(), read_segment_->available(),
       factory_.NewCallback(&TCPSocket::OnRead));
   if (result != PP_OK_COMPLETIONPENDING) {
     delete socket_;
     socket_ = NULL;
     read_sent_ = false;
-    sys->cond().broadcast();
+    NotifyStateChanged();
   }
 }
 
 void TCPSocket::OnRead(int32_t result) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
 
   read_sent_ = false;
   if (!is_open()) {
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
-  if (result > 0) {
-    in_buf_.insert(in_buf_.end(),
-                   read_buf_.begin(), read_buf_.begin() + result);
+  if (result > 0 && (size_t)result <= read_segment_->available()) {
+    size_t begin = read_segment_->used();
+    read_segment_->Commit(result);
+    in_buf_.Append(read_segment_, begin, begin + result);
     PostReadTask();
   } else {
     delete socket_;
     socket_ = NULL;
   }
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
-void TCPSocket::Write(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+void TCPSocket::Write(int32_t result) {
+  Mutex::Lock lock(mutex());
 
   if (!is_open()) {
-    if (pres)
-      *pres = PP_ERROR_FAILED;
     write_sent_ = false;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
-  if (write_buf_.size()) {
-    // Previous write operation is in progress.
-    PostWriteTask(pres, true);
-    return;
-  }
-  assert(out_buf_.size());
-  write_buf_.swap(out_buf_);
-  result = socket_->Write(&write_buf_[0], write_buf_.size(),
-      factory_.NewCallback(&TCPSocket::OnWrite, pres));
+  // Pepper sends straight from the front segment of out_buf_. It is not
+  // consumed until OnWrite, and appends never move it.
+  assert(!out_buf_.empty());
+  const char* data = out_buf_.Peek(&write_size_);
+  result = socket_->Write(data, write_size_,
+      factory_.NewCallback(&TCPSocket::OnWrite));
   if (result != PP_OK_COMPLETIONPENDING) {
-    LOG("TCPSocket::Write: failed %d %d %d\n", fd_, result, write_buf_.size());
+    LOG("TCPSocket::Write: failed %d %d %d\n", fd_, result, write_size_);
     delete socket_;
     socket_ = NULL;
-    if (pres)
-      *pres = result;
     write_sent_ = false;
-    sys->cond().broadcast();
+    NotifyStateChanged();
   }
 }
 
-void TCPSocket::OnWrite(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+void TCPSocket::OnWrite(int32_t result) {
+  Mutex::Lock lock(mutex());
 
   write_sent_ = false;
   if (!is_open()) {
-    if (pres)
-      *pres = PP_ERROR_FAILED;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
-  if (result < 0 || (size_t)result > write_buf_.size()) {
+  if (result < 0 || (size_t)result > write_size_) {
     // Write error.
     LOG("TCPSocket::OnWrite: close socket %d\n", fd_);
     delete socket_;
     socket_ = NULL;
-  } else if ((size_t)result < write_buf_.size()) {
-    // Partial write. Insert remaining bytes at the beginning of out_buf_.
-    out_buf_.insert(out_buf_.begin(), &write_buf_[result], &*write_buf_.end());
-  }
-  if (pres)
-    *pres = result;
-  write_buf_.clear();
-  sys->cond().broadcast();
-
-  if (!is_block()) {
-    // For async sockets some more data could be written while Pepper sends
-    // previous portion so check do we have some data to write. For sync case,
-    // we always wait write operation completion.
-    PostWriteTask(NULL, false);
+  } else {
+    // A partial write just leaves the rest at the front of out_buf_.
+    out_buf_.Consume(result);
+    bytes_sent_ += result;
   }
+  write_size_ = 0;
+  NotifyStateChanged();
+
+  // Some more data could have been queued while Pepper sent this portion.
+  PostWriteTask(false);
 }
 
 void TCPSocket::Close(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   delete socket_;
   socket_ = NULL;
+  if (race_)
+    FinishRace(PP_ERROR_ABORTED);
+  else if (is_connecting())
+    SetConnectResult(PP_ERROR_ABORTED);
   if (pres)
     *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 bool TCPSocket::Accept(int32_t result, PP_Resource resource, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(!socket_);
   socket_ = new pp::TCPSocketPrivate(pp::PassRef(), resource);
   PostReadTask();
   *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
   return true;
 }
@@ -5,11 +5,16 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
+#include <netinet/in.h>
+
+#include <string>
 #include <vector>
 
+#include "ppapi/c/pp_errors.h"
 #include "ppapi/cpp/completion_callback.h"
 #include "ppapi/cpp/private/tcp_socket_private.h"
 
+#include "chunk_buffer.h"
 #include "file_system.h"
 #include "pthread_helpers.h"
 
@@ -22,18 +27,38 @@ class TCPSocket : public FileStream {
   int oflag() { return oflag_; }
   bool is_block() { return !(oflag_ & O_NONBLOCK); }
   bool is_open() { return socket_ != NULL; }
-
-  bool connect(const char* host, uint16_t port);
+  bool is_connecting() { return connect_result_ == PP_OK_COMPLETIONPENDING; }
+
+  // The connects return 0 or an errno value. A non-blocking socket
+  // returns EINPROGRESS and finishes in the background: it turns
+  // writable when done, and getsockopt(SO_ERROR) has the outcome.
+  int connect(const char* host, uint16_t port);
+  // Connects to the first of |addrs| to answer on |port|. Attempts start
+  // kConnectStaggerMs apart, or as soon as the previous one fails, and
+  // the rest are cancelled once one succeeds.
+  int connect(const std::vector<sockaddr_in6>& addrs, uint16_t port);
+  // What connect() on this socket again fails with: EALREADY while the
+  // first connect is in progress, EISCONN if it succeeded, and its error
+  // if it failed. Reporting the error clears SO_ERROR, as on Linux.
+  int GetConnectError();
   bool accept(PP_Resource resource);
 
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kTcpSocket;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
+  virtual int readv(const iovec* iov, int iovcnt, size_t* nread);
+  virtual int writev(const iovec* iov, int iovcnt, size_t* nwrote);
 
   virtual int fcntl(int cmd,  va_list ap);
+  virtual int getsockopt(int level, int optname, void* optval,
+                         socklen_t* optlen);
 
   virtual bool is_read_ready();
   virtual bool is_write_ready();
@@ -41,32 +66,74 @@ class TCPSocket : public FileStream {
 
  private:
   void PostReadTask();
-  void PostWriteTask(int32_t* pres, bool always_post);
+  void PostWriteTask(bool always_post);
+
+  static int PPErrorToErrno(int32_t result);
+
+  // Waits for a blocking connect to finish and returns its outcome.
+  int WaitForConnect();
+  void SetConnectResult(int32_t result);
+
+  void Connect(int32_t result, const std::string& host, uint16_t port);
+  void OnConnect(int32_t result);
 
-  void Connect(int32_t result, const char* host, uint16_t port, int32_t* pres);
-  void OnConnect(int32_t result, int32_t* pres);
+  // Starts connecting to the next untried address of race_.
+  void StartAttempt(int32_t result);
+  // Fires kConnectStaggerMs after an attempt started. |next| is the
+  // address that comes after it; another attempt may have started
+  // meanwhile.
+  void OnAttemptTimeout(int32_t result, size_t next);
+  void OnAttemptConnect(int32_t result, size_t index);
+  void FinishRace(int32_t result);
 
   void Read(int32_t result);
   void OnRead(int32_t result);
 
-  void Write(int32_t result, int32_t* pres);
-  void OnWrite(int32_t result, int32_t* pres);
+  void Write(int32_t result);
+  void OnWrite(int32_t result);
 
   void Close(int32_t result, int32_t* pres);
 
   bool Accept(int32_t result, PP_Resource resource, int32_t* pres);
 
   static const size_t kBufSize = 64 * 1024;
+  static const int32_t kConnectStaggerMs = 300;
+
+  // State of a connect() racing several addresses. Only touched on the
+  // main thread.
+  struct ConnectRace {
+    std::vector<sockaddr_in6> addrs;
+    uint16_t port;
+    // Index into addrs of the next address to try.
+    size_t next;
+    // Attempts in flight, by address index.
+    std::vector<pp::TCPSocketPrivate*> attempts;
+    // Error from the last failed attempt.
+    int32_t result;
+  };
 
   int ref_;
   int fd_;
   int oflag_;
   pp::CompletionCallbackFactory<TCPSocket, ThreadSafeRefCount> factory_;
   pp::TCPSocketPrivate* socket_;
-  std::vector<char> in_buf_;
-  std::vector<char> out_buf_;
-  std::vector<char> read_buf_;
-  std::vector<char> write_buf_;
+  ConnectRace* race_;
+  // PP_OK_COMPLETIONPENDING while a connect is in progress, then its
+  // outcome.
+  int32_t connect_result_;
+  // Pending error for getsockopt(SO_ERROR).
+  int so_error_;
+  ChunkBuffer in_buf_;
+  ChunkBuffer out_buf_;
+  // Segment the pending Pepper read lands in. OnRead hands the filled part
+  // to in_buf_ without copying.
+  Segment* read_segment_;
+  // Length of the front span of out_buf_ passed to the pending Pepper write.
+  size_t write_size_;
+  // Total bytes appended to and sent from out_buf_. A blocking write waits
+  // until bytes_sent_ reaches the total at the end of its own data.
+  uint64_t bytes_queued_;
+  uint64_t bytes_sent_;
   bool read_sent_;
   bool write_sent_;
 
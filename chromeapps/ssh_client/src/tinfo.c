@@ -1,32 +1,82 @@
+#include <stdint.h>
 #include <string.h>
 
 #include <curses.h>
 #include <term.h>
 
-/* Fake libtinfo for mosh on NaCl */
+/* Fake libtinfo for mosh on NaCl. Capabilities come from
+ * xterm-256color.ti, compiled into tinfo_table.h by gen_tinfo.py. */
+
+enum tinfo_type {
+  TINFO_FLAG,
+  TINFO_NUM,
+  TINFO_STR
+};
+
+struct tinfo_cap {
+  const char *name;
+  enum tinfo_type type;
+  int num;
+  const char *str;
+};
+
+#include "tinfo_table.h"
+
+/* Keep in sync with tinfo_slot() in gen_tinfo.py. */
+static uint32_t tinfo_slot(const char *name) {
+  uint32_t h = 2166136261u;
+  while (*name) {
+    h ^= (unsigned char)*name++;
+    h *= 16777619u;
+  }
+  return ((h ^ TINFO_HASH_SEED) * 2654435761u) >> (32 - TINFO_TABLE_BITS);
+}
+
+static const struct tinfo_cap *tinfo_lookup(const char *capname) {
+  const struct tinfo_cap *cap = &tinfo_table[tinfo_slot(capname)];
+  if (cap->name && strcmp(cap->name, capname) == 0)
+    return cap;
+  return NULL;
+}
 
 int setupterm(char *term, int filedes, int *errret) {
   if (errret) *errret = 1;
   return OK;
 }
 
+/* As in ncurses, asking for a capability as the wrong type gets -1, -2 or
+ * (char *)-1 respectively. Names the entry doesn't have are reported as
+ * absent: false, -1 or NULL. */
+
 int tigetflag(char *capname) {
-  if (strcmp(capname, "bce") == 0) {
-    return 1;
+  const struct tinfo_cap *cap = tinfo_lookup(capname);
+  if (!cap) {
+    return 0;
   }
-  return -1;
+  if (cap->type != TINFO_FLAG) {
+    return -1;
+  }
+  return 1;
 }
 
 int tigetnum(char *capname) {
-  if (strcmp(capname, "colors") == 0) {
-    return 256;
+  const struct tinfo_cap *cap = tinfo_lookup(capname);
+  if (!cap) {
+    return -1;
+  }
+  if (cap->type != TINFO_NUM) {
+    return -2;
   }
-  return -1;
+  return cap->num;
 }
 
 char *tigetstr(char *capname) {
-  if (strcmp(capname, "ech") == 0) {
-    return (char *)"\033[%p1%dX";
+  const struct tinfo_cap *cap = tinfo_lookup(capname);
+  if (!cap) {
+    return NULL;
+  }
+  if (cap->type != TINFO_STR) {
+    return (char *)-1;
   }
-  return (char *)-1;
+  return (char *)cap->str;
 }
@@ -11,20 +11,14 @@
 #include "ppapi/cpp/module.h"
 
 #include "file_system.h"
-
-template <class T>
-class ScopedDeleter {
- public:
-  ScopedDeleter(T* data) : data_(data) { }
-  ~ScopedDeleter() { delete data_; }
- private:
-  T* data_;
-  DISALLOW_COPY_AND_ASSIGN(ScopedDeleter);
-};
+#include "task_queue.h"
 
 UDPSocket::UDPSocket(int domain, int type, int fd, int oflag)
   : ref_(1), fd_(fd), oflag_(oflag), domain_(domain),
-    type_(type), factory_(this), socket_(NULL), recvfrom_len_(0) {
+    type_(type), factory_(this), socket_(NULL),
+    recv_head_(0), recv_count_(0), recv_sent_(false),
+    send_head_(0), send_count_(0), send_task_sent_(false),
+    send_in_flight_(false) {
 }
 
 UDPSocket::~UDPSocket() {
@@ -36,21 +30,23 @@ bool UDPSocket::open() {
   int32_t result = PP_OK_COMPLETIONPENDING;
   pp::Module::Get()->core()->CallOnMainThread(
       0, factory_.NewCallback(&UDPSocket::Open, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
   while(result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
+    WaitForStateChange();
   if (result != PP_OK)
     errno = EPROTONOSUPPORT;  // Bleh.
   return result == PP_OK;
 }
 
 void UDPSocket::addref() {
-  ++ref_;
+  __sync_add_and_fetch(&ref_, 1);
 }
 
 void UDPSocket::release() {
-  if (!--ref_) {
-    close();
+  if (!__sync_sub_and_fetch(&ref_, 1)) {
+    {
+      Mutex::Lock lock(mutex());
+      close();
+    }
     delete this;
   }
 }
@@ -60,9 +56,8 @@ void UDPSocket::close() {
     int32_t result = PP_OK_COMPLETIONPENDING;
     pp::Module::Get()->core()->CallOnMainThread(0,
         factory_.NewCallback(&UDPSocket::Close, &result));
-    FileSystem* sys = FileSystem::GetFileSystem();
     while(result == PP_OK_COMPLETIONPENDING)
-      sys->cond().wait(sys->mutex());
+      WaitForStateChange();
   }
 }
 
@@ -78,31 +73,69 @@ int UDPSocket::read(char* buf, size_t count, size_t* nread) {
 
 ssize_t UDPSocket::recvfrom(void* buf, size_t len, int flags,
                             sockaddr* src_addr, socklen_t* addrlen) {
-  if (!is_open()) {
-    errno = EIO;
-    return -1;
+  iovec iov = { buf, len };
+  msghdr msg = {};
+  msg.msg_name = src_addr;
+  msg.msg_namelen = src_addr ? *addrlen : 0;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  ssize_t ret = recvmsg(&msg, flags);
+  if (ret >= 0 && src_addr)
+    *addrlen = msg.msg_namelen;
+  return ret;
+}
+
+int UDPSocket::readv(const iovec* iov, int iovcnt, size_t* nread) {
+  msghdr msg = {};
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+  ssize_t ret = recvmsg(&msg, 0);
+  if (ret < 0) {
+    *nread = -1;
+    return errno;
   }
+  *nread = ret;
+  return 0;
+}
 
-  FileSystem* sys = FileSystem::GetFileSystem();
-  if (is_block()) {
-    while (!recvfrom_len_ && is_open())
-      sys->cond().wait(sys->mutex());
+ssize_t UDPSocket::recvmsg(msghdr* msg, int flags) {
+  if (is_block() && !(flags & MSG_DONTWAIT)) {
+    while (!recv_count_ && is_open())
+      WaitForStateChange();
+  }
+
+  if (!recv_count_) {
+    errno = is_open() ? EAGAIN : EIO;
+    return -1;
   }
 
   // Got a packet. Copy it in.
-  size_t bytes_received = std::min(len, recvfrom_len_);
-  if (src_addr) {
-    memcpy(buf, recvfrom_buf_, bytes_received);
-    memcpy(src_addr, &recvfrom_address_,
-           std::min(*addrlen, sizeof(recvfrom_address_)));
-    *addrlen = (recvfrom_address_.ss_family == AF_INET6) ?
+  Packet* packet = &recv_ring_[recv_head_];
+  size_t bytes_received = 0;
+  for (size_t i = 0; i < msg->msg_iovlen && bytes_received < packet->len;
+       i++) {
+    size_t n = std::min(msg->msg_iov[i].iov_len,
+                        packet->len - bytes_received);
+    memcpy(msg->msg_iov[i].iov_base, packet->buf + bytes_received, n);
+    bytes_received += n;
+  }
+  msg->msg_flags = bytes_received < packet->len ? MSG_TRUNC : 0;
+  msg->msg_controllen = 0;
+  if (msg->msg_name) {
+    memcpy(msg->msg_name, &packet->address,
+           std::min(static_cast<size_t>(msg->msg_namelen),
+                    sizeof(packet->address)));
+    msg->msg_namelen = (packet->address.ss_family == AF_INET6) ?
         sizeof(sockaddr_in6) : sizeof(sockaddr_in);
   }
+  recv_head_ = (recv_head_ + 1) % kRecvSlots;
+  recv_count_--;
 
-  // Fire off the next RecvFrom.
-  recvfrom_len_ = 0;
-  pp::Module::Get()->core()->CallOnMainThread(
-      0, factory_.NewCallback(&UDPSocket::RecvFrom));
+  // If the ring was full, OnRecvFrom stopped pulling packets. Fire off
+  // the next RecvFrom now that there is room.
+  if (!recv_sent_ && is_open()) {
+    TaskQueue::Get()->Post(factory_.NewCallback(&UDPSocket::RecvFrom));
+  }
 
   return bytes_received;
 }
@@ -122,33 +155,75 @@ int UDPSocket::write(const char* buf, size_t count, size_t* nwrote) {
 
 ssize_t UDPSocket::sendto(const void* buf, size_t len, int flags,
                           const sockaddr* dest_addr, socklen_t addrlen) {
+  iovec iov = { const_cast<void*>(buf), len };
+  msghdr msg = {};
+  msg.msg_name = const_cast<sockaddr*>(dest_addr);
+  msg.msg_namelen = addrlen;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  return sendmsg(&msg, flags);
+}
+
+int UDPSocket::writev(const iovec* iov, int iovcnt, size_t* nwrote) {
+  msghdr msg = {};
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+  ssize_t ret = sendmsg(&msg, 0);
+  if (ret < 0) {
+    *nwrote = -1;
+    return errno;
+  }
+  *nwrote = ret;
+  return 0;
+}
+
+ssize_t UDPSocket::sendmsg(const msghdr* msg, int flags) {
   if (!is_open()) {
     errno = EIO;
     return -1;
   }
+  if (!msg->msg_name) {
+    errno = EDESTADDRREQ;
+    return -1;
+  }
+  size_t len = 0;
+  for (size_t i = 0; i < msg->msg_iovlen; i++)
+    len += msg->msg_iov[i].iov_len;
+  if (len > kBufSize || msg->msg_namelen > sizeof(sockaddr_storage)) {
+    errno = len > kBufSize ? EMSGSIZE : EINVAL;
+    return -1;
+  }
 
-  SendToData* data = new SendToData;
-  data->buf = buf;
-  data->len = len;
-  data->dest_addr = dest_addr;
-  data->addrlen = addrlen;
-  int32_t result = PP_OK_COMPLETIONPENDING;
-  pp::Module::Get()->core()->CallOnMainThread(
-      0, factory_.NewCallback(&UDPSocket::SendTo, data, &result));
-  FileSystem* sys = FileSystem::GetFileSystem();
-  while (result == PP_OK_COMPLETIONPENDING)
-    sys->cond().wait(sys->mutex());
-
-  if (result != PP_OK) {
-    LOG("EIO\n");
-    errno = EIO;
+  if (is_block() && !(flags & MSG_DONTWAIT)) {
+    while (send_count_ == kSendSlots && is_open())
+      WaitForStateChange();
+    if (!is_open()) {
+      errno = EIO;
+      return -1;
+    }
+  }
+  if (send_count_ == kSendSlots) {
+    errno = EAGAIN;
     return -1;
   }
 
+  Packet* packet = &send_ring_[(send_head_ + send_count_) % kSendSlots];
+  memcpy(&packet->address, msg->msg_name, msg->msg_namelen);
+  char* p = packet->buf;
+  for (size_t i = 0; i < msg->msg_iovlen; i++) {
+    memcpy(p, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+    p += msg->msg_iov[i].iov_len;
+  }
+  packet->len = len;
+  send_count_++;
+
+  if (!send_task_sent_ && !send_in_flight_) {
+    send_task_sent_ = true;
+    TaskQueue::Get()->Post(factory_.NewCallback(&UDPSocket::SendTo));
+  }
   return len;
 }
 
-
 int UDPSocket::fcntl(int cmd, va_list ap) {
   if (cmd == F_GETFL) {
     return oflag_;
@@ -161,17 +236,12 @@ int UDPSocket::fcntl(int cmd, va_list ap) {
 }
 
 bool UDPSocket::is_read_ready() {
-  LOG("is_read_ready: len = %d\n", recvfrom_len_);
-  return !is_open() || recvfrom_len_ > 0;
+  LOG("is_read_ready: count = %d\n", recv_count_);
+  return !is_open() || recv_count_ > 0;
 }
 
 bool UDPSocket::is_write_ready() {
-  // TODO(davidben): Buffer packets so we don't spam
-  // pp::UDPSocketPrivate::SendTo? I think mosh ignores this, so we
-  // should just be able to discard errors. It's UDP anyway, and it's
-  // unclear how long before pp::UDPSocketPrivate::SendTo's callback
-  // returns.
-  return true;
+  return !is_open() || send_count_ < kSendSlots;
 }
 
 bool UDPSocket::is_exception() {
@@ -180,13 +250,13 @@ bool UDPSocket::is_exception() {
 
 void UDPSocket::Open(int32_t result, int32_t* pres) {
   FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   assert(!socket_);
 
   if (!pp::UDPSocketPrivate::IsAvailable()) {
     LOG("UDPSocketPrivate not available\n");
     *pres = PP_ERROR_NOTSUPPORTED;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
@@ -200,7 +270,7 @@ void UDPSocket::Open(int32_t result, int32_t* pres) {
   if (!pp::NetAddressPrivate::GetAnyAddress(domain_ == AF_INET6, &addr)) {
     LOG("pp::NetAddressPrivate::GetAnyAddress failed!\n");
     *pres = PP_ERROR_FAILED;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
@@ -211,104 +281,118 @@ void UDPSocket::Open(int32_t result, int32_t* pres) {
 }
 
 void UDPSocket::OnBind(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
 
   assert(socket_);
   if (result != PP_OK) {
     LOG("pp::UDPSocket::OnBind failed!\n");
     *pres = PP_ERROR_FAILED;
-    sys->cond().broadcast();
+    NotifyStateChanged();
     return;
   }
 
   // Finally, we're ready. Fire off the first RecvFrom and go.
   RecvFrom(PP_OK);
   *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
 void UDPSocket::RecvFrom(int32_t) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  if (!is_open())
+  Mutex::Lock lock(mutex());
+  if (!is_open() || recv_sent_ || recv_count_ == kRecvSlots)
     return;
 
-  assert(recvfrom_len_ == 0);
   LOG("RecvFrom\n");
-  int ret = socket_->RecvFrom(recvfrom_buf_, kBufSize,
+  Packet* packet = &recv_ring_[(recv_head_ + recv_count_) % kRecvSlots];
+  recv_sent_ = true;
+  int ret = socket_->RecvFrom(packet->buf, kBufSize,
                               factory_.NewCallback(&UDPSocket::OnRecvFrom));
   assert(ret == PP_OK_COMPLETIONPENDING);
   (void)ret;
 }
 
 void UDPSocket::OnRecvFrom(int32_t result) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
+  recv_sent_ = false;
   if (!is_open())
     return;
   LOG("OnRecvFrom (%d)\n", result);
 
+  Packet* packet = &recv_ring_[(recv_head_ + recv_count_) % kRecvSlots];
   PP_NetAddress_Private address = { };
   if (result > 0 && !socket_->GetRecvFromAddress(&address)) {
     LOG("UDPSocketPrivate::GetRecvFromAddress failed!\n");
     result = PP_ERROR_FAILED;
   }
   if (result > 0 && !NetAddressToSockAddr(
-          address, reinterpret_cast<sockaddr*>(&recvfrom_address_))) {
+          address, reinterpret_cast<sockaddr*>(&packet->address))) {
     result = PP_ERROR_FAILED;
   }
   if (result > 0) {
-    recvfrom_len_ = result;
+    packet->len = result;
+    recv_count_++;
+    // Keep pulling while we have room; we are already on the main
+    // thread.
+    RecvFrom(PP_OK);
   } else {
     LOG("UDPSocketPrivate::RecvFrom failed! (%d)\n", result);
     delete socket_;
     socket_ = NULL;
   }
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
-void UDPSocket::SendTo(int32_t result, SendToData* data, int32_t* pres) {
-  ScopedDeleter<SendToData> del(data);
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
-  if (!is_open()) {
-    *pres = PP_ERROR_FAILED;
-    sys->cond().broadcast();
-    return;
-  }
-
-  // Convert the sockaddr.
-  PP_NetAddress_Private addr = { };
-  if (!SockAddrToNetAddress(data->dest_addr, data->addrlen, &addr)) {
-    *pres = PP_ERROR_FAILED;
-    sys->cond().broadcast();
-    return;
-  }
-
-  // Actually send the data. We have no information about the OS's
-  // buffer, and the callback may not run until then. So return
-  // immediately and ignore the callback. Make this an optional
-  // callback on the off-chance we can get an error synchronously.
-  pp::CompletionCallback cb = factory_.NewCallback(&UDPSocket::OnSendTo);
-  int ret = socket_->SendTo(
-      reinterpret_cast<const char*>(data->buf), data->len, &addr, cb);
-  if (ret != PP_OK_COMPLETIONPENDING) {
-    // Free the data.
-    cb.Run(ret);
-  } else {
-    ret = PP_OK;
-  }
-  *pres = ret;
-  sys->cond().broadcast();
+void UDPSocket::SendTo(int32_t result) {
+  Mutex::Lock lock(mutex());
+  send_task_sent_ = false;
+  DrainSendQueue();
 }
 
 void UDPSocket::OnSendTo(int32_t result) {
+  Mutex::Lock lock(mutex());
+  send_in_flight_ = false;
   // TODO(davidben): It would be good to map this to an errno and
-  // plumb back to mosh. But we can't be sure that won't block the
-  // caller.
+  // plumb back to mosh. But the packet was already accepted by
+  // sendto(). It's UDP anyway.
   if (result < 0)
     LOG("UDPSocket::SendTo failed (%d)!\n", result);
+  if (!is_open())
+    return;
+
+  assert(send_count_ > 0);
+  send_head_ = (send_head_ + 1) % kSendSlots;
+  send_count_--;
+  DrainSendQueue();
+}
+
+void UDPSocket::DrainSendQueue() {
+  size_t drained = 0;
+  while (is_open() && send_count_ > 0 && !send_in_flight_) {
+    Packet* packet = &send_ring_[send_head_];
+
+    // Convert the sockaddr.
+    PP_NetAddress_Private addr = { };
+    int ret = PP_ERROR_FAILED;
+    if (SockAddrToNetAddress(reinterpret_cast<sockaddr*>(&packet->address),
+                             sizeof(packet->address), &addr)) {
+      ret = socket_->SendTo(packet->buf, packet->len, &addr,
+                            factory_.NewCallback(&UDPSocket::OnSendTo));
+    }
+    if (ret == PP_OK_COMPLETIONPENDING) {
+      // The packet stays at the head of the ring until OnSendTo.
+      send_in_flight_ = true;
+      break;
+    }
+
+    // Completed (or failed) synchronously. Drop it and move on.
+    if (ret < 0)
+      LOG("UDPSocket::SendTo failed (%d)!\n", ret);
+    send_head_ = (send_head_ + 1) % kSendSlots;
+    send_count_--;
+    drained++;
+  }
+  if (drained || send_in_flight_)
+    NotifyStateChanged();
 }
 
 // static
@@ -380,12 +464,11 @@ bool UDPSocket::NetAddressToSockAddr(const PP_NetAddress_Private& netaddress,
 }
 
 void UDPSocket::Close(int32_t result, int32_t* pres) {
-  FileSystem* sys = FileSystem::GetFileSystem();
-  Mutex::Lock lock(sys->mutex());
+  Mutex::Lock lock(mutex());
   delete socket_;
   socket_ = NULL;
   if (pres)
     *pres = PP_OK;
-  sys->cond().broadcast();
+  NotifyStateChanged();
 }
 
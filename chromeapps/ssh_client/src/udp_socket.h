@@ -29,6 +29,10 @@ class UDPSocket : public FileStream {
   virtual void addref();
   virtual void release();
 
+  virtual Stats::StreamType stream_type() const {
+    return Stats::kUdpSocket;
+  }
+
   virtual void close();
   virtual int read(char* buf, size_t count, size_t* nread);
   virtual int write(const char* buf, size_t count, size_t* nwrote);
@@ -37,6 +41,12 @@ class UDPSocket : public FileStream {
                            sockaddr* src_addr, socklen_t* addrlen);
   virtual ssize_t sendto(const void* buf, size_t len, int flags,
                          const sockaddr* dest_addr, socklen_t addrlen);
+  // Each call moves exactly one datagram, gathered from or scattered into
+  // the buffers.
+  virtual int readv(const iovec* iov, int iovcnt, size_t* nread);
+  virtual int writev(const iovec* iov, int iovcnt, size_t* nwrote);
+  virtual ssize_t recvmsg(msghdr* msg, int flags);
+  virtual ssize_t sendmsg(const msghdr* msg, int flags);
 
   virtual int fcntl(int cmd,  va_list ap);
 
@@ -59,16 +69,9 @@ class UDPSocket : public FileStream {
   void RecvFrom(int32_t result);
   void OnRecvFrom(int32_t result);
 
-  // CompletionCallbackFactory only has overloads to bind up to three
-  // arguments into the closure.
-  struct SendToData {
-    const void* buf;
-    size_t len;
-    const sockaddr* dest_addr;
-    socklen_t addrlen;
-  };
-  void SendTo(int32_t result, SendToData* data, int32_t* pres);
+  void SendTo(int32_t result);
   void OnSendTo(int32_t result);
+  void DrainSendQueue();
 
   int ref_;
   int fd_;
@@ -78,16 +81,43 @@ class UDPSocket : public FileStream {
   pp::CompletionCallbackFactory<UDPSocket, ThreadSafeRefCount> factory_;
   pp::UDPSocketPrivate* socket_;
 
-  // We buffer one packet at a time. Unfortuately, because we cannot
-  // get read-ready state, we must (like TCPSocket) continually pull
-  // data and drive select by the buffer. But UDP packets are not a
-  // stream, so the size of the buffer matters. Use 4096 which is
-  // larger than what mosh needs and appears to be what Chrome uses
-  // internally?
+  // UDP packets are not a stream, so the size of the buffer
+  // matters. Use 4096 which is larger than what mosh needs and
+  // appears to be what Chrome uses internally?
   static const size_t kBufSize = 4096;
-  sockaddr_storage recvfrom_address_;
-  char recvfrom_buf_[kBufSize];
-  size_t recvfrom_len_;
+  // Number of packets we queue before we stop pulling from the
+  // browser. Bursts after roaming or a large screen update easily
+  // exceed a single packet.
+  static const size_t kRecvSlots = 32;
+  // Number of outgoing packets we queue before sendto() blocks or
+  // fails with EAGAIN.
+  static const size_t kSendSlots = 32;
+
+  struct Packet {
+    sockaddr_storage address;
+    size_t len;
+    char buf[kBufSize];
+  };
+
+  // Because we cannot get read-ready state, we must (like TCPSocket)
+  // continually pull data and drive select by the buffer. Received
+  // packets go into a fixed ring of preallocated slots. Pepper only
+  // allows one RecvFrom in flight, so OnRecvFrom re-arms it directly
+  // on the main thread while there is a free slot. recvfrom() only
+  // needs to post a task when it frees a slot in a full ring.
+  Packet recv_ring_[kRecvSlots];
+  size_t recv_head_;
+  size_t recv_count_;
+  bool recv_sent_;
+
+  // sendto() copies packets into this ring and returns immediately.
+  // The main thread drains it in SendTo/OnSendTo, one Pepper SendTo
+  // in flight at a time, without going back to the sending thread.
+  Packet send_ring_[kSendSlots];
+  size_t send_head_;
+  size_t send_count_;
+  bool send_task_sent_;
+  bool send_in_flight_;
 
   DISALLOW_COPY_AND_ASSIGN(UDPSocket);
 };